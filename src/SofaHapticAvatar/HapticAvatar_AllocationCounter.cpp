@@ -0,0 +1,71 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_AllocationCounter.h>
+
+#ifdef SOFAHAPTICAVATAR_TRACK_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    thread_local uint64_t t_allocationCount = 0;
+
+    void* countedAllocation(std::size_t size)
+    {
+        ++t_allocationCount;
+        if (void* ptr = std::malloc(size == 0 ? 1 : size))
+            return ptr;
+        throw std::bad_alloc();
+    }
+}
+
+void* operator new(std::size_t size) { return countedAllocation(size); }
+void* operator new[](std::size_t size) { return countedAllocation(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+#endif
+
+namespace sofa::HapticAvatar
+{
+
+    uint64_t getThreadAllocationCount()
+    {
+#ifdef SOFAHAPTICAVATAR_TRACK_ALLOCATIONS
+        return t_allocationCount;
+#else
+        return 0;
+#endif
+    }
+
+    bool isAllocationCountTracked()
+    {
+#ifdef SOFAHAPTICAVATAR_TRACK_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+} // namespace sofa::HapticAvatar
@@ -0,0 +1,40 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <cstdint>
+
+namespace sofa::HapticAvatar
+{
+
+    /**
+    * Debug counter of the heap allocations made by the calling thread.
+    * Only available when the plugin is built with SOFAHAPTICAVATAR_TRACK_ALLOCATIONS, which replaces the global
+    * operator new to count allocations per thread. Otherwise the count stays 0 and @sa isAllocationCountTracked returns false.
+    */
+    SOFA_HAPTICAVATAR_API uint64_t getThreadAllocationCount();
+
+    /// Returns true if @sa getThreadAllocationCount is really counting.
+    SOFA_HAPTICAVATAR_API bool isAllocationCountTracked();
+
+} // namespace sofa::HapticAvatar
@@ -17,9 +17,37 @@ HapticAvatar_ArticulatedDeviceController::HapticAvatar_ArticulatedDeviceControll
     : HapticAvatar_BaseDeviceController()
     , d_toolPosition(initData(&d_toolPosition, "toolPosition", "Output data position of the tool"))
     , m_forceFeedback(nullptr)
+    , m_articulationStep(0)
 {
     this->f_listening.setValue(true);
 }
 
 
+void HapticAvatar_ArticulatedDeviceController::publishArticulations(const VecCoord& articulations, double time)
+{
+    ArticulationSnapshot snapshot;
+    snapshot.size = (articulations.size() < MAX_ARTICULATIONS) ? (unsigned int)(articulations.size()) : MAX_ARTICULATIONS;
+    for (unsigned int i = 0; i < snapshot.size; i++)
+        snapshot.values[i] = articulations[i][0];
+    snapshot.step = ++m_articulationStep;
+    snapshot.time = time;
+
+    m_articulationSnapshots.publish(snapshot);
+}
+
+
+bool HapticAvatar_ArticulatedDeviceController::fetchArticulations(VecCoord& articulations, ArticulationSnapshot& snapshot)
+{
+    if (m_articulationSnapshots.fetch(snapshot))
+    {
+        // only allocates the first time, or if the number of articulations changes
+        if (articulations.size() != snapshot.size)
+            articulations.resize(snapshot.size);
+        for (unsigned int i = 0; i < snapshot.size; i++)
+            articulations[i][0] = snapshot.values[i];
+    }
+    return snapshot.step > 0;
+}
+
+
 } // namespace sofa::HapticAvatar
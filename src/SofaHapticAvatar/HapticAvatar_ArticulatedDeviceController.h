@@ -11,6 +11,8 @@
 namespace sofa::HapticAvatar
 {
 
+#define MAX_ARTICULATIONS 8
+
 using namespace sofa::defaulttype;
 
 /**
@@ -35,6 +37,32 @@ public:
     /// Pointer to the ForceFeedback component
     LCPForceFeedback::SPtr m_forceFeedback;
 
+    /// Articulations of the tool as written in @sa d_toolPosition by the simulation thread, handed over to the haptic thread at the end of the step
+    struct ArticulationSnapshot
+    {
+        sofa::type::fixed_array<SReal, MAX_ARTICULATIONS> values;
+        unsigned int size = 0;
+        uint64_t step = 0;    ///< number of the animation step that wrote the articulations, 0 if none yet
+        double time = 0.0;    ///< simulation time at the beginning of that step. Published after its constraint solve, the force feedback holds its constraints
+    };
+
+    /** Haptic thread side: get the latest articulations published, without touching @sa d_toolPosition.
+    * @param {VecCoord} articulations: receives the articulations, resized only if their number changed.
+    * @param {ArticulationSnapshot} snapshot: receives the latest snapshot, kept if none has been published since the last call.
+    * @returns {bool} true if a snapshot has ever been published.
+    */
+    bool fetchArticulations(VecCoord& articulations, ArticulationSnapshot& snapshot);
+
+protected:
+    /** Simulation thread side: publish the articulations of @sa d_toolPosition for the haptic thread. To be called at the end of the step which
+    * wrote them, once the constraints of the force feedback have been solved for them.
+    * @param {double} time: simulation time at the beginning of the step.
+    */
+    void publishArticulations(const VecCoord& articulations, double time);
+
+    HapticAvatar_TripleBuffer<ArticulationSnapshot> m_articulationSnapshots;
+    uint64_t m_articulationStep;
+
 };
 
 } // namespace sofa::HapticAvatar
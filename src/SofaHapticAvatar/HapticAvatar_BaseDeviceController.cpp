@@ -12,6 +12,7 @@
 
 #include <sofa/core/visual/VisualParams.h>
 #include <iomanip> 
+#include <sstream>
 
 namespace sofa::HapticAvatar
 {
@@ -19,6 +20,28 @@ namespace sofa::HapticAvatar
 //constructeur
 HapticAvatar_BaseDeviceController::HapticAvatar_BaseDeviceController()
     : d_portName(initData(&d_portName, std::string("//./COM3"), "portName", "Name of the port used by this device"))
+    , d_binaryProtocol(initData(&d_binaryProtocol, false, "binaryProtocol", "Request the compact binary wire protocol, older firmware keep the Ascii protocol"))
+    , d_pipelineDepth(initData(&d_pipelineDepth, 1, "pipelineDepth", "Number of binary frames in flight before waiting for the oldest reply, 1 to wait for each reply"))
+    , d_streamPeriod(initData(&d_streamPeriod, 0, "streamPeriod", "Period in microseconds at which the device pushes the subscribed commands by itself, 0 to request them in each frame (binary protocol only)"))
+    , d_subscriptionProfile(initData(&d_subscriptionProfile, "subscriptionProfile", "XML file listing the commands to subscribe to, their period in cycles and priority lane. Default subscriptions of the device if empty"))
+    , d_cycleByteBudget(initData(&d_cycleByteBudget, 0, "cycleByteBudget", "Number of bytes a cycle can use in each direction of the link, overrides the budget of the subscription profile if positive"))
+    , d_commandStats(initData(&d_commandStats, "commandStats", "Round trip latency of each command sent to the device in microseconds (p50, p99, p99.9, max), requests, bytes and errors, refreshed at each animation step"))
+    , d_loopPeriod(initData(&d_loopPeriod, 1000, "loopPeriod", "Period of the haptic loop in microseconds"))
+    , d_loopSpinMargin(initData(&d_loopSpinMargin, 100, "loopSpinMargin", "Time in microseconds the haptic loop spins before each deadline instead of sleeping, to absorb the wake-up latency of the OS"))
+    , d_loopSlack(initData(&d_loopSlack, 1000, "loopSlack", "Lateness in microseconds after which a haptic cycle is considered missed and the loop restarts from now instead of catching up"))
+    , d_loopWakeError(initData(&d_loopWakeError, "loopWakeError", "Wake-up error of the haptic loop in microseconds after its deadlines: last, mean and max"))
+    , d_loopJitterTolerance(initData(&d_loopJitterTolerance, 100, "loopJitterTolerance", "Lateness in microseconds after which the start of a haptic cycle is counted as a deadline miss"))
+    , d_loopPeriodStats(initData(&d_loopPeriodStats, "loopPeriodStats", "Period of the haptic loop in microseconds: p50, p99, p99.9 and max"))
+    , d_loopMisses(initData(&d_loopMisses, "loopMisses", "Number of haptic cycles started late and of cycles whose work took longer than the period"))
+    , d_loopTelemetry(initData(&d_loopTelemetry, "loopTelemetry", "Histograms of the period and jitter of the haptic loop and time spent in each of its phases, refreshed at each animation step"))
+    , d_threadPolicy(initData(&d_threadPolicy, std::string("default"), "threadPolicy", "Scheduling policy of the haptic thread: default, fifo or rr"))
+    , d_threadPriority(initData(&d_threadPriority, 80, "threadPriority", "Real-time priority of the haptic thread, used with the fifo and rr policies"))
+    , d_threadCpus(initData(&d_threadCpus, "threadCpus", "CPUs the haptic thread may run on, all if empty"))
+    , d_threadName(initData(&d_threadName, std::string("HapticAvatar"), "threadName", "Name of the haptic thread in the OS tools"))
+    , d_lockMemory(initData(&d_lockMemory, false, "lockMemory", "Lock the memory of the process in RAM before starting the haptic thread, so that it never waits on a page fault"))
+    , d_threadConfigReport(initData(&d_threadConfigReport, "threadConfigReport", "Outcome of each real-time setting of the haptic thread"))
+    , d_healthSamplePeriod(initData(&d_healthSamplePeriod, 100, "healthSamplePeriod", "Number of haptic cycles between two samples of the diagnostics of the device by the health channel, 0 to disable it"))
+    , d_healthStatus(initData(&d_healthStatus, "healthStatus", "Last diagnostics of the device, active warnings and last health events, refreshed at each animation step"))
     , d_hapticIdentity(initData(&d_hapticIdentity, "hapticIdentity", "Data to store Information received by HW device"))
     , d_scale(initData(&d_scale, 1.0, "scale", "Default scale applied to the tool Coordinates"))
     , m_forceScale(initData(&m_forceScale, SReal(1.0), "forceScale", "jaws opening angle"))
@@ -28,16 +51,27 @@ HapticAvatar_BaseDeviceController::HapticAvatar_BaseDeviceController()
     , d_drawDebug(initData(&d_drawDebug, false, "drawDebugForce", "Parameter to draw debug information"))
     , d_drawLogOutputs(initData(&d_drawLogOutputs, false, "drawLogOutputs", "Parameter to draw output logs"))
     , l_portalMgr(initLink("portalManager", "link to portalManager"))    
+    , l_deviceHub(initLink("deviceHub", "link to the DeviceHub owning the driver and servicing it from its haptic thread. The device has a haptic thread of its own if not set"))
     , m_simulationStarted(false)
     , m_terminate(true)
     , m_HA_driver(nullptr)
     , m_portalMgr(nullptr)
+    , m_deviceHub(nullptr)
     , m_deviceReady(false)
     , m_portId(-1)
+    , m_healthSamplePeriod(0)
+    , m_healthCountdown(0)
 {
     this->f_listening.setValue(true);
     
     d_hapticIdentity.setReadOnly(true);
+    d_commandStats.setReadOnly(true);
+    d_loopWakeError.setReadOnly(true);
+    d_loopPeriodStats.setReadOnly(true);
+    d_loopMisses.setReadOnly(true);
+    d_loopTelemetry.setReadOnly(true);
+    d_threadConfigReport.setReadOnly(true);
+    d_healthStatus.setReadOnly(true);
 
     m_toolRot.identity();
 
@@ -47,11 +81,11 @@ HapticAvatar_BaseDeviceController::HapticAvatar_BaseDeviceController()
 HapticAvatar_BaseDeviceController::~HapticAvatar_BaseDeviceController()
 {
     clearDevice();
-    if (m_HA_driver)
+    if (m_HA_driver && m_deviceHub == nullptr)
     {
         delete m_HA_driver;
-        m_HA_driver = nullptr;
     }
+    m_HA_driver = nullptr;
 }
 
 
@@ -59,9 +93,16 @@ HapticAvatar_BaseDeviceController::~HapticAvatar_BaseDeviceController()
 void HapticAvatar_BaseDeviceController::init()
 {
     msg_info() << "HapticAvatar_BaseDeviceController::init()";
-    m_HA_driver = new HapticAvatar_DriverPort(d_portName.getValue());
+    if (!l_deviceHub.empty())
+        m_deviceHub = l_deviceHub.get();
 
-    if (!m_HA_driver->IsConnected())
+    // the driver belongs to the hub if any
+    if (m_deviceHub)
+        m_HA_driver = m_deviceHub->getPortDriver(d_portName.getValue());
+    else
+        m_HA_driver = new HapticAvatar_DriverPort(d_portName.getValue());
+
+    if (m_HA_driver == nullptr || !m_HA_driver->IsConnected())
         return;
         
     // get identity
@@ -69,6 +110,26 @@ void HapticAvatar_BaseDeviceController::init()
     d_hapticIdentity.setValue(identity);
     std::cout << "HapticAvatar_BaseDeviceController identity: '" << identity << "'" << std::endl;
 
+    if (d_binaryProtocol.getValue() && !m_HA_driver->setWireProtocol(WireProtocol::Binary))
+    {
+        msg_warning() << "Binary protocol not supported by device at " << d_portName.getValue() << ", using Ascii protocol.";
+    }
+    else if (!m_HA_driver->setPipelineDepth(d_pipelineDepth.getValue()))
+    {
+        msg_warning() << "Invalid pipelineDepth " << d_pipelineDepth.getValue() << ", waiting for each reply.";
+    }
+
+    if (!d_subscriptionProfile.getValue().empty() && !m_HA_driver->loadSubscriptionProfile(d_subscriptionProfile.getFullPath()))
+    {
+        msg_warning() << "Failed to load subscriptionProfile " << d_subscriptionProfile.getValue() << ", using the default subscriptions.";
+    }
+
+    if (d_cycleByteBudget.getValue() > 0)
+        m_HA_driver->setCycleByteBudget(d_cycleByteBudget.getValue());
+
+    if (d_streamPeriod.getValue() > 0 && m_HA_driver->getWireProtocol() == WireProtocol::Binary)
+        m_HA_driver->startStreaming(d_streamPeriod.getValue());
+
     // get access to portalMgr
     if (l_portalMgr.empty())
     {
@@ -93,12 +154,19 @@ void HapticAvatar_BaseDeviceController::init()
 void HapticAvatar_BaseDeviceController::clearDevice()
 {
     msg_info() << "HapticAvatar_BaseDeviceController::clearDevice()";
-    if (m_terminate == false && m_deviceReady)
+    if (m_deviceHub)
+    {
+        // the callbacks run by the hub use this controller
+        m_deviceHub->stop();
+    }
+    else if (m_terminate == false && m_deviceReady)
     {
         m_terminate = true;
         haptic_thread.join();
-        copy_thread.join();
     }
+
+    // after the haptic thread, the only producer of the health channel
+    m_healthMonitor.stop();
 }
 
 
@@ -134,7 +202,8 @@ void HapticAvatar_BaseDeviceController::updatePosition()
     if (!m_HA_driver)
         return;
 
-    // get info from simuData
+    // get the latest sample of the haptic thread, if any
+    m_deviceData.fetch(m_simuData);
     sofa::type::fixed_array<float, 4> dofV = m_simuData.anglesAndLength;
 
     // propagate info to portal
@@ -243,6 +312,80 @@ void HapticAvatar_BaseDeviceController::drawDebug(const sofa::core::visual::Visu
 }
 
 
+void HapticAvatar_BaseDeviceController::updateCommandStats()
+{
+    if (m_HA_driver == nullptr || !m_HA_driver->IsConnected())
+        return;
+
+    std::ostringstream oss;
+    m_HA_driver->printCommandStats(oss);
+    d_commandStats.setValue(oss.str());
+}
+
+void HapticAvatar_BaseDeviceController::updateLoopStats()
+{
+    // a device serviced by a hub is paced by the loop of its worker, not by the one of the controller
+    const HapticAvatar_LoopScheduler::Stats stats = m_deviceHub ? m_deviceHub->getLoopStats(m_HA_driver) : m_loopScheduler.getStats();
+    d_loopWakeError.setValue(sofa::type::Vec3d(stats.lastWakeErrorUs, stats.meanWakeErrorUs, stats.maxWakeErrorUs));
+
+    const HapticAvatar_LoopTelemetry::Stats telemetry = m_telemetry.getStats();
+    d_loopPeriodStats.setValue(sofa::type::Vec4d(double(telemetry.periodUs[0]), double(telemetry.periodUs[1]), double(telemetry.periodUs[2]), double(telemetry.periodUs[3])));
+    d_loopMisses.setValue(sofa::type::Vec2i(int(telemetry.deadlineMisses), int(telemetry.overruns)));
+
+    std::ostringstream oss;
+    m_telemetry.print(oss);
+    d_loopTelemetry.setValue(oss.str());
+}
+
+void HapticAvatar_BaseDeviceController::updateHealthStatus()
+{
+    if (m_healthSamplePeriod <= 0)
+        return;
+
+    d_healthStatus.setValue(m_healthMonitor.getReport());
+}
+
+void HapticAvatar_BaseDeviceController::sampleHealth()
+{
+    if (m_healthSamplePeriod <= 0 || --m_healthCountdown > 0)
+        return;
+
+    m_healthCountdown = m_healthSamplePeriod;
+    HealthSample sample;
+    if (m_HA_driver->sampleHealth(sample))
+        m_healthMonitor.sample(sample);
+}
+
+void HapticAvatar_BaseDeviceController::prepareRealTime()
+{
+    m_threadReport = ThreadConfigReport();
+    if (d_lockMemory.getValue())
+        HapticAvatar_ThreadConfig::lockMemory(m_threadReport);
+}
+
+void HapticAvatar_BaseDeviceController::configureHapticThread(std::thread& thread)
+{
+    ThreadSettings settings;
+    if (!HapticAvatar_ThreadConfig::parsePolicy(d_threadPolicy.getValue(), settings.policy))
+    {
+        msg_warning() << "Unknown threadPolicy '" << d_threadPolicy.getValue() << "', expected default, fifo or rr. Keeping the default policy.";
+    }
+    settings.priority = d_threadPriority.getValue();
+    settings.cpus.assign(d_threadCpus.getValue().begin(), d_threadCpus.getValue().end());
+    settings.name = d_threadName.getValue();
+
+    HapticAvatar_ThreadConfig::apply(thread, settings, m_threadReport);
+    d_threadConfigReport.setValue(HapticAvatar_ThreadConfig::toString(m_threadReport));
+    if (!m_threadReport.isSuccess())
+    {
+        msg_warning() << "Haptic thread real-time configuration incomplete: " << d_threadConfigReport.getValue();
+    }
+    else
+    {
+        msg_info() << "Haptic thread real-time configuration: " << d_threadConfigReport.getValue();
+    }
+}
+
 void HapticAvatar_BaseDeviceController::handleEvent(core::objectmodel::Event *event)
 {
     if (!m_deviceReady)
@@ -252,6 +395,9 @@ void HapticAvatar_BaseDeviceController::handleEvent(core::objectmodel::Event *ev
     {
         m_simulationStarted = true;
         updatePosition();
+        updateCommandStats();
+        updateLoopStats();
+        updateHealthStatus();
     }
 }
 
@@ -10,12 +10,20 @@
 
 #include <sofa/defaulttype/RigidTypes.h>
 #include <sofa/type/Vec.h>
+#include <sofa/core/objectmodel/DataFileName.h>
 
 #include <SofaUserInteraction/Controller.h>
 #include <SofaHaptics/LCPForceFeedback.h>
 
 #include <SofaHapticAvatar/HapticAvatar_DriverPort.h>
 #include <SofaHapticAvatar/HapticAvatar_PortalManager.h>
+#include <SofaHapticAvatar/HapticAvatar_DeviceHub.h>
+#include <SofaHapticAvatar/HapticAvatar_TripleBuffer.h>
+#include <SofaHapticAvatar/HapticAvatar_LoopScheduler.h>
+#include <SofaHapticAvatar/HapticAvatar_LoopTelemetry.h>
+#include <SofaHapticAvatar/HapticAvatar_HealthMonitor.h>
+#include <SofaHapticAvatar/HapticAvatar_ThreadConfig.h>
+#include <chrono>
 
 
 namespace sofa::HapticAvatar
@@ -49,6 +57,9 @@ public:
     void draw(const sofa::core::visual::VisualParams* vparams) override;
     ///}
 
+    /// Period, jitter, deadline misses, overruns and phase durations of the haptic loop, readable from any thread
+    const HapticAvatar_LoopTelemetry& getLoopTelemetry() const { return m_telemetry; }
+
 protected:
     /// Internal method to init specific info. Called by init
     virtual void initImpl() {}
@@ -63,6 +74,24 @@ protected:
     /// Will call @sa updatePortalAnglesAndLength and @sa updatePositionImpl
     virtual void updatePosition();
 
+    /// Copy the statistics of the commands sent by the driver in @sa d_commandStats
+    void updateCommandStats();
+
+    /// Copy the wake-up error of the haptic loop in @sa d_loopWakeError and its telemetry in @sa d_loopPeriodStats, @sa d_loopMisses and @sa d_loopTelemetry
+    void updateLoopStats();
+
+    /// Copy the report of the health channel in @sa d_healthStatus
+    void updateHealthStatus();
+
+    /// Haptic thread side: hand the diagnostics of the device over to the health channel every @sa d_healthSamplePeriod cycles
+    void sampleHealth();
+
+    /// Lock the memory of the process if @sa d_lockMemory. To be called before the haptic threads are created
+    void prepareRealTime();
+
+    /// Apply the real-time settings of the Data to @param thread and report the outcome in @sa d_threadConfigReport
+    void configureHapticThread(std::thread& thread);
+
     /// Method to propage
     void updatePortalAnglesAndLength(sofa::type::fixed_array<float, 4> values);
 
@@ -79,6 +108,50 @@ protected:
 public:
     /// Name of the port for this device
     Data<std::string> d_portName; 
+    /// Request the compact binary wire protocol, older firmware keep the Ascii protocol
+    Data<bool> d_binaryProtocol;
+    /// Number of binary frames in flight before waiting for the oldest reply, 1 to wait for each reply
+    Data<int> d_pipelineDepth;
+    /// Period in microseconds at which the device pushes the subscribed commands by itself, 0 to request them in each frame (binary protocol only)
+    Data<int> d_streamPeriod;
+    /// XML file listing the commands to subscribe to, their period in cycles and priority lane. Default subscriptions of the device if empty
+    sofa::core::objectmodel::DataFileName d_subscriptionProfile;
+    /// Number of bytes a cycle can use in each direction of the link, overrides the budget of the subscription profile if positive
+    Data<int> d_cycleByteBudget;
+    /// Round trip latency of each command sent to the device in microseconds (p50, p99, p99.9, max), requests, bytes and errors, refreshed at each animation step
+    Data<std::string> d_commandStats;
+    /// Period of the haptic loop in microseconds
+    Data<int> d_loopPeriod;
+    /// Time in microseconds the haptic loop spins before each deadline instead of sleeping, to absorb the wake-up latency of the OS
+    Data<int> d_loopSpinMargin;
+    /// Lateness in microseconds after which a haptic cycle is considered missed and the loop restarts from now instead of catching up
+    Data<int> d_loopSlack;
+    /// Wake-up error of the haptic loop in microseconds after its deadlines: last, mean and max. With a device hub, the one of the worker servicing the device
+    Data<sofa::type::Vec3d> d_loopWakeError;
+    /// Lateness in microseconds after which the start of a haptic cycle is counted as a deadline miss
+    Data<int> d_loopJitterTolerance;
+    /// Period of the haptic loop in microseconds: p50, p99, p99.9 and max
+    Data<sofa::type::Vec4d> d_loopPeriodStats;
+    /// Number of haptic cycles started late and of cycles whose work took longer than the period
+    Data<sofa::type::Vec2i> d_loopMisses;
+    /// Histograms of the period and jitter of the haptic loop and time spent in each of its phases, refreshed at each animation step
+    Data<std::string> d_loopTelemetry;
+    /// Scheduling policy of the haptic thread: default, fifo or rr
+    Data<std::string> d_threadPolicy;
+    /// Real-time priority of the haptic thread, used with the fifo and rr policies
+    Data<int> d_threadPriority;
+    /// CPUs the haptic thread may run on, all if empty
+    Data<sofa::type::vector<int> > d_threadCpus;
+    /// Name of the haptic thread in the OS tools
+    Data<std::string> d_threadName;
+    /// Lock the memory of the process in RAM before starting the haptic thread, so that it never waits on a page fault
+    Data<bool> d_lockMemory;
+    /// Outcome of each real-time setting of the haptic thread
+    Data<std::string> d_threadConfigReport;
+    /// Number of haptic cycles between two samples of the diagnostics of the device by the health channel, 0 to disable it
+    Data<int> d_healthSamplePeriod;
+    /// Last diagnostics of the device, active warnings and last health events, refreshed at each animation step
+    Data<std::string> d_healthStatus;
     /// Data to store Information received by HW device
     Data<std::string> d_hapticIdentity;
 
@@ -104,6 +177,8 @@ public:
     
     /// Link to the portalManager component
     SingleLink<HapticAvatar_BaseDeviceController, HapticAvatar_PortalManager, BaseLink::FLAG_STOREPATH | BaseLink::FLAG_STRONGLINK> l_portalMgr;
+    /// Link to the DeviceHub owning the driver and servicing it from its haptic thread. The device has a haptic thread of its own if not set
+    SingleLink<HapticAvatar_BaseDeviceController, HapticAvatar_DeviceHub, BaseLink::FLAG_STOREPATH | BaseLink::FLAG_STRONGLINK> l_deviceHub;
 
 public: 
     /// Data public for haptic thread
@@ -116,11 +191,17 @@ public:
         sofa::type::fixed_array<float, 3> collisionForces;
         int toolId;
         float jawOpening;
+        /// Receive sequence number of anglesAndLength in the driver, unchanged if the device has not answered since the previous sample
+        uint64_t sequence = 0;
+        /// Time at which anglesAndLength has been received from the device
+        std::chrono::steady_clock::time_point timestamp;
     };
 
-    /// Data belonging to the haptic thread only
+    /// Data belonging to the haptic thread only, published in @sa m_deviceData at each haptic loop
     DeviceData m_hapticData;
-    /// Data used in the copy thread to copy @sa m_hapticData into this data that can be used by simulation thread.
+    /// Latest sample published by the haptic thread, fetched without waiting by the simulation thread
+    HapticAvatar_TripleBuffer<DeviceData> m_deviceData;
+    /// Data belonging to the simulation thread, fetched from @sa m_deviceData at each animation step
     DeviceData m_simuData;
 
     /// Boolean to warn scheduler when SOFA has started the simulation (changed by AnimateBeginEvent)
@@ -131,10 +212,12 @@ public:
 
 
 protected:
-    /// Pointer to the internal Driver for device API communication
+    /// Pointer to the internal Driver for device API communication, owned by @sa m_deviceHub if set
     HapticAvatar_DriverPort * m_HA_driver;
     /// Pointer to the portal manager to get information from the current portal
     HapticAvatar_PortalManager * m_portalMgr;
+    /// Pointer to the DeviceHub servicing the device, nullptr if the device has its own haptic thread
+    HapticAvatar_DeviceHub * m_deviceHub;
     
     /// values returned by tool: Rot angle, Pitch angle, z Length, Yaw Angle
     DeviceData m_debugData;
@@ -145,7 +228,17 @@ protected:
     int m_portId;
     
     std::thread haptic_thread;
-    std::thread copy_thread;
+    /// Paces the haptic loop, set from @sa d_loopPeriod, @sa d_loopSpinMargin and @sa d_loopSlack
+    HapticAvatar_LoopScheduler m_loopScheduler;
+    /// Timing of the haptic loop, written by the haptic thread only
+    HapticAvatar_LoopTelemetry m_telemetry;
+    /// Diagnostics of the device, decoded off the haptic thread
+    HapticAvatar_HealthMonitor m_healthMonitor;
+    /// Set from @sa d_healthSamplePeriod when the haptic thread starts, haptic thread only
+    int m_healthSamplePeriod;
+    int m_healthCountdown;
+    /// Outcome of the real-time settings, filled by @sa prepareRealTime and @sa configureHapticThread
+    ThreadConfigReport m_threadReport;
 
 
     sofa::type::Mat3x3f m_toolRot;
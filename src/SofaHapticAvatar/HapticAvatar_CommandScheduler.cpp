@@ -0,0 +1,209 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_CommandScheduler.h>
+
+namespace sofa::HapticAvatar
+{
+
+    // Ascii values are scaled integers of up to 7 digits with sign and separator.
+    static constexpr int ASCII_VALUE_SIZE = 9;
+    // Ascii command ids are up to 2 digits with separator.
+    static constexpr int ASCII_CMD_SIZE = 3;
+
+
+    HapticAvatar_CommandScheduler::HapticAvatar_CommandScheduler()
+        : m_byteBudget(0)
+    {
+        clear();
+    }
+
+
+    void HapticAvatar_CommandScheduler::clear()
+    {
+        for (int k = 0; k < SCHEDULER_MAX_CMDS; k++)
+            m_entries[k] = Entry();
+        for (int i = 0; i < SCHEDULER_LOAD_WINDOW; i++)
+            m_load[i] = 0;
+    }
+
+
+    void HapticAvatar_CommandScheduler::subscribe(int cmd, int period, CommandLane lane, int numReturnVals, uint64_t cycle)
+    {
+        if (cmd < 0 || cmd >= SCHEDULER_MAX_CMDS)
+            return;
+
+        Entry& entry = m_entries[cmd];
+        if (entry.period > 0)
+            addLoad(entry.phase, entry.period, replyBytes(WireProtocol::Ascii, entry.numReturnVals), -1);
+
+        entry.period = (period > 0) ? period : 0;
+        entry.lane = lane;
+        entry.numReturnVals = numReturnVals;
+        if (entry.period == 0)
+            return;
+
+        // the reply dominates the size of a subscribed command
+        const int bytes = replyBytes(WireProtocol::Ascii, numReturnVals);
+        entry.phase = choosePhase(entry.period);
+        // due from the current cycle on, a command subscribed while running is not late from the start
+        const uint64_t periodCycles = uint64_t(entry.period);
+        entry.nextDue = cycle + (uint64_t(entry.phase) + periodCycles - cycle % periodCycles) % periodCycles;
+        addLoad(entry.phase, entry.period, bytes, 1);
+    }
+
+
+    void HapticAvatar_CommandScheduler::setLinkRate(int bytesPerSecond, int cycleRate, float utilization)
+    {
+        if (bytesPerSecond <= 0 || cycleRate <= 0)
+        {
+            m_byteBudget = 0;
+            return;
+        }
+        m_byteBudget = int(float(bytesPerSecond) * utilization / float(cycleRate));
+        if (m_byteBudget < 1)
+            m_byteBudget = 1;
+    }
+
+
+    int HapticAvatar_CommandScheduler::requestBytes(WireProtocol protocol, int numArgs)
+    {
+        if (protocol == WireProtocol::Binary)
+            return wire::entrySize(numArgs);
+        return ASCII_CMD_SIZE + numArgs * ASCII_VALUE_SIZE;
+    }
+
+
+    int HapticAvatar_CommandScheduler::replyBytes(WireProtocol protocol, int numReturnVals)
+    {
+        if (protocol == WireProtocol::Binary)
+            return numReturnVals * wire::VALUE_SIZE;
+        return numReturnVals * ASCII_VALUE_SIZE;
+    }
+
+
+    int HapticAvatar_CommandScheduler::collect(uint64_t cycle, WireProtocol protocol, int usedRequestBytes, int usedReplyBytes, int arenaBytes, const bool* exclude, int* cmds, int maxCmds)
+    {
+        int n = 0;
+        int request = usedRequestBytes;
+        int reply = usedReplyBytes;
+        int arena = arenaBytes;
+        bool controlOverBudget = false;
+
+        for (int lane = int(CommandLane::Control); lane <= int(CommandLane::Diagnostics); lane++)
+        {
+            // most late commands first inside a lane
+            while (n < maxCmds)
+            {
+                int best = -1;
+                for (int k = 0; k < SCHEDULER_MAX_CMDS; k++)
+                {
+                    const Entry& entry = m_entries[k];
+                    if (entry.period == 0 || effectiveLane(entry, cycle) != lane || entry.nextDue > cycle)
+                        continue;
+                    if (exclude != nullptr && exclude[k])
+                        continue;
+                    if (best < 0 || entry.nextDue < m_entries[best].nextDue)
+                        best = k;
+                }
+                if (best < 0)
+                    break;
+
+                Entry& entry = m_entries[best];
+                const int req = requestBytes(protocol, 0);
+                const int rep = replyBytes(protocol, entry.numReturnVals);
+                const bool fitsArena = (req <= arena);
+                const bool fits = fitsArena && ((m_byteBudget == 0) || (request + req <= m_byteBudget && reply + rep <= m_byteBudget));
+                if (!fits && (lane != int(CommandLane::Control) || !fitsArena))
+                {
+                    // no budget left for this lane, or no room in the arena: everything still due in it and the next lanes waits for the next cycle
+                    for (int k = 0; k < SCHEDULER_MAX_CMDS; k++)
+                    {
+                        const Entry& other = m_entries[k];
+                        if (other.period > 0 && effectiveLane(other, cycle) >= lane && other.nextDue <= cycle && !(exclude != nullptr && exclude[k]))
+                            m_stats.deferred++;
+                    }
+                    lane = int(CommandLane::Diagnostics) + 1;
+                    break;
+                }
+                controlOverBudget = controlOverBudget || !fits;
+
+                cmds[n++] = best;
+                request += req;
+                reply += rep;
+                arena -= req;
+                if (cycle - entry.nextDue > m_stats.maxLateness)
+                    m_stats.maxLateness = cycle - entry.nextDue;
+
+                // next cycle of the same phase after this one
+                entry.nextDue += uint64_t(entry.period);
+                if (entry.nextDue <= cycle)
+                    entry.nextDue += ((cycle - entry.nextDue) / uint64_t(entry.period) + 1) * uint64_t(entry.period);
+            }
+        }
+
+        if (controlOverBudget)
+            m_stats.overBudget++;
+
+        return n;
+    }
+
+
+    int HapticAvatar_CommandScheduler::effectiveLane(const Entry& entry, uint64_t cycle) const
+    {
+        // a command late by a whole period is not deferred anymore, so that a reply larger than the budget can't starve
+        if (entry.nextDue + uint64_t(entry.period) <= cycle)
+            return int(CommandLane::Control);
+        return int(entry.lane);
+    }
+
+
+    int HapticAvatar_CommandScheduler::choosePhase(int period) const
+    {
+        const int numPhases = (period < SCHEDULER_LOAD_WINDOW) ? period : SCHEDULER_LOAD_WINDOW;
+        int bestPhase = 0;
+        int bestLoad = -1;
+        for (int phase = 0; phase < numPhases; phase++)
+        {
+            int maxLoad = 0;
+            for (int i = phase; i < SCHEDULER_LOAD_WINDOW; i += period)
+            {
+                if (m_load[i] > maxLoad)
+                    maxLoad = m_load[i];
+            }
+            if (bestLoad < 0 || maxLoad < bestLoad)
+            {
+                bestLoad = maxLoad;
+                bestPhase = phase;
+            }
+        }
+        return bestPhase;
+    }
+
+
+    void HapticAvatar_CommandScheduler::addLoad(int phase, int period, int bytes, int sign)
+    {
+        for (int i = phase; i < SCHEDULER_LOAD_WINDOW; i += period)
+            m_load[i] += sign * bytes;
+    }
+
+} // namespace sofa::HapticAvatar
@@ -0,0 +1,130 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <SofaHapticAvatar/HapticAvatar_WireProtocol.h>
+#include <cstdint>
+
+namespace sofa::HapticAvatar
+{
+
+#define SCHEDULER_MAX_CMDS 64
+#define SCHEDULER_LOAD_WINDOW 1024
+
+    /// Priority lanes of the subscribed commands. A lane is only served once the lanes before it are.
+    enum class CommandLane
+    {
+        Control = 0,     ///< pose and force related data, always sent at its period
+        Status = 1,      ///< tool and device state, deferred if the cycle budget is exhausted
+        Diagnostics = 2  ///< temperatures, battery etc., sent on spare budget only
+    };
+
+    /**
+    * Scheduler of the commands subscribed by a driver. Each command has a period in cycles, a lane and a phase chosen when it is
+    * subscribed to spread the load of low-rate commands over the cycles. Each cycle, the due commands are collected lane by lane
+    * until the byte budget of the cycle is reached, in both directions: the request bytes sent and the reply bytes expected.
+    * Commands of the Control lane are only deferred when the output arena is full, the others stay due and are sent at the first cycle
+    * with enough budget, or at the latest one period after their due cycle. Without byte budget, the room left in the arena is the limit.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_CommandScheduler
+    {
+    public:
+        HapticAvatar_CommandScheduler();
+
+        /** Add, change or remove a subscription.
+        * @param {int} cmd: command id, lower than SCHEDULER_MAX_CMDS.
+        * @param {int} period: send the command every @param period cycles, 0 to remove the subscription.
+        * @param {CommandLane} lane: priority of the command.
+        * @param {int} numReturnVals: number of values in the reply of the command, used to estimate its reply size.
+        * @param {uint64_t} cycle: next cycle to be collected, the command is first due at the first cycle from it matching its phase.
+        */
+        void subscribe(int cmd, int period, CommandLane lane, int numReturnVals, uint64_t cycle = 0);
+
+        /// Remove all subscriptions.
+        void clear();
+
+        int getPeriod(int cmd) const { return (cmd >= 0 && cmd < SCHEDULER_MAX_CMDS) ? m_entries[cmd].period : 0; }
+        CommandLane getLane(int cmd) const { return m_entries[cmd].lane; }
+        int getPhase(int cmd) const { return m_entries[cmd].phase; }
+
+        /// Set the number of bytes a cycle can use in each direction, 0 for no limit.
+        void setByteBudget(int bytes) { m_byteBudget = bytes; }
+        int getByteBudget() const { return m_byteBudget; }
+
+        /** Derive the byte budget of a cycle from the link rate.
+        * @param {int} bytesPerSecond: usable rate of the link in each direction, e.g. baud rate / 10 for a 8N1 serial line.
+        * @param {int} cycleRate: number of cycles per second.
+        * @param {float} utilization: fraction of the link allowed to be used, keeping a margin for jitter.
+        */
+        void setLinkRate(int bytesPerSecond, int cycleRate, float utilization = 0.8f);
+
+        /** Collect the subscribed commands to send at @param cycle.
+        * @param {uint64_t} cycle: index of the cycle, increasing by one at each call.
+        * @param {WireProtocol} protocol: format of the frame, for the size estimates.
+        * @param {int} usedRequestBytes: request bytes already used in this cycle, e.g. by the appended commands.
+        * @param {int} usedReplyBytes: reply bytes already expected in this cycle.
+        * @param {int} arenaBytes: room left in the output arena. The commands collected always fit in it, of any lane, even without byte budget.
+        * @param {const bool *} exclude: commands not to send, e.g. pushed by the device. Can be null.
+        * @param {int *} cmds: array receiving the commands, in lane order.
+        * @param {int} maxCmds: size of @param cmds.
+        * @returns {int} the number of commands written in @param cmds.
+        */
+        int collect(uint64_t cycle, WireProtocol protocol, int usedRequestBytes, int usedReplyBytes, int arenaBytes, const bool* exclude, int* cmds, int maxCmds);
+
+        /// Estimated size in bytes of the request of a command with @param numArgs arguments.
+        static int requestBytes(WireProtocol protocol, int numArgs);
+        /// Estimated size in bytes of the reply of a command with @param numReturnVals values.
+        static int replyBytes(WireProtocol protocol, int numReturnVals);
+
+        struct Stats
+        {
+            uint64_t deferred = 0;       ///< number of times a due command has been postponed for lack of budget
+            uint64_t maxLateness = 0;    ///< largest delay of a command after its due cycle, in cycles
+            uint64_t overBudget = 0;     ///< number of cycles where the Control lane alone exceeded the budget
+        };
+
+        const Stats& getStats() const { return m_stats; }
+
+    protected:
+        struct Entry
+        {
+            int period = 0;
+            CommandLane lane = CommandLane::Status;
+            int numReturnVals = 0;
+            int phase = 0;
+            uint64_t nextDue = 0;
+        };
+
+        /// Lane a command is served in at @param cycle: its own lane, or Control once it is late by a whole period.
+        int effectiveLane(const Entry& entry, uint64_t cycle) const;
+        /// Phase of a new command minimizing the largest load of the cycles it will be sent in.
+        int choosePhase(int period) const;
+        void addLoad(int phase, int period, int bytes, int sign);
+
+        Entry m_entries[SCHEDULER_MAX_CMDS];
+        int m_load[SCHEDULER_LOAD_WINDOW]; // estimated bytes of the subscriptions at each cycle of the window
+        int m_byteBudget;
+        Stats m_stats;
+    };
+
+} // namespace sofa::HapticAvatar
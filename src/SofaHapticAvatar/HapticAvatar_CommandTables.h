@@ -0,0 +1,117 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <sofa/type/fixed_array.h>
+#include <type_traits>
+
+namespace sofa::HapticAvatar
+{
+
+    /// Type of the values returned by a command, None for the commands without return value.
+    enum class CommandValueType
+    {
+        None = 0,
+        Int,
+        Float
+    };
+
+    /// How a command appended several times before it is sent is queued, see @sa HapticAvatar_DriverBase::appendCmd
+    enum class CommandAppend
+    {
+        Queue = 0,        ///< one-shot command: every call is sent, in order
+        Latest,           ///< setpoint: only the last value is sent
+        LatestPerChannel  ///< setpoint of a channel, e.g. a collision object: only the last value for each first argument is sent
+    };
+
+    /**
+    * Description of one command of a device: the name used by the subscription profiles, the number of values the device returns,
+    * the factor converting the integers of the wire to and from floats, the type of the returned values and, for the setpoints, how they are coalesced.
+    * Each device driver has one constexpr table of them, indexed by its command enum, from which the driver and its getters are set up.
+    */
+    struct CommandDescriptor
+    {
+        const char* name;
+        int numReturnVals;
+        float scale;
+        CommandValueType type;
+        CommandAppend append = CommandAppend::Queue;
+    };
+
+    /** Check a descriptor table at compile time: every command of the enum has a named entry, a positive scale,
+    * a number of return values fitting in a row of the result table and a type if and only if it returns something.
+    * Commands returning values are never coalesced, each call expects its reply.
+    * @param {CommandDescriptor[N]} table: descriptors indexed by the command enum, N being its ALWAYS_LAST.
+    * @param {int} maxReturnVals: number of values in a row of the result table.
+    */
+    template <unsigned int N>
+    constexpr bool isValidCommandTable(const CommandDescriptor (&table)[N], int maxReturnVals)
+    {
+        for (unsigned int i = 0; i < N; i++)
+        {
+            const CommandDescriptor& cmd = table[i];
+            if (cmd.name == nullptr || cmd.scale <= 0.0f || cmd.numReturnVals < 0 || cmd.numReturnVals > maxReturnVals)
+                return false;
+            if ((cmd.numReturnVals == 0) != (cmd.type == CommandValueType::None))
+                return false;
+            if (cmd.numReturnVals > 0 && cmd.append != CommandAppend::Queue)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+    * Type of the values of a command known at compile time, read from a row of the result table: a scalar for a single value,
+    * a fixed_array of @param NumReturnVals values otherwise. Assigning it to a value of another arity does not build.
+    */
+    template <int NumReturnVals, CommandValueType Type>
+    struct CommandValue
+    {
+        static_assert(NumReturnVals > 0 && Type != CommandValueType::None, "The command does not return any value");
+
+        typedef typename std::conditional<Type == CommandValueType::Int, int, float>::type scalar_type;
+        typedef typename std::conditional<NumReturnVals == 1, scalar_type, sofa::type::fixed_array<scalar_type, NumReturnVals> >::type value_type;
+
+        static value_type read(const float* row)
+        {
+            if constexpr (NumReturnVals == 1)
+            {
+                return scalar_type(row[0]);
+            }
+            else
+            {
+                value_type values;
+                for (int i = 0; i < NumReturnVals; i++)
+                    values[i] = scalar_type(row[i]);
+                return values;
+            }
+        }
+
+        /// Value @param channel of the row, 0 if out of the values returned by the command.
+        static scalar_type read(const float* row, int channel)
+        {
+            return (channel >= 0 && channel < NumReturnVals) ? scalar_type(row[channel]) : scalar_type(0);
+        }
+    };
+
+} // namespace sofa::HapticAvatar
@@ -0,0 +1,650 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_DeviceHub.h>
+#include <sofa/core/ObjectFactory.h>
+#include <sofa/simulation/AnimateBeginEvent.h>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+namespace sofa::HapticAvatar
+{
+
+int HapticAvatar_DeviceHubClass = core::RegisterObject("Owner of the HapticAvatar device drivers, servicing all of them from a fixed pool of haptic threads.")
+    .add< HapticAvatar_DeviceHub >()
+    ;
+
+
+HapticAvatar_DeviceHub::HapticAvatar_DeviceHub()
+    : d_workerThreads(initData(&d_workerThreads, 1, "workerThreads", "Number of haptic threads servicing the devices, at most one per device. Keep it below the number of cores left to the simulation"))
+    , d_loopPeriod(initData(&d_loopPeriod, 1000, "loopPeriod", "Period of the haptic loop in microseconds"))
+    , d_loopSpinMargin(initData(&d_loopSpinMargin, 100, "loopSpinMargin", "Time in microseconds the haptic loop spins before each deadline instead of sleeping, to absorb the wake-up latency of the OS"))
+    , d_loopSlack(initData(&d_loopSlack, 1000, "loopSlack", "Lateness in microseconds after which a haptic cycle is considered missed and the loop restarts from now instead of catching up"))
+    , d_loopWakeError(initData(&d_loopWakeError, "loopWakeError", "Wake-up error of the haptic loops in microseconds after their deadlines: last of the first worker, mean and max of all"))
+    , d_threadPolicy(initData(&d_threadPolicy, std::string("default"), "threadPolicy", "Scheduling policy of the haptic threads: default, fifo or rr"))
+    , d_threadPriority(initData(&d_threadPriority, 80, "threadPriority", "Real-time priority of the haptic threads, used with the fifo and rr policies"))
+    , d_threadCpus(initData(&d_threadCpus, "threadCpus", "CPUs the haptic threads may run on, all if empty. With at least one CPU per worker, each worker is pinned to its own CPU of the list"))
+    , d_threadName(initData(&d_threadName, std::string("HapticAvatarHub"), "threadName", "Name of the haptic threads in the OS tools, followed by the index of the worker if there are several"))
+    , d_lockMemory(initData(&d_lockMemory, false, "lockMemory", "Lock the memory of the process in RAM before starting the haptic threads, so that they never wait on a page fault"))
+    , d_threadConfigReport(initData(&d_threadConfigReport, "threadConfigReport", "Outcome of each real-time setting of the haptic threads"))
+    , d_numDevices(initData(&d_numDevices, "numDevices", "Number of devices serviced by the haptic threads, and how many of them are multiplexed by the reactors"))
+    , d_deviceStats(initData(&d_deviceStats, "deviceStats", "Loop rate of each device in Hz, cycles skipped while its reply was awaited and replies given up, refreshed every second"))
+    , m_terminate(true)
+    , m_running(false)
+{
+    this->f_listening.setValue(true);
+
+    d_loopWakeError.setReadOnly(true);
+    d_threadConfigReport.setReadOnly(true);
+    d_numDevices.setReadOnly(true);
+    d_deviceStats.setReadOnly(true);
+}
+
+
+HapticAvatar_DeviceHub::~HapticAvatar_DeviceHub()
+{
+    stop();
+    for (HubDevice* device : m_devices)
+        delete device;
+    m_devices.clear();
+
+    for (OwnedDriver& owned : m_drivers)
+    {
+        delete owned.driver;
+        owned.driver = nullptr;
+    }
+    m_drivers.clear();
+}
+
+
+void HapticAvatar_DeviceHub::cleanup()
+{
+    stop();
+}
+
+
+template<class TDriver>
+TDriver* HapticAvatar_DeviceHub::getDriver(const std::string& portName)
+{
+    for (const OwnedDriver& owned : m_drivers)
+    {
+        if (owned.portName != portName)
+            continue;
+
+        TDriver* driver = dynamic_cast<TDriver*>(owned.driver);
+        if (driver == nullptr)
+        {
+            msg_error() << "Port " << portName << " is already used by another type of device.";
+        }
+        return driver;
+    }
+
+    TDriver* driver = new TDriver(portName);
+    OwnedDriver owned;
+    owned.portName = portName;
+    owned.driver = driver;
+    m_drivers.push_back(owned);
+    return driver;
+}
+
+
+HapticAvatar_DriverPort* HapticAvatar_DeviceHub::getPortDriver(const std::string& portName)
+{
+    return getDriver<HapticAvatar_DriverPort>(portName);
+}
+
+
+HapticAvatar_DriverIbox* HapticAvatar_DeviceHub::getIboxDriver(const std::string& portName)
+{
+    return getDriver<HapticAvatar_DriverIbox>(portName);
+}
+
+
+HapticAvatar_DriverScope* HapticAvatar_DeviceHub::getScopeDriver(const std::string& portName)
+{
+    return getDriver<HapticAvatar_DriverScope>(portName);
+}
+
+
+bool HapticAvatar_DeviceHub::registerDevice(HapticAvatar_DriverBase* driver, DeviceCallback callback, HapticAvatar_DriverBase* linkedDriver)
+{
+    if (m_running)
+    {
+        msg_error() << "Device registered after the start of the haptic threads, it will not be serviced.";
+        return false;
+    }
+
+    bool owned = false;
+    bool linkedOwned = (linkedDriver == nullptr);
+    for (const OwnedDriver& ownedDriver : m_drivers)
+    {
+        owned = owned || ownedDriver.driver == driver;
+        linkedOwned = linkedOwned || ownedDriver.driver == linkedDriver;
+    }
+
+    if (driver == nullptr || !owned || !linkedOwned)
+    {
+        msg_error() << "Only the drivers created by the hub can be registered.";
+        return false;
+    }
+
+    for (HubDevice* device : m_devices)
+    {
+        if (device->driver == driver)
+        {
+            if (callback)
+                device->callback = callback;
+            if (linkedDriver != nullptr)
+                device->linkedDriver = linkedDriver;
+            return true;
+        }
+    }
+
+    HubDevice* device = new HubDevice();
+    device->driver = driver;
+    device->callback = callback;
+    device->linkedDriver = linkedDriver;
+    m_devices.push_back(device);
+    return true;
+}
+
+
+int HapticAvatar_DeviceHub::findDevice(const HapticAvatar_DriverBase* driver) const
+{
+    for (unsigned int i = 0; i < m_devices.size(); i++)
+    {
+        if (m_devices[i]->driver == driver)
+            return int(i);
+    }
+    return -1;
+}
+
+
+HapticAvatar_LoopScheduler::Stats HapticAvatar_DeviceHub::getLoopStats(const HapticAvatar_DriverBase* driver) const
+{
+    if (!m_running)
+        return HapticAvatar_LoopScheduler::Stats();
+
+    for (const HubDevice* device : m_devices)
+    {
+        if (device->driver == driver)
+            return m_workers[device->worker]->loopScheduler.getStats();
+    }
+    return HapticAvatar_LoopScheduler::Stats();
+}
+
+
+int HapticAvatar_DeviceHub::createReactor(HubWorker& worker)
+{
+    int numMultiplexed = 0;
+#ifdef __linux__
+    worker.epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker.epollFd >= 0)
+    {
+        // the timer wakes the reactor at the deadlines with the resolution of the clock, epoll_wait only has milliseconds
+        worker.timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = DEVICEHUB_TIMER_EVENT;
+        if (worker.timerFd < 0 || epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, worker.timerFd, &event) != 0)
+        {
+            if (worker.timerFd >= 0)
+                ::close(worker.timerFd);
+            ::close(worker.epollFd);
+            worker.timerFd = -1;
+            worker.epollFd = -1;
+        }
+    }
+    if (worker.epollFd < 0)
+    {
+        msg_warning() << "Failed to create the epoll reactor: " << std::strerror(errno) << ". The devices are updated one after the other.";
+    }
+#endif
+
+    for (unsigned int index : worker.devices)
+    {
+        HubDevice& device = *m_devices[index];
+        device.pollHandle = -1;
+        device.waiting = false;
+        if (worker.epollFd < 0 || !device.driver->IsConnected())
+            continue;
+
+#ifdef __linux__
+        const int handle = device.driver->getPollHandle();
+        if (handle < 0)
+            continue;
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = index;
+        if (epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, handle, &event) != 0)
+        {
+            msg_warning() << "Failed to add " << device.driver->getPortName() << " to the epoll reactor: " << std::strerror(errno);
+            continue;
+        }
+        device.pollHandle = handle;
+        numMultiplexed++;
+#endif
+    }
+
+    return numMultiplexed;
+}
+
+
+bool HapticAvatar_DeviceHub::start()
+{
+    if (m_running)
+        return true;
+
+    if (m_devices.empty())
+        return false;
+
+    // the linked devices form groups serviced by one worker, each group is identified by its first device
+    sofa::type::vector<unsigned int> group(m_devices.size());
+    for (unsigned int i = 0; i < m_devices.size(); i++)
+        group[i] = i;
+    for (unsigned int i = 0; i < m_devices.size(); i++)
+    {
+        if (m_devices[i]->linkedDriver == nullptr)
+            continue;
+
+        // a linked driver never registered, e.g. whose controller failed to initialize, is not updated by any thread
+        const int linked = findDevice(m_devices[i]->linkedDriver);
+        if (linked < 0)
+        {
+            msg_warning() << "Device " << m_devices[i]->driver->getPortName() << " is linked to " << m_devices[i]->linkedDriver->getPortName()
+                << " which is not serviced by the hub.";
+            continue;
+        }
+
+        // merge the two groups
+        const unsigned int from = std::max(group[i], group[linked]);
+        const unsigned int to = std::min(group[i], group[linked]);
+        for (unsigned int& g : group)
+        {
+            if (g == from)
+                g = to;
+        }
+    }
+
+    sofa::type::vector<unsigned int> groupOrdinal(m_devices.size(), 0);
+    unsigned int numGroups = 0;
+    for (unsigned int i = 0; i < m_devices.size(); i++)
+    {
+        if (group[i] == i)
+            groupOrdinal[i] = numGroups++;
+    }
+
+    // the groups are shared evenly between the workers
+    int numWorkers = d_workerThreads.getValue();
+    if (numWorkers < 1)
+        numWorkers = 1;
+    if (numWorkers > int(numGroups))
+        numWorkers = int(numGroups);
+
+    for (int i = 0; i < numWorkers; i++)
+        m_workers.push_back(new HubWorker());
+
+    int numMultiplexed = 0;
+    for (unsigned int i = 0; i < m_devices.size(); i++)
+    {
+        const unsigned int worker = groupOrdinal[group[i]] % numWorkers;
+        m_devices[i]->worker = worker;
+        m_devices[i]->cycles.store(0, std::memory_order_relaxed);
+        m_devices[i]->skipped.store(0, std::memory_order_relaxed);
+        m_devices[i]->expired.store(0, std::memory_order_relaxed);
+        m_devices[i]->lastCycles = 0;
+        m_workers[worker]->devices.push_back(i);
+    }
+    for (HubWorker* worker : m_workers)
+    {
+        numMultiplexed += createReactor(*worker);
+        worker->loopScheduler.setTiming(d_loopPeriod.getValue(), d_loopSpinMargin.getValue(), d_loopSlack.getValue());
+    }
+
+    d_numDevices.setValue(sofa::type::Vec2i(int(m_devices.size()), numMultiplexed));
+    msg_info() << m_devices.size() << " devices serviced by " << numWorkers << " haptic threads, " << numMultiplexed << " of them by the epoll reactors.";
+
+    m_threadReport = ThreadConfigReport();
+    if (d_lockMemory.getValue())
+        HapticAvatar_ThreadConfig::lockMemory(m_threadReport);
+
+    m_terminate = false;
+    std::string report;
+    for (unsigned int i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i]->thread = std::thread(&HapticAvatar_DeviceHub::run, this, m_workers[i]);
+        if (m_workers.size() > 1)
+            report += "worker " + std::to_string(i) + ": ";
+        report += configureThread(*m_workers[i], i);
+        if (i + 1 < m_workers.size())
+            report += "\n";
+    }
+    d_threadConfigReport.setValue(report);
+    m_running = true;
+    m_lastStatsTime = std::chrono::steady_clock::now();
+
+    return true;
+}
+
+
+void HapticAvatar_DeviceHub::stop()
+{
+    if (!m_running)
+        return;
+
+    m_terminate = true;
+    for (HubWorker* worker : m_workers)
+        worker->thread.join();
+    m_running = false;
+
+    for (HubWorker* worker : m_workers)
+    {
+#ifdef __linux__
+        if (worker->timerFd >= 0)
+            ::close(worker->timerFd);
+        if (worker->epollFd >= 0)
+            ::close(worker->epollFd);
+#endif
+        delete worker;
+    }
+    m_workers.clear();
+}
+
+
+std::string HapticAvatar_DeviceHub::configureThread(HubWorker& worker, unsigned int index)
+{
+    ThreadSettings settings;
+    if (!HapticAvatar_ThreadConfig::parsePolicy(d_threadPolicy.getValue(), settings.policy))
+    {
+        msg_warning() << "Unknown threadPolicy '" << d_threadPolicy.getValue() << "', expected default, fifo or rr. Keeping the default policy.";
+    }
+    settings.priority = d_threadPriority.getValue();
+
+    // with enough CPUs each worker gets its own, otherwise they share the list
+    const sofa::type::vector<int>& cpus = d_threadCpus.getValue();
+    if (m_workers.size() > 1 && cpus.size() >= m_workers.size())
+        settings.cpus.push_back(cpus[index]);
+    else
+        settings.cpus.assign(cpus.begin(), cpus.end());
+
+    settings.name = d_threadName.getValue();
+    if (m_workers.size() > 1)
+        settings.name += std::to_string(index);
+
+    ThreadConfigReport report = m_threadReport;
+    HapticAvatar_ThreadConfig::apply(worker.thread, settings, report);
+    const std::string text = HapticAvatar_ThreadConfig::toString(report);
+    if (!report.isSuccess())
+    {
+        msg_warning() << "Haptic thread " << settings.name << " real-time configuration incomplete: " << text;
+    }
+    else
+    {
+        msg_info() << "Haptic thread " << settings.name << " real-time configuration: " << text;
+    }
+    return text;
+}
+
+
+void HapticAvatar_DeviceHub::run(HubWorker* worker)
+{
+    worker->loopScheduler.start();
+    while (!m_terminate)
+    {
+        runCycle(*worker);
+
+        // Sleep until the next deadline, spinning only for its last microseconds
+        worker->loopScheduler.waitNextCycle();
+    }
+
+    // ensure no force
+    for (unsigned int index : worker->devices)
+    {
+        HubDevice& device = *m_devices[index];
+        if (device.waiting)
+            device.driver->expireReply();
+        device.waiting = false;
+
+        HapticAvatar_DriverPort* port = dynamic_cast<HapticAvatar_DriverPort*>(device.driver);
+        if (port != nullptr)
+        {
+            port->releaseForce();
+            port->update();
+        }
+    }
+}
+
+
+void HapticAvatar_DeviceHub::endDeviceCycle(HubDevice& device)
+{
+    device.waiting = false;
+    device.cycles.store(device.cycles.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (device.callback)
+        device.callback();
+}
+
+
+void HapticAvatar_DeviceHub::runCycle(HubWorker& worker)
+{
+    typedef HapticAvatar_LoopScheduler::Clock Clock;
+
+    const unsigned int numDevices = (unsigned int)(worker.devices.size());
+    // replies are awaited until the worker has to get ready for its next deadline
+    const Clock::time_point cycleEnd = worker.loopScheduler.getDeadline() - std::chrono::microseconds(worker.loopScheduler.getSpinMargin());
+
+    // serve the devices in a rotating order, none of them is always the last one of the cycle
+    const unsigned int first = worker.firstDevice;
+    worker.firstDevice = (first + 1) % numDevices;
+
+    // write the requests of the multiplexed devices back to back, their replies come in parallel
+    int numWaiting = 0;
+    for (unsigned int k = 0; k < numDevices; k++)
+    {
+        HubDevice& device = *m_devices[worker.devices[(first + k) % numDevices]];
+        if (device.pollHandle < 0)
+            continue;
+
+        if (device.waiting)
+        {
+            // its reply is still awaited within its own deadline: no request this cycle, the others are not held back
+            device.skipped.store(device.skipped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            numWaiting++;
+            continue;
+        }
+
+        device.driver->sendRequests();
+        device.waiting = device.driver->isWaitingReply();
+        if (device.waiting)
+        {
+            device.deadline = Clock::now() + std::chrono::microseconds(device.driver->getReceiveTimeout());
+            numWaiting++;
+        }
+    }
+
+    // the other devices are updated in the meantime, waiting for each reply as in a thread of their own
+    for (unsigned int k = 0; k < numDevices; k++)
+    {
+        HubDevice& device = *m_devices[worker.devices[(first + k) % numDevices]];
+        if (device.pollHandle >= 0)
+            continue;
+
+        if (device.callback)
+            device.callback();
+        device.driver->update();
+        device.cycles.store(device.cycles.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // the devices with frames in flight but no reply needed before the next cycle only parse what has already arrived
+    for (unsigned int k = 0; k < numDevices; k++)
+    {
+        HubDevice& device = *m_devices[worker.devices[(first + k) % numDevices]];
+        if (device.pollHandle < 0 || device.waiting)
+            continue;
+
+        device.driver->receiveAvailable();
+        endDeviceCycle(device);
+    }
+
+#ifdef __linux__
+    struct epoll_event events[DEVICEHUB_MAX_EVENTS];
+    while (numWaiting > 0)
+    {
+        // the replies still missing at their deadline are given up, their rows keep the previous values
+        Clock::time_point now = Clock::now();
+        Clock::time_point wakeTime = cycleEnd;
+        for (unsigned int index : worker.devices)
+        {
+            HubDevice& device = *m_devices[index];
+            if (!device.waiting)
+                continue;
+
+            if (device.deadline <= now)
+            {
+                device.driver->expireReply();
+                device.expired.store(device.expired.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                numWaiting--;
+                endDeviceCycle(device);
+            }
+            else if (device.deadline < wakeTime)
+                wakeTime = device.deadline;
+        }
+
+        // the replies still awaited at the end of the cycle are parsed during the next one
+        if (numWaiting == 0 || now >= cycleEnd)
+            break;
+
+        // sleep in the kernel until a line is readable or the timer expires
+        const int64_t wakeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(wakeTime.time_since_epoch()).count();
+        struct itimerspec timer;
+        timer.it_interval.tv_sec = 0;
+        timer.it_interval.tv_nsec = 0;
+        timer.it_value.tv_sec = time_t(wakeNs / 1000000000);
+        timer.it_value.tv_nsec = long(wakeNs % 1000000000);
+        timerfd_settime(worker.timerFd, TFD_TIMER_ABSTIME, &timer, nullptr);
+
+        const int numEvents = epoll_wait(worker.epollFd, events, DEVICEHUB_MAX_EVENTS, -1);
+        for (int i = 0; i < numEvents; i++)
+        {
+            if (events[i].data.u32 == DEVICEHUB_TIMER_EVENT)
+            {
+                uint64_t expirations = 0;
+                if (::read(worker.timerFd, &expirations, sizeof(expirations)) < 0)
+                {
+                    // nothing to read, the timer has been set again since
+                }
+                continue;
+            }
+
+            HubDevice& device = *m_devices[events[i].data.u32];
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                // the line is gone: stop waiting on it, its driver reports the errors from now on
+                epoll_ctl(worker.epollFd, EPOLL_CTL_DEL, device.pollHandle, nullptr);
+                device.pollHandle = -1;
+                msg_error("HapticAvatar_DeviceHub") << "Serial line of " << device.driver->getPortName() << " in error, removed from the reactor.";
+                if (device.waiting)
+                {
+                    device.driver->expireReply();
+                    numWaiting--;
+                    endDeviceCycle(device);
+                }
+                continue;
+            }
+
+            const bool done = device.driver->receiveAvailable();
+            if (device.waiting && done)
+            {
+                numWaiting--;
+                endDeviceCycle(device);
+            }
+        }
+    }
+#endif
+}
+
+
+void HapticAvatar_DeviceHub::updateStats()
+{
+    if (!m_running)
+        return;
+
+    double lastWakeError = 0.0;
+    double meanWakeError = 0.0;
+    double maxWakeError = 0.0;
+    for (unsigned int i = 0; i < m_workers.size(); i++)
+    {
+        const HapticAvatar_LoopScheduler::Stats stats = m_workers[i]->loopScheduler.getStats();
+        if (i == 0)
+            lastWakeError = stats.lastWakeErrorUs;
+        meanWakeError += stats.meanWakeErrorUs / double(m_workers.size());
+        if (stats.maxWakeErrorUs > maxWakeError)
+            maxWakeError = stats.maxWakeErrorUs;
+    }
+    d_loopWakeError.setValue(sofa::type::Vec3d(lastWakeError, meanWakeError, maxWakeError));
+
+    // loop rates are averaged over a second at least
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(now - m_lastStatsTime).count();
+    if (elapsed < 1.0)
+        return;
+    m_lastStatsTime = now;
+
+    std::ostringstream oss;
+    oss << std::left << std::setw(24) << "device" << std::right << std::setw(8) << "worker" << std::setw(10) << "rate" << std::setw(10) << "skipped" << std::setw(10) << "expired" << "\n";
+    for (HubDevice* device : m_devices)
+    {
+        const uint64_t cycles = device->cycles.load(std::memory_order_relaxed);
+        const double rate = double(cycles - device->lastCycles) / elapsed;
+        device->lastCycles = cycles;
+
+        oss << std::left << std::setw(24) << device->driver->getPortName() << std::right << std::setw(8) << device->worker
+            << std::setw(10) << std::fixed << std::setprecision(0) << rate
+            << std::setw(10) << device->skipped.load(std::memory_order_relaxed)
+            << std::setw(10) << device->expired.load(std::memory_order_relaxed) << "\n";
+    }
+    d_deviceStats.setValue(oss.str());
+}
+
+
+void HapticAvatar_DeviceHub::handleEvent(core::objectmodel::Event *event)
+{
+    if (dynamic_cast<sofa::simulation::AnimateBeginEvent *>(event))
+    {
+        // all the controllers have registered their device during the initialization of the scene
+        if (!m_running && !m_devices.empty())
+            start();
+
+        updateStats();
+    }
+}
+
+} // namespace sofa::HapticAvatar
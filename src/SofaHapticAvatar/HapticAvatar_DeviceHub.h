@@ -0,0 +1,222 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <SofaHapticAvatar/HapticAvatar_DriverPort.h>
+#include <SofaHapticAvatar/HapticAvatar_DriverIbox.h>
+#include <SofaHapticAvatar/HapticAvatar_DriverScope.h>
+#include <SofaHapticAvatar/HapticAvatar_LoopScheduler.h>
+#include <SofaHapticAvatar/HapticAvatar_ThreadConfig.h>
+
+#include <sofa/core/objectmodel/BaseObject.h>
+#include <sofa/type/Vec.h>
+#include <sofa/type/vector.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace sofa::HapticAvatar
+{
+
+#define DEVICEHUB_MAX_EVENTS 16
+#define DEVICEHUB_TIMER_EVENT 0xffffffffu
+
+/**
+* HapticAvatar_DeviceHub owns the drivers of all the HapticAvatar devices of a scene and services them from a fixed pool of haptic threads,
+* @sa d_workerThreads, so that the number of threads does not grow with the number of portals.
+* The devices are shared evenly between the workers, a device whose callback commands another one, e.g. a tool and its IBox, is serviced
+* by the worker of that device so that one thread only appends commands to each driver. At each cycle a worker writes the requests of its devices back to back, then one epoll
+* reactor waits on all their serial lines at once and parses each reply as soon as it arrives. Once the reply of a device has been parsed,
+* or given up after its receive timeout, the callback of the device is run on the worker, the forces it sets are sent at the next cycle.
+* Each device has its own deadline: a reply still missing at the end of the cycle is awaited during the next one, this device skips a
+* request meanwhile and the others are not held back. The devices are served in a rotating order and at most once per cycle, none of them
+* can take the share of the others.
+* Devices whose transport can't be multiplexed, and all the devices on platforms without epoll, are updated one after the other.
+* Controllers get their driver from @sa getPortDriver, @sa getIboxDriver or @sa getScopeDriver, register it during the initialization
+* of the scene and the workers start at the first animation step.
+*/
+class SOFA_HAPTICAVATAR_API HapticAvatar_DeviceHub : public sofa::core::objectmodel::BaseObject
+{
+public:
+    SOFA_CLASS(HapticAvatar_DeviceHub, sofa::core::objectmodel::BaseObject);
+
+    /// Run on the haptic thread once the reply of a device has been parsed or given up.
+    typedef std::function<void()> DeviceCallback;
+
+    HapticAvatar_DeviceHub();
+
+    virtual ~HapticAvatar_DeviceHub();
+
+    void cleanup() override;
+    void handleEvent(core::objectmodel::Event *) override;
+
+    /** Get the driver of the Port device on @param portName, created and connected at the first call.
+    * @returns {HapticAvatar_DriverPort *} nullptr if the port is already used by another type of device. Owned by the hub.
+    */
+    HapticAvatar_DriverPort* getPortDriver(const std::string& portName);
+    /// Get the driver of the IBox device on @param portName, see @sa getPortDriver.
+    HapticAvatar_DriverIbox* getIboxDriver(const std::string& portName);
+    /// Get the driver of the Scope device on @param portName, see @sa getPortDriver.
+    HapticAvatar_DriverScope* getScopeDriver(const std::string& portName);
+
+    /** Service a driver from the haptic thread. To be called before the thread starts.
+    * @param {HapticAvatar_DriverBase *} driver: driver returned by this hub.
+    * @param {DeviceCallback} callback: run after each reply of the device, may be empty. Replaces the previous callback of the driver.
+    * @param {HapticAvatar_DriverBase *} linkedDriver: driver of this hub the callback reads or sends commands to, serviced by the same worker. Can be null.
+    * @returns {bool} false if the thread is already running or a driver does not belong to this hub.
+    */
+    bool registerDevice(HapticAvatar_DriverBase* driver, DeviceCallback callback = DeviceCallback(), HapticAvatar_DriverBase* linkedDriver = nullptr);
+
+    /// Start the haptic threads if not running yet. Called at the first animation step. Returns false if no device is registered.
+    bool start();
+
+    /// Stop the haptic threads and wait for their end, the callbacks are not run anymore once it returns. Called by the controllers before their destruction.
+    void stop();
+
+    bool isRunning() const { return m_running; }
+
+    /// Statistics of the pacing of the worker servicing @param driver, can be read from any thread. Empty if the workers are not running.
+    HapticAvatar_LoopScheduler::Stats getLoopStats(const HapticAvatar_DriverBase* driver) const;
+
+    /// Number of haptic threads servicing the devices, at most one per device
+    Data<int> d_workerThreads;
+
+    /// Period of the haptic loop in microseconds
+    Data<int> d_loopPeriod;
+    /// Time in microseconds the haptic loop spins before each deadline instead of sleeping, to absorb the wake-up latency of the OS
+    Data<int> d_loopSpinMargin;
+    /// Lateness in microseconds after which a haptic cycle is considered missed and the loop restarts from now instead of catching up
+    Data<int> d_loopSlack;
+    /// Wake-up error of the haptic loops in microseconds after their deadlines: last of the first worker, mean and max of all
+    Data<sofa::type::Vec3d> d_loopWakeError;
+    /// Scheduling policy of the haptic thread: default, fifo or rr
+    Data<std::string> d_threadPolicy;
+    /// Real-time priority of the haptic thread, used with the fifo and rr policies
+    Data<int> d_threadPriority;
+    /// CPUs the haptic threads may run on, all if empty. With at least one CPU per worker, each worker is pinned to its own CPU of the list
+    Data<sofa::type::vector<int> > d_threadCpus;
+    /// Name of the haptic threads in the OS tools, followed by the index of the worker if there are several
+    Data<std::string> d_threadName;
+    /// Lock the memory of the process in RAM before starting the haptic thread, so that it never waits on a page fault
+    Data<bool> d_lockMemory;
+    /// Outcome of each real-time setting of the haptic threads
+    Data<std::string> d_threadConfigReport;
+    /// Number of devices serviced by the haptic threads, and how many of them are multiplexed by the reactors
+    Data<sofa::type::Vec2i> d_numDevices;
+    /// Loop rate of each device in Hz, cycles skipped while its reply was awaited and replies given up, refreshed every second
+    Data<std::string> d_deviceStats;
+
+protected:
+    /// Get the driver of type TDriver on @param portName, created at the first call. nullptr if the port is used by another type of device.
+    template<class TDriver>
+    TDriver* getDriver(const std::string& portName);
+
+    struct HubDevice;
+    struct HubWorker;
+
+    /// Index in @sa m_devices of the device of @param driver, -1 if it is not registered
+    int findDevice(const HapticAvatar_DriverBase* driver) const;
+
+    /// Create the reactor of @param worker and register the poll handle of each of its devices in it. Returns the number of devices multiplexed.
+    int createReactor(HubWorker& worker);
+
+    /// Body of a haptic thread.
+    void run(HubWorker* worker);
+
+    /** One cycle of a worker: send the requests of its devices whose previous reply is done, then parse the replies as they arrive
+    * until all are received or the end of the cycle, running the callback of each device once its reply is done.
+    */
+    void runCycle(HubWorker& worker);
+
+    /// Run the callback of @param device, its reply has been parsed or given up
+    void endDeviceCycle(HubDevice& device);
+
+    /// Apply the real-time settings of the Data to the thread of worker @param index, returns their outcome in a readable form
+    std::string configureThread(HubWorker& worker, unsigned int index);
+
+    /// Refresh @sa d_deviceStats and @sa d_loopWakeError from the statistics of the workers
+    void updateStats();
+
+    struct OwnedDriver
+    {
+        std::string portName;
+        HapticAvatar_DriverBase* driver = nullptr;
+    };
+
+    struct HubDevice
+    {
+        HapticAvatar_DriverBase* driver = nullptr;
+        DeviceCallback callback;
+        /// driver serviced by the same worker, nullptr if none
+        HapticAvatar_DriverBase* linkedDriver = nullptr;
+        /// index of the worker servicing the device
+        unsigned int worker = 0;
+        /// handle registered in the reactor, -1 if the device is updated without it
+        int pollHandle = -1;
+        /// the reply of the last requests is awaited
+        bool waiting = false;
+        /// time at which the reply awaited is given up
+        std::chrono::steady_clock::time_point deadline;
+
+        /// statistics written by the worker, read by @sa updateStats
+        std::atomic<uint64_t> cycles{ 0 };
+        std::atomic<uint64_t> skipped{ 0 };
+        std::atomic<uint64_t> expired{ 0 };
+        /// value of @sa cycles at the last refresh of @sa d_deviceStats, simulation thread only
+        uint64_t lastCycles = 0;
+    };
+
+    struct HubWorker
+    {
+        std::thread thread;
+        /// devices serviced by this worker, indices in @sa m_devices
+        sofa::type::vector<unsigned int> devices;
+        /// first device served at the next cycle, rotated at each cycle
+        unsigned int firstDevice = 0;
+        /// epoll instance waiting on the devices with a poll handle, -1 if none
+        int epollFd = -1;
+        /// timer waking the reactor at the deadlines, registered in @sa epollFd
+        int timerFd = -1;
+        /// Paces the worker, set from @sa d_loopPeriod, @sa d_loopSpinMargin and @sa d_loopSlack
+        HapticAvatar_LoopScheduler loopScheduler;
+    };
+
+    /// Drivers created by the hub, deleted with it
+    sofa::type::vector<OwnedDriver> m_drivers;
+    /// Drivers serviced by the haptic threads
+    sofa::type::vector<HubDevice*> m_devices;
+    /// Pool of haptic threads, created by @sa start
+    sofa::type::vector<HubWorker*> m_workers;
+
+    std::atomic<bool> m_terminate;
+    bool m_running;
+
+    /// Outcome of the memory lock, the base of the report of each worker
+    ThreadConfigReport m_threadReport;
+    /// Time of the last refresh of @sa d_deviceStats
+    std::chrono::steady_clock::time_point m_lastStatsTime;
+};
+
+} // namespace sofa::HapticAvatar
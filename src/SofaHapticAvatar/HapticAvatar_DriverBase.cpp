@@ -21,17 +21,49 @@
 ******************************************************************************/
 
 #include <SofaHapticAvatar/HapticAvatar_DriverBase.h>
+#include <SofaHapticAvatar/HapticAvatar_AllocationCounter.h>
 #include <sofa/helper/logging/Messaging.h>
+#include <tinyxml.h>
+#include <charconv>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <chrono>
 
 namespace sofa::HapticAvatar
 {
 
     using namespace HapticAvatar;
 
-    HapticAvatar_DriverBase::HapticAvatar_DriverBase(const std::string& portName)
-        : m_connected(false)
+    namespace
+    {
+        /// Write @param value followed by a space at @param out, without going past @param end. Returns false if it does not fit.
+        bool writeAsciiInt(char*& out, char* end, int value)
+        {
+            std::to_chars_result res = std::to_chars(out, end, value);
+            if (res.ec != std::errc() || res.ptr >= end)
+                return false;
+            *res.ptr = ' ';
+            out = res.ptr + 1;
+            return true;
+        }
+    }
+
+    HapticAvatar_DriverBase::HapticAvatar_DriverBase(const std::string& portName, HapticAvatar_Transport* transport)
+        : m_replyParser(num_return_vals, scale_factor, &result_table[0][0], RESULT_SIZEY, result_stamp)
+        , m_connected(false)
+        , m_wireProtocol(WireProtocol::Ascii)
+        , m_receiveTimeoutUs(10000)
+        , m_staleReplies(0)
+        , m_receiveTimeouts(0)
+        , m_receiveErrors(0)
+        , m_malformedReplies(0)
+        , m_transport(transport)
         , m_portName(portName)
     {
+        if (m_transport == nullptr)
+            m_transport = HapticAvatar_Transport::create();
+
         // First try to connect to device
         connectDevice();
 
@@ -49,9 +81,11 @@ namespace sofa::HapticAvatar
         {
             //We're no longer connected
             m_connected = false;
-            //Close the serial handler
-            CloseHandle(m_hSerial);
+            //Close the serial line
+            m_transport->close();
         }
+        delete m_transport;
+        m_transport = nullptr;
     }
 
 
@@ -72,7 +106,6 @@ namespace sofa::HapticAvatar
         int res = std::atoi(incomingData);
         return res;
 
-        setupNumReturnVals();  // needs to be implemented in each device driver
         setupCmdLists();   // needs to be implemented in each device driver
 
     }
@@ -125,221 +158,512 @@ namespace sofa::HapticAvatar
 
     void HapticAvatar_DriverBase::connectDevice()
     {
-        //Try to connect to the given port throuh CreateFile
-        m_hSerial = CreateFileA(m_portName.c_str(),
-            GENERIC_READ | GENERIC_WRITE,
-            0,
-            NULL,
-            OPEN_EXISTING,
-            FILE_ATTRIBUTE_NORMAL,
-            NULL
-        );
-
-        //Check if the connection was successfull
-        if (m_hSerial == INVALID_HANDLE_VALUE)
+        m_connected = m_transport->open(m_portName);
+    }
+
+
+    int HapticAvatar_DriverBase::getDataImpl(char* buffer, bool do_flush, int timeoutUs)
+    {
+        const Deadline deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs >= 0 ? timeoutUs : m_receiveTimeoutUs);
+
+        // Replies to requests that timed out may arrive before the current one.
+        const int expected_lines = 1 + m_staleReplies;
+        int size = 0;
+        int que = 0;
+        int num_cr = 0;
+        int last_cr = -1;
+        while (num_cr < expected_lines && size < INCOMING_DATA_LEN - 1)
         {
-            //If not success full display an Error
-            if (GetLastError() == ERROR_FILE_NOT_FOUND) {
+            WaitStatus status = m_transport->waitReadable(deadline);
+            if (status == WaitStatus::Timeout)
+                break;
 
-                //Print Error if neccessary
-                msg_error("HapticAvatar_DriverBase") << "Handle was not attached. Reason: " << m_portName << " not available.";
+            int n = (status == WaitStatus::Ready) ? readDataImpl(buffer + size, INCOMING_DATA_LEN - 1 - size, &que, do_flush) : -1;
+            if (n < 0)
+            {
+                m_receiveErrors++;
+                buffer[0] = '\0';
+                return RECEIVE_ERROR;
             }
-            else
+
+            // count the number of \n in the new bytes
+            for (int i = size; i < size + n; i++)
             {
-                msg_error("HapticAvatar_DriverBase") << "Unknown error occured!";
+                if (buffer[i] == '\n')
+                {
+                    num_cr++;
+                    last_cr = i;
+                }
             }
+            size += n;
         }
-        else
+
+        if (num_cr == 0)
         {
-            //If connected we try to set the comm parameters
-            DCB dcbSerialParams = { 0 };
+            // The reply may still come, it will be read away with the next one.
+            m_receiveTimeouts++;
+            if (m_staleReplies < 4)
+                m_staleReplies++;
+            buffer[0] = '\0';
+            return RECEIVE_TIMEOUT;
+        }
+        m_staleReplies = 0;
 
-            //Try to get the current
-            if (!GetCommState(m_hSerial, &dcbSerialParams))
-            {
-                //If impossible, show an error
-                msg_warning("HapticAvatar_DriverBase") << "Failed to get current serial parameters!";
-            }
-            else
+        // keep only the last complete line
+        int line_start = last_cr;
+        while (line_start > 0 && buffer[line_start - 1] != '\n')
+            line_start--;
+        if (line_start > 0)
+            std::memmove(buffer, buffer + line_start, last_cr + 1 - line_start);
+        buffer[last_cr + 1 - line_start] = '\0';
+
+        return num_cr;
+    }
+
+
+    int HapticAvatar_DriverBase::getFrameImpl(wire::FrameHeader& header, int timeoutUs)
+    {
+        const Deadline deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs >= 0 ? timeoutUs : m_receiveTimeoutUs);
+        int que = 0;
+        while (true)
+        {
+            // drop bytes until a sync sequence is found at the start of the buffer
+            int start = 0;
+            while (start + 1 < incoming_size && !(uint8_t(incomingData[start]) == wire::SYNC0 && uint8_t(incomingData[start + 1]) == wire::SYNC1))
+                start++;
+            if (start > 0)
+                dropIncoming(start);
+
+            if (incoming_size >= wire::HEADER_SIZE && wire::readHeader(incomingData, header))
             {
-                //Define serial connection parameters for the arduino board
-                dcbSerialParams.BaudRate = CBR_9600;
-                dcbSerialParams.ByteSize = 8;
-                dcbSerialParams.StopBits = ONESTOPBIT;
-                dcbSerialParams.Parity = NOPARITY;
-                //Setting the DTR to Control_Enable ensures that the Arduino is properly
-                //reset upon establishing a connection
-                dcbSerialParams.fDtrControl = DTR_CONTROL_ENABLE;
-
-                //Set the parameters and check for their proper application
-                if (!SetCommState(m_hSerial, &dcbSerialParams))
-                {
-                    msg_warning("HapticAvatar_DriverBase") << "ALERT: Could not set Serial Port parameters";
-                }
-                else
+                const int frameSize = wire::HEADER_SIZE + header.payloadLength;
+                if (frameSize > INCOMING_DATA_LEN)
                 {
-                    //If everything went fine we're connected
-                    m_connected = true;
-                    //Flush any remaining characters in the buffers
-                    PurgeComm(m_hSerial, PURGE_RXCLEAR | PURGE_TXCLEAR);
-                    //We wait 2s as the arduino board will be reseting
-                    Sleep(ARDUINO_WAIT_TIME);
+                    // not a valid header, search the next sync sequence
+                    msg_warning("HapticAvatar_DriverBase") << "Binary frame too long: " << frameSize << " bytes, dropped.";
+                    dropIncoming(2);
+                    continue;
                 }
+                if (incoming_size >= frameSize)
+                    return frameSize;
             }
+
+            WaitStatus status = m_transport->waitReadable(deadline);
+            if (status == WaitStatus::Timeout)
+                return RECEIVE_TIMEOUT;
+
+            int n = (status == WaitStatus::Ready) ? readDataImpl(incomingData + incoming_size, INCOMING_DATA_LEN - incoming_size, &que, false) : -1;
+            if (n < 0)
+            {
+                m_receiveErrors++;
+                return RECEIVE_ERROR;
+            }
+            incoming_size += n;
         }
     }
 
 
-    int HapticAvatar_DriverBase::getDataImpl(char* buffer, bool do_flush)
+    int HapticAvatar_DriverBase::receiveAsciiReply()
     {
-        bool response = false;
-        int cptSecu = 0;
-        int n = 0;
+        const Deadline deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(m_receiveTimeoutUs);
+
+        // m_replyParser has been started when the request was sent
         int que = 0;
-        char* pch;
-        int num_cr = 0;
-        while (!response && cptSecu < 10000)
+        while (!m_replyParser.isComplete())
         {
-            n = readDataImpl(buffer, INCOMING_DATA_LEN, &que, do_flush);
-            if (n > 0)
+            WaitStatus status = m_transport->waitReadable(deadline);
+            if (status == WaitStatus::Timeout)
+                break;
+
+            // only read what is available, to parse each chunk as soon as it arrives
+            int n = (status == WaitStatus::Ready) ? readDataImpl(incomingData, INCOMING_DATA_LEN, &que, true) : -1;
+            if (n < 0)
             {
-                // count the number of \n in the return string
-                pch = strchr(buffer, '\n');
-                while (pch != NULL)
-                {
-                    num_cr++;
-                    pch = strchr(pch + 1, '\n');
-                }
-                response = true;
+                m_receiveErrors++;
+                recordErrors(cmd_send_list, cmd_send_list_size);
+                return RECEIVE_ERROR;
             }
+            // bytes after the end of line are not part of any reply and are dropped
+            m_replyParser.consume(incomingData, n);
+        }
+
+        return finishAsciiReply();
+    }
 
-            cptSecu++;
+
+    int HapticAvatar_DriverBase::finishAsciiReply()
+    {
+        if (!m_replyParser.finish())
+        {
+            // The reply may still come, it will be read away with the next one.
+            recordErrors(cmd_send_list, cmd_send_list_size);
+            m_receiveTimeouts++;
+            if (m_staleReplies < 4)
+                m_staleReplies++;
+            return RECEIVE_TIMEOUT;
         }
+        m_staleReplies = 0;
 
-        if (!response) // secu loop reach end
+        if (m_replyParser.hasError())
         {
-            std::cerr << "## Error getData no message returned. Reach security loop limit: " << cptSecu << std::endl;
-            return -1;
+            // only the first one is logged, this runs in the haptic loop
+            if (m_malformedReplies++ == 0)
+                msg_warning("HapticAvatar_DriverBase") << "Malformed reply from device type " << device_type << ", " << m_replyParser.getNumRowsCommitted() << " rows received.";
+            recordErrors(cmd_send_list, cmd_send_list_size);
+        }
+        else
+        {
+            recordReply(cmd_send_list, cmd_send_list_size, m_asciiSendTime, m_replyParser.getReplySize());
         }
 
-        return num_cr;
+        return m_replyParser.getNumRowsCommitted();
+    }
+
+
+    void HapticAvatar_DriverBase::dropIncoming(int size)
+    {
+        if (size >= incoming_size)
+        {
+            incoming_size = 0;
+            return;
+        }
+        std::memmove(incomingData, incomingData + size, incoming_size - size);
+        incoming_size -= size;
     }
 
 
     int HapticAvatar_DriverBase::readDataImpl(char* buffer, unsigned int nbChar, int* queue, bool do_flush)
     {
-        //Number of bytes we'll have read
-        DWORD bytesRead = 0;
-        DWORD junkBytesRead = 0;
+        return m_transport->read(buffer, nbChar, queue, do_flush);
+    }
+
+
+    bool HapticAvatar_DriverBase::writeDataImpl(char* buffer, unsigned int nbChar)
+    {
+        return m_transport->write(buffer, nbChar);
+    }
+
+
+    void HapticAvatar_DriverBase::update()
+    {
+        if (m_connected) {
+            const uint64_t allocationsBefore = getThreadAllocationCount();
 
-        //Use the ClearCommError function to get status info on the Serial port
-        ClearCommError(m_hSerial, &m_errors, &m_status);
+            // first, receive the data from the previously sent commands
 
-        *queue = (int)m_status.cbInQue;
+            updateReceive();
 
+            sendRequestsImpl();
 
-        if (do_flush) {
-            if (*queue > 0)
-                // read away as much as possible, max 512
-                ReadFile(m_hSerial, buffer, std::min(unsigned int(*queue), nbChar), &bytesRead, NULL);
+            m_arenaStats.cycles++;
+            m_arenaStats.allocations += getThreadAllocationCount() - allocationsBefore;
         }
-        else {
-            // regardless of what the queue is, read nbChar bytes, in an attempt to suspend the thread
-            ReadFile(m_hSerial, buffer, *queue, &bytesRead, NULL);
-            //ClearCommError(this->hSerial, &this->errors, &this->status);
-            //*queue = (int)status.cbInQue;
-            //if (*queue > 0) {
-            //	char junkbuffer[32];
-            //	// clear the buffer from any remaining bytes
-            //	ReadFile(this->hSerial, junkbuffer, min(*queue, 32), &junkBytesRead, NULL);
-            //}
+    }
+
+    void HapticAvatar_DriverBase::sendRequests()
+    {
+        if (m_connected) {
+            const uint64_t allocationsBefore = getThreadAllocationCount();
+
+            sendRequestsImpl();
 
+            m_arenaStats.cycles++;
+            m_arenaStats.allocations += getThreadAllocationCount() - allocationsBefore;
         }
-        return bytesRead;
     }
 
+    bool HapticAvatar_DriverBase::isWaitingReply() const
+    {
+        if (m_wireProtocol == WireProtocol::Binary)
+            return m_inFlightCount > 0 && m_inFlightCount >= m_pipelineDepth;
 
-    bool HapticAvatar_DriverBase::writeDataImpl(char* buffer, unsigned int nbChar)
+        return expected_num_return_vals > 0;
+    }
+
+    bool HapticAvatar_DriverBase::receiveAvailable()
     {
-        DWORD bytesSend;
+        if (!m_connected)
+            return true;
 
-        //Try to write the buffer on the Serial port
-        if (!WriteFile(m_hSerial, (void*)buffer, nbChar, &bytesSend, 0))
-        {
-            //In case it don't work get comm error and return false
-            ClearCommError(m_hSerial, &m_errors, &m_status);
+        if (m_wireProtocol == WireProtocol::Binary) {
+            if (m_inFlightCount == 0 && !m_streaming)
+                discardAvailable();
+            else
+                receiveFrames(false, false);
 
-            std::cerr << "Error failed to send command: '" << buffer << "'. Error returned: " << m_errors << std::endl;
-            return false;
+            // the frames in flight keep their own copy of the command list
+            expected_num_return_vals = 0;
+            cmd_send_list_size = 0;
+            return !isWaitingReply();
         }
-        else
+
+        if (expected_num_return_vals == 0) {
+            discardAvailable();
             return true;
+        }
+
+        int que = 0;
+        while (!m_replyParser.isComplete()) {
+            int n = readDataImpl(incomingData, INCOMING_DATA_LEN, &que, true);
+            if (n < 0) {
+                m_receiveErrors++;
+                recordErrors(cmd_send_list, cmd_send_list_size);
+                break;
+            }
+            if (n == 0)
+                return false;
+            m_replyParser.consume(incomingData, n);
+        }
+
+        if (m_replyParser.isComplete())
+            finishAsciiReply();
+
+        expected_num_return_vals = 0;
+        cmd_send_list_size = 0;
+        return true;
     }
 
+    void HapticAvatar_DriverBase::expireReply()
+    {
+        if (m_wireProtocol == WireProtocol::Binary) {
+            if (m_inFlightCount > 0) {
+                // give up the oldest frame to free its slot, as update does on timeout
+                m_receiveTimeouts++;
+                popInFlight(true);
+            }
+        }
+        else if (expected_num_return_vals > 0) {
+            finishAsciiReply();
+        }
 
-    void HapticAvatar_DriverBase::update()
+        expected_num_return_vals = 0;
+        cmd_send_list_size = 0;
+    }
+
+    void HapticAvatar_DriverBase::discardAvailable()
     {
-        if (m_connected) {
-            // first, receive the data from the previously sent commands
+        int que = 0;
+        int n = readDataImpl(incomingData, INCOMING_DATA_LEN, &que, true);
+        if (n < 0) {
+            m_receiveErrors++;
+            return;
+        }
 
-            updateReceive();
+        if (m_wireProtocol == WireProtocol::Ascii) {
+            for (int i = 0; i < n && m_staleReplies > 0; i++) {
+                if (incomingData[i] == '\n')
+                    m_staleReplies--;
+            }
+        }
+    }
 
-            std::string send_string; 
+    void HapticAvatar_DriverBase::sendRequestsImpl()
+    {
+        // Background transfers of the device driver take what the appended commands leave of the budget of the cycle
+        int requestBytes = (m_scheduler.getByteBudget() > 0) ? m_scheduler.getByteBudget() : OUTGOING_DATA_LEN;
+        int arenaBytes = OUTGOING_DATA_LEN - ((m_wireProtocol == WireProtocol::Binary) ? wire::HEADER_SIZE : 2);
+        if (m_wireProtocol == WireProtocol::Binary)
+            requestBytes -= wire::HEADER_SIZE;
+        const int appendedBytes = getAppendedRequestBytes();
+        requestBytes -= appendedBytes;
+        arenaBytes -= appendedBytes;
+        appendBackground(requestBytes, arenaBytes);
+
+        // Assemble the total command set in the output arena and send it to the device.
+        unsigned int outlen = 0;
+        if (m_wireProtocol == WireProtocol::Binary)
+            outlen = encodeBinary(outgoing_arena);
+        else
+            outlen = encodeAscii(outgoing_arena);
+
+        if (outlen > m_arenaStats.highWater)
+            m_arenaStats.highWater = outlen;
 
-            // fill the cmd_send_list again, starting with the cmd_always list  based on the subscription
-            for (int k = 0; k < device_num_cmds; k++) {
-                if (update_cmd_every_nth[k] > 0) {
-                    if ((send_counter % update_cmd_every_nth[k]) == 0) {
-                        cmd_send_list[cmd_send_list_size++] = k;
-                        expected_num_return_vals += num_return_vals[k];
-                        send_string += std::to_string(k) + " ";
-                    }
+        if (cmd_send_list_size > 0) {
+            const std::chrono::steady_clock::time_point sendTime = std::chrono::steady_clock::now();
+            bool write_success = writeDataImpl(outgoing_arena, outlen);
+            if (!write_success) {
+                msg_error("HapticAvatar_DriverBase") << "Write to device type " << device_type << " failed.";
+                recordErrors(cmd_send_list, cmd_send_list_size);
+            }
+            else {
+                for (int k = 0; k < cmd_send_list_size; k++) {
+                    CommandStats& stats = m_commandStats[cmd_send_list[k]];
+                    stats.requests.store(stats.requests.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    stats.bytesSent.store(stats.bytesSent.load(std::memory_order_relaxed) + uint64_t(cmd_send_bytes[k]), std::memory_order_relaxed);
                 }
+                m_asciiSendTime = sendTime;
             }
 
-            // add the appended commands, if any
-            if (cmd_appended_size > 0) {
-                for (int k = 0; k < cmd_appended_size; k++) {
-                    cmd_send_list[cmd_send_list_size++] = cmd_appended[k];
-                    expected_num_return_vals += num_return_vals[cmd_appended[k]];
-                }
-                send_string += cmd_appended_str;
+            if (write_success && m_wireProtocol == WireProtocol::Binary) {
+                // keep what has been requested to parse the reply, whenever it comes
+                if (m_inFlightCount == PIPELINE_MAX_DEPTH)
+                    popInFlight(true);
+                InFlightFrame& frame = m_inFlight[(m_inFlightFirst + m_inFlightCount) % PIPELINE_MAX_DEPTH];
+                frame.seq = send_seq;
+                frame.cmd_send_list_size = cmd_send_list_size;
+                std::memcpy(frame.cmd_send_list, cmd_send_list, cmd_send_list_size * sizeof(int));
+                frame.expected_num_return_vals = expected_num_return_vals;
+                frame.sendTime = sendTime;
+                m_inFlightCount++;
+                m_pipelineStats.framesSent++;
             }
 
-            // terminate the send string
-            send_string += " \n";
- 
-            if (cmd_send_list_size > 0) {
-                // Send the total command string to the device.
-                char outgoingData[OUTGOING_DATA_LEN];
-                strcpy(outgoingData, send_string.c_str());
-                //std::cout << "Call from update 2. Device type " << std::to_string(device_type) << " string length (" << send_string.size() << ") " << send_string << std::endl;
-                
-                //if (device_type == 2)
-                //    std::cout << "Call from update. Device type " << std::to_string(device_type) << " string length (" << send_string.size() << ") " << outgoingData << "END" << std::endl;
-
-                unsigned int outlen = send_string.size(); // (unsigned int)(strlen(outgoingData));
-                bool write_success = writeDataImpl(outgoingData, outlen);
-                if (!write_success) {
-                    std::cout << "Write to device type " << std::to_string(device_type) << " failed." << std::endl;
+            // the reply is parsed as it arrives, skipping the late replies of the previous requests
+            if (m_wireProtocol == WireProtocol::Ascii && expected_num_return_vals > 0)
+                m_replyParser.begin(cmd_send_list, cmd_send_list_size, m_staleReplies, ++m_receiveSeq);
+        }
+
+        // Remove the appended commands encoded, those which did not fit in the arena go first at the next cycle
+        const int carried = cmd_appended_size - m_appendedEncoded;
+        if (carried > 0) {
+            std::memmove(cmd_appended, cmd_appended + m_appendedEncoded, carried * sizeof(int));
+            std::memmove(cmd_appended_num_args, cmd_appended_num_args + m_appendedEncoded, carried * sizeof(int));
+            std::memmove(cmd_appended_args, cmd_appended_args + m_appendedArgsEncoded, (cmd_appended_args_size - m_appendedArgsEncoded) * sizeof(int));
+            m_appendStats.carried += uint64_t(carried);
+        }
+        cmd_appended_size = carried;
+        cmd_appended_args_size -= m_appendedArgsEncoded;
+
+        send_counter++;
+    }
+
+    int HapticAvatar_DriverBase::collectScheduled(WireProtocol protocol, int arenaBytes, const bool* exclude, int* cmds)
+    {
+        // the appended commands encoded are always sent, the subscribed ones share what they leave of the budget
+        int requestBytes = 0;
+        int replyBytes = 0;
+        if (protocol == WireProtocol::Binary) {
+            requestBytes += wire::HEADER_SIZE;
+            replyBytes += wire::HEADER_SIZE;
+        }
+        for (int k = 0; k < m_appendedEncoded; k++) {
+            requestBytes += HapticAvatar_CommandScheduler::requestBytes(protocol, cmd_appended_num_args[k]);
+            replyBytes += HapticAvatar_CommandScheduler::replyBytes(protocol, num_return_vals[cmd_appended[k]]);
+        }
+
+        return m_scheduler.collect(uint64_t(send_counter), protocol, requestBytes, replyBytes, arenaBytes, exclude, cmds, SCHEDULER_MAX_CMDS);
+    }
+
+    unsigned int HapticAvatar_DriverBase::encodeAscii(char* outgoingData)
+    {
+        char* out = outgoingData;
+        char* const end = outgoingData + OUTGOING_DATA_LEN - 2; // keep room for the terminating " \n"
+        bool truncated = false;
+
+        // fill the cmd_send_list again, starting with the appended commands so that the setpoints are never pushed out by the subscriptions.
+        // A command is either fully written or not at all, those which do not fit are kept for the next cycle.
+        const int* args = cmd_appended_args;
+        m_appendedEncoded = 0;
+        m_appendedArgsEncoded = 0;
+        for (int k = 0; k < cmd_appended_size; k++) {
+            char* cmdStart = out;
+            bool fits = writeAsciiInt(out, end, cmd_appended[k]);
+            for (int i = 0; i < cmd_appended_num_args[k] && fits; i++)
+                fits = writeAsciiInt(out, end, args[i]);
+
+            if (!fits) {
+                out = cmdStart;
+                truncated = true;
+                break;
+            }
+
+            cmd_send_bytes[cmd_send_list_size] = int(out - cmdStart);
+            cmd_send_list[cmd_send_list_size++] = cmd_appended[k];
+            expected_num_return_vals += num_return_vals[cmd_appended[k]];
+            args += cmd_appended_num_args[k];
+            m_appendedEncoded++;
+            m_appendedArgsEncoded += cmd_appended_num_args[k];
+        }
+
+        // then the subscribed commands due in this cycle, they stay due if the arena is already full
+        if (!truncated) {
+            int scheduled[SCHEDULER_MAX_CMDS];
+            const int numScheduled = collectScheduled(WireProtocol::Ascii, int(end - out), nullptr, scheduled);
+            for (int i = 0; i < numScheduled; i++) {
+                char* cmdStart = out;
+                if (!writeAsciiInt(out, end, scheduled[i])) {
+                    truncated = true;
+                    break;
                 }
+                cmd_send_bytes[cmd_send_list_size] = int(out - cmdStart);
+                cmd_send_list[cmd_send_list_size++] = scheduled[i];
+                expected_num_return_vals += num_return_vals[scheduled[i]];
             }
+        }
+
+        if (truncated)
+            m_arenaStats.overflows++;
 
-            // Clear the appended list and string
-            cmd_appended_str.clear();
-            cmd_appended_size = 0;
+        // terminate the send string
+        *out++ = ' ';
+        *out++ = '\n';
 
-            send_counter++;
+        return (unsigned int)(out - outgoingData);
+    }
+
+    unsigned int HapticAvatar_DriverBase::encodeBinary(char* outgoingData)
+    {
+        char* out = outgoingData + wire::HEADER_SIZE;
+        const char* end = outgoingData + OUTGOING_DATA_LEN;
+        bool truncated = false;
+
+        // appended commands first, as in the Ascii format. Those which do not fit are kept for the next cycle.
+        const int* args = cmd_appended_args;
+        m_appendedEncoded = 0;
+        m_appendedArgsEncoded = 0;
+        for (int k = 0; k < cmd_appended_size; k++) {
+            if (out + wire::entrySize(cmd_appended_num_args[k]) > end || cmd_send_list_size == 255) {
+                truncated = true;
+                break;
+            }
+            cmd_send_bytes[cmd_send_list_size] = wire::entrySize(cmd_appended_num_args[k]);
+            cmd_send_list[cmd_send_list_size++] = cmd_appended[k];
+            expected_num_return_vals += num_return_vals[cmd_appended[k]];
+            out += wire::writeEntry(out, cmd_appended[k], args, cmd_appended_num_args[k]);
+            args += cmd_appended_num_args[k];
+            m_appendedEncoded++;
+            m_appendedArgsEncoded += cmd_appended_num_args[k];
         }
+
+        // then the subscribed commands. Commands pushed by the device are not requested.
+        if (!truncated) {
+            int scheduled[SCHEDULER_MAX_CMDS];
+            const int numScheduled = collectScheduled(WireProtocol::Binary, int(end - out), stream_active, scheduled);
+            for (int i = 0; i < numScheduled; i++) {
+                if (out + wire::entrySize(0) > end || cmd_send_list_size == 255) {
+                    truncated = true;
+                    break;
+                }
+                cmd_send_bytes[cmd_send_list_size] = wire::entrySize(0);
+                cmd_send_list[cmd_send_list_size++] = scheduled[i];
+                expected_num_return_vals += num_return_vals[scheduled[i]];
+                out += wire::writeEntry(out, scheduled[i], nullptr, 0);
+            }
+        }
+
+        if (truncated)
+            m_arenaStats.overflows++;
+
+        wire::FrameHeader header;
+        header.type = wire::FRAME_REQUEST;
+        header.count = uint8_t(cmd_send_list_size);
+        header.payloadLength = uint16_t(out - outgoingData - wire::HEADER_SIZE);
+        header.seq = ++send_seq;
+        wire::writeHeader(outgoingData, header);
+
+        return (unsigned int)(out - outgoingData);
     }
 
     void HapticAvatar_DriverBase::updateReceive()
     {
-        if (expected_num_return_vals > 0) {  // expected_num_return_vals is determined from the previous sent command set.
-            getDataImpl(incomingData, false);
-            //if (device_type == 1)
-                //std::cout << "Received data from device " << std::to_string(device_type) << ": " << incomingData << std::endl;
-            parseMessage();
+        if (m_wireProtocol == WireProtocol::Binary) {
+            // in binary mode the device answers every frame, even if no value is expected.
+            receiveFrames(false);
+        }
+        else if (expected_num_return_vals > 0) {  // expected_num_return_vals is determined from the previous sent command set.
+            // On timeout or error the rows not received keep their previous values.
+            receiveAsciiReply();
         }
         // now that the previous command is parsed, we can clear it
         expected_num_return_vals = 0;
@@ -347,209 +671,587 @@ namespace sofa::HapticAvatar
         //send_string.clear();
     }
 
-    void HapticAvatar_DriverBase::parseMessage()
+    void HapticAvatar_DriverBase::receiveFrames(bool waitAll, bool waitOnWire)
     {
-        // Parse and sort the incoming data into the result table, which is a two dimensional float array
-        char* pEnd = incomingData;
-        for (int k = 0; k < cmd_send_list_size; k++) {
-            for (int i = 0; i < num_return_vals[cmd_send_list[k]]; i++) {
-                result_table[cmd_send_list[k]][i] = std::strtof(pEnd, &pEnd) / scale_factor[cmd_send_list[k]];
-                //if (device_type == 1)
-                    //std::cout << "Port receive data " << std::to_string(result_table[cmd_send_list[k]][i]); 
+        while (m_inFlightCount > 0 || m_streaming) {
+            // only wait on the wire when no more frame can be sent without the oldest reply
+            const bool wait = waitOnWire && m_inFlightCount > 0 && (waitAll || m_inFlightCount >= m_pipelineDepth);
+            wire::FrameHeader header;
+            int frameSize = getFrameImpl(header, wait ? -1 : 0);
+            if (frameSize == RECEIVE_TIMEOUT && wait) {
+                // give up the oldest frame to free its slot
+                m_receiveTimeouts++;
+                popInFlight(true);
+                continue;
+            }
+            if (frameSize < 0)
+                break;
 
+            if (header.type == wire::FRAME_STREAM) {
+                parseStreamFrame(incomingData + wire::HEADER_SIZE, header);
+                dropIncoming(frameSize);
+                continue;
             }
+
+            if (header.type != wire::FRAME_REPLY) {
+                msg_warning("HapticAvatar_DriverBase") << "Unexpected frame type " << int(header.type) << " seq " << header.seq << " dropped.";
+                dropIncoming(frameSize);
+                continue;
+            }
+
+            int k = 0;
+            while (k < m_inFlightCount && m_inFlight[(m_inFlightFirst + k) % PIPELINE_MAX_DEPTH].seq != header.seq)
+                k++;
+
+            if (k < m_inFlightCount) {
+                // replies come in order: the frames sent before this one will not be answered anymore
+                for (int i = 0; i < k; i++)
+                    popInFlight(true);
+
+                const InFlightFrame& frame = m_inFlight[m_inFlightFirst];
+                if (parseFrame(incomingData + wire::HEADER_SIZE, header, frame))
+                    recordReply(frame.cmd_send_list, frame.cmd_send_list_size, frame.sendTime, header.payloadLength);
+                else
+                    recordErrors(frame.cmd_send_list, frame.cmd_send_list_size);
+
+                const double latencyUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - frame.sendTime).count();
+                m_pipelineStats.repliesParsed++;
+                m_pipelineStats.lastLatencyUs = latencyUs;
+                m_pipelineStats.sumLatencyUs += latencyUs;
+                if (latencyUs > m_pipelineStats.maxLatencyUs)
+                    m_pipelineStats.maxLatencyUs = latencyUs;
+                popInFlight(false);
+            }
+            // else: late reply of a frame already given up
+
+            dropIncoming(frameSize);
         }
-        //if (device_type == 1)
-        //    std::cout << std::endl;
+    }
 
+    void HapticAvatar_DriverBase::popInFlight(bool lost)
+    {
+        if (m_inFlightCount == 0)
+            return;
+
+        if (lost) {
+            const InFlightFrame& frame = m_inFlight[m_inFlightFirst];
+            recordErrors(frame.cmd_send_list, frame.cmd_send_list_size);
+            m_pipelineStats.framesLost++;
+        }
+        m_inFlightFirst = (m_inFlightFirst + 1) % PIPELINE_MAX_DEPTH;
+        m_inFlightCount--;
     }
 
-    void HapticAvatar_DriverBase::appendCmd(int cmd, const char* args)
+    void HapticAvatar_DriverBase::parseStreamFrame(const char* payload, const wire::FrameHeader& header)
     {
-        cmd_appended[cmd_appended_size++] = cmd;
-        cmd_appended_str += std::to_string(cmd) + " " + args;
+        if (m_streamStats.frames > 0 && uint16_t(header.seq - m_streamSeq) != 1)
+            m_streamStats.gaps++;
+        m_streamSeq = header.seq;
+        m_streamStats.frames++;
+        const uint64_t seq = ++m_receiveSeq;
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        // one entry per command due in this period, with the same scaled values as a reply
+        const char* entry = payload;
+        const char* end = payload + header.payloadLength;
+        for (int e = 0; e < header.count && entry + wire::ENTRY_HEADER_SIZE <= end; e++) {
+            const int cmd = uint8_t(entry[0]);
+            const int numVals = uint8_t(entry[1]);
+            if (entry + wire::entrySize(numVals) > end)
+                break;
+
+            if (cmd < device_num_cmds && numVals == num_return_vals[cmd] && numVals <= RESULT_SIZEY) {
+                for (int i = 0; i < numVals; i++)
+                    result_table[cmd][i] = float(wire::readInt32(entry + wire::ENTRY_HEADER_SIZE + i * wire::VALUE_SIZE)) / scale_factor[cmd];
+                result_stamp[cmd].seq = seq;
+                result_stamp[cmd].time = now;
+                m_streamStats.samples++;
+            }
+            entry += wire::entrySize(numVals);
+        }
     }
 
-    void HapticAvatar_DriverBase::updateIfUnsubscribed(int cmd)
+    int HapticAvatar_DriverBase::sendStreamTable(int periodUs)
     {
-        if (update_cmd_every_nth[cmd] == 0) {
-            appendCmd(cmd, "");
-            update(); // Read away any existing return data and request the data with cmd 
-            update(); // Read the data from this request. The data ends up in the results_table.
+        // one subscription entry per subscribed command with return values
+        char outgoingData[OUTGOING_DATA_LEN];
+        char* out = outgoingData + wire::HEADER_SIZE;
+        int cmds[RESULT_SIZEX];
+        int numCmds = 0;
+        for (int k = 0; k < device_num_cmds; k++) {
+            if (update_cmd_every_nth[k] <= 0 || num_return_vals[k] == 0)
+                continue;
+            if (periodUs == 0 && !stream_active[k])
+                continue;
+            int args[2] = { k, periodUs * update_cmd_every_nth[k] };
+            out += wire::writeEntry(out, wire::STREAM_SUBSCRIBE_CMD, args, 2);
+            cmds[numCmds++] = k;
+        }
+        if (numCmds == 0)
+            return 0;
+
+        wire::FrameHeader header;
+        header.type = wire::FRAME_REQUEST;
+        header.count = uint8_t(numCmds);
+        header.payloadLength = uint16_t(out - outgoingData - wire::HEADER_SIZE);
+        header.seq = ++send_seq;
+        wire::writeHeader(outgoingData, header);
+        if (!writeDataImpl(outgoingData, (unsigned int)(out - outgoingData)))
+            return 0;
+
+        // the device may push samples before its answer
+        int accepted = 0;
+        while (true) {
+            int frameSize = getFrameImpl(header, 200000);
+            if (frameSize < 0)
+                break;
+
+            if (header.type == wire::FRAME_STREAM) {
+                parseStreamFrame(incomingData + wire::HEADER_SIZE, header);
+            }
+            else if (header.type == wire::FRAME_REPLY && header.seq == send_seq) {
+                // older firmware do not know the command and answer without value: nothing is streamed
+                const bool known = (header.payloadLength == numCmds * wire::VALUE_SIZE);
+                for (int i = 0; i < numCmds; i++) {
+                    const bool on = known && periodUs > 0 && wire::readInt32(incomingData + wire::HEADER_SIZE + i * wire::VALUE_SIZE) == 1;
+                    stream_active[cmds[i]] = on;
+                    accepted += on ? 1 : 0;
+                }
+                dropIncoming(frameSize);
+                break;
+            }
+            dropIncoming(frameSize);
         }
+        return accepted;
     }
 
+    bool HapticAvatar_DriverBase::startStreaming(int basePeriodUs)
+    {
+        if (!m_connected || m_wireProtocol != WireProtocol::Binary || basePeriodUs <= 0) {
+            msg_error("HapticAvatar_DriverBase") << "Streaming needs a connected device using the binary protocol and a positive period.";
+            return false;
+        }
+
+        // the replies in flight were requested with the previous command lists
+        receiveFrames(true);
+        m_streaming = (sendStreamTable(basePeriodUs) > 0);
+        if (!m_streaming)
+            msg_warning("HapticAvatar_DriverBase") << "Device at " << m_portName << " does not stream, subscribed commands are still requested in each frame.";
 
-    std::string HapticAvatar_DriverBase::getDeviceType()
+        return m_streaming;
+    }
+
+    void HapticAvatar_DriverBase::stopStreaming()
     {
-        // Use this command only when to determine which type of device you are communicating with.
-        char incoming_str[100];
-        sendCommandToDevice(1, "", incoming_str);  // GET_DEVICE_TYPE command is number 1 on all Haptic Avatar devices
-        return convertSingleData(incoming_str);
+        if (!m_streaming)
+            return;
+
+        receiveFrames(true);
+        sendStreamTable(0);
+        for (int k = 0; k < RESULT_SIZEX; k++)
+            stream_active[k] = false;
+        m_streaming = false;
     }
 
-    void HapticAvatar_DriverBase::subscribeTo(int cmd, int every_nth)
+    bool HapticAvatar_DriverBase::setPipelineDepth(int depth)
     {
-        update_cmd_every_nth[cmd] = every_nth;
+        if (depth < 1 || depth > PIPELINE_MAX_DEPTH) {
+            msg_error("HapticAvatar_DriverBase") << "Pipeline depth " << depth << " out of range [1, " << PIPELINE_MAX_DEPTH << "].";
+            return false;
+        }
+
+        m_pipelineDepth = depth;
+        return true;
     }
 
-    sofa::type::fixed_array<float, 6> HapticAvatar_DriverBase::getFloat6(int cmd)
+    bool HapticAvatar_DriverBase::parseFrame(const char* payload, const wire::FrameHeader& header, const InFlightFrame& frame)
     {
-        updateIfUnsubscribed(cmd);
-        sofa::type::fixed_array<float, 6> results;
-        for (unsigned int i = 0; i < results.size(); i++) {
-            results[i] = result_table[cmd][i];
+        if (header.payloadLength != frame.expected_num_return_vals * wire::VALUE_SIZE) {
+            msg_warning("HapticAvatar_DriverBase") << "Reply to seq " << header.seq << " has " << header.payloadLength / wire::VALUE_SIZE << " values, " << frame.expected_num_return_vals << " expected.";
+            return false;
+        }
+
+        // Values come in the order of the command list of the frame, num_return_vals per command.
+        const uint64_t seq = ++m_receiveSeq;
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        const char* value = payload;
+        for (int k = 0; k < frame.cmd_send_list_size; k++) {
+            const int cmd = frame.cmd_send_list[k];
+            if (num_return_vals[cmd] == 0)
+                continue;
+            for (int i = 0; i < num_return_vals[cmd]; i++) {
+                result_table[cmd][i] = float(wire::readInt32(value)) / scale_factor[cmd];
+                value += wire::VALUE_SIZE;
+            }
+            result_stamp[cmd].seq = seq;
+            result_stamp[cmd].time = now;
         }
-        return results;
+        return true;
     }
 
-    sofa::type::fixed_array<float, 4> HapticAvatar_DriverBase::getFloat4(int cmd)
+    int HapticAvatar_DriverBase::getAppendedRequestBytes() const
     {
-        updateIfUnsubscribed(cmd);
-        sofa::type::fixed_array<float, 4> results;
-        for (unsigned int i = 0; i < results.size(); i++) {
-            results[i] = result_table[cmd][i];
+        int bytes = 0;
+        for (int k = 0; k < cmd_appended_size; k++)
+            bytes += HapticAvatar_CommandScheduler::requestBytes(m_wireProtocol, cmd_appended_num_args[k]);
+        return bytes;
+    }
+
+    void HapticAvatar_DriverBase::appendCmd(int cmd, const int* args, int num_args)
+    {
+        m_appendStats.appended++;
+
+        const CommandAppend mode = (command_table != nullptr && cmd >= 0 && cmd < device_num_cmds) ? command_table[cmd].append : CommandAppend::Queue;
+        if (mode != CommandAppend::Queue) {
+            // a setpoint is queued at most once per key, remove the older value before appending the new one
+            int offset = 0;
+            for (int k = 0; k < cmd_appended_size; k++) {
+                const int n = cmd_appended_num_args[k];
+                const bool sameKey = (mode == CommandAppend::Latest) || (n > 0 && num_args > 0 && cmd_appended_args[offset] == args[0]);
+                if (cmd_appended[k] == cmd && sameKey) {
+                    const int after = cmd_appended_size - k - 1;
+                    std::memmove(cmd_appended + k, cmd_appended + k + 1, after * sizeof(int));
+                    std::memmove(cmd_appended_num_args + k, cmd_appended_num_args + k + 1, after * sizeof(int));
+                    std::memmove(cmd_appended_args + offset, cmd_appended_args + offset + n, (cmd_appended_args_size - offset - n) * sizeof(int));
+                    cmd_appended_size--;
+                    cmd_appended_args_size -= n;
+                    m_appendStats.coalesced++;
+                    break;
+                }
+                offset += n;
+            }
+        }
+
+        if (cmd_appended_size >= APPENDED_MAX_CMDS || cmd_appended_args_size + num_args > APPENDED_ARGS_LEN) {
+            // only the first one is logged, this runs in the haptic loop
+            if (m_appendStats.dropped++ == 0)
+                msg_error("HapticAvatar_DriverBase") << "Appended command list full, command " << cmd << " dropped.";
+            return;
         }
-        return results;
+
+        cmd_appended[cmd_appended_size] = cmd;
+        cmd_appended_num_args[cmd_appended_size] = num_args;
+        cmd_appended_size++;
+        for (int i = 0; i < num_args; i++)
+            cmd_appended_args[cmd_appended_args_size++] = args[i];
+
+        if (cmd_appended_size > m_appendStats.highWater)
+            m_appendStats.highWater = cmd_appended_size;
     }
 
-    sofa::type::fixed_array<float, 3> HapticAvatar_DriverBase::getFloat3(int cmd)
+    bool HapticAvatar_DriverBase::setWireProtocol(WireProtocol protocol)
     {
-        updateIfUnsubscribed(cmd);
-        sofa::type::fixed_array<float, 3> results;
-        for (unsigned int i = 0; i < results.size(); i++) {
-            results[i] = result_table[cmd][i];
+        if (protocol == m_wireProtocol)
+            return true;
+
+        if (!m_connected)
+            return false;
+
+        // Read away the replies of the previous command sets, the device switches only between two frames.
+        if (m_wireProtocol == WireProtocol::Binary) {
+            stopStreaming();
+            receiveFrames(true);
         }
-        return results;
+        updateReceive();
+
+        const int version = (protocol == WireProtocol::Binary) ? wire::BINARY_PROTOCOL_VERSION : 0;
+        int answer = -1;
+
+        if (m_wireProtocol == WireProtocol::Ascii)
+        {
+            std::string fullCommand = std::to_string(wire::PROTOCOL_SELECT_CMD) + " " + std::to_string(version) + " \n";
+            char outgoingData[OUTGOING_DATA_LEN];
+            strcpy(outgoingData, fullCommand.c_str());
+            if (!writeDataImpl(outgoingData, (unsigned int)fullCommand.size()))
+                return false;
+
+            // Older firmware do not know this command: only wait a bounded time for the Ascii answer.
+            char reply[INCOMING_DATA_LEN];
+            m_staleReplies = 0;
+            if (getDataImpl(reply, false, 200000) > 0)
+                answer = std::atoi(reply);
+            m_staleReplies = 0;
+        }
+        else
+        {
+            // The switch back is requested in a binary frame, the device answers with one value.
+            int arg = version;
+            char outgoingData[OUTGOING_DATA_LEN];
+            char* out = outgoingData + wire::HEADER_SIZE;
+            out += wire::writeEntry(out, wire::PROTOCOL_SELECT_CMD, &arg, 1);
+
+            wire::FrameHeader header;
+            header.type = wire::FRAME_REQUEST;
+            header.count = 1;
+            header.payloadLength = uint16_t(out - outgoingData - wire::HEADER_SIZE);
+            header.seq = ++send_seq;
+            wire::writeHeader(outgoingData, header);
+            if (!writeDataImpl(outgoingData, (unsigned int)(out - outgoingData)))
+                return false;
+
+            int frameSize = getFrameImpl(header, 200000);
+            if (frameSize > 0 && header.payloadLength == wire::VALUE_SIZE)
+                answer = wire::readInt32(incomingData + wire::HEADER_SIZE);
+            if (frameSize > 0)
+                dropIncoming(frameSize);
+        }
+
+        if (answer != version)
+        {
+            // Read away anything the device could have answered instead.
+            int que = 0;
+            readDataImpl(incomingData, INCOMING_DATA_LEN, &que, true);
+            msg_warning("HapticAvatar_DriverBase") << "Device at " << m_portName << " does not support the requested wire protocol, keeping the current one.";
+            return false;
+        }
+
+        m_wireProtocol = protocol;
+        incoming_size = 0;
+        return true;
     }
 
-    float HapticAvatar_DriverBase::getFloat(int cmd)
+    void HapticAvatar_DriverBase::updateIfUnsubscribed(int cmd)
     {
-        updateIfUnsubscribed(cmd);
-        return result_table[cmd][0];
+        if (update_cmd_every_nth[cmd] == 0) {
+            appendCmd(cmd);
+            update(); // Read away any existing return data and request the data with cmd 
+            // Only wait for the reply of this request, without sending another one. The data ends up in the results_table.
+            if (m_wireProtocol == WireProtocol::Binary)
+                receiveFrames(true); // The data is needed now, whatever the pipeline depth.
+            else
+                updateReceive();
+        }
     }
 
-    float HapticAvatar_DriverBase::getFloat(int cmd, int channel)
+    double HapticAvatar_DriverBase::getCommandAge(int cmd, std::chrono::steady_clock::time_point now) const
     {
-        updateIfUnsubscribed(cmd);
-        if (channel >= 0 && channel < RESULT_SIZEY)
-            return result_table[cmd][channel];
-        else
-            return 0;
+        if (result_stamp[cmd].seq == 0)
+            return -1.0;
+        return std::chrono::duration<double, std::micro>(now - result_stamp[cmd].time).count();
     }
 
 
-    int HapticAvatar_DriverBase::getInt(int cmd)
+    std::string HapticAvatar_DriverBase::getDeviceType()
     {
-        updateIfUnsubscribed(cmd);
-        return (int)result_table[cmd][0];
+        // Use this command only when to determine which type of device you are communicating with.
+        char incoming_str[INCOMING_DATA_LEN];
+        incoming_str[0] = '\0';
+        sendCommandToDevice(1, "", incoming_str);  // GET_DEVICE_TYPE command is number 1 on all Haptic Avatar devices
+        return convertSingleData(incoming_str);
     }
-    int HapticAvatar_DriverBase::getInt(int cmd, int channel)
+
+    void HapticAvatar_DriverBase::recordReply(const int* cmds, int numCmds, const std::chrono::steady_clock::time_point& sendTime, int replyBytes)
     {
-        updateIfUnsubscribed(cmd);
-        if (channel >= 0 && channel < RESULT_SIZEY)
-            return (int)result_table[cmd][channel];
-        else
-            return 0;
+        const int64_t latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sendTime).count();
+        int numVals = 0;
+        for (int k = 0; k < numCmds; k++)
+            numVals += num_return_vals[cmds[k]];
+
+        for (int k = 0; k < numCmds; k++) {
+            CommandStats& stats = m_commandStats[cmds[k]];
+            stats.latency.record(latencyUs > 0 ? uint64_t(latencyUs) : 0);
+            if (numVals > 0) {
+                const uint64_t bytes = uint64_t(replyBytes) * uint64_t(num_return_vals[cmds[k]]) / uint64_t(numVals);
+                stats.bytesReceived.store(stats.bytesReceived.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+            }
+        }
     }
 
-   sofa::type::fixed_array<int, 4> HapticAvatar_DriverBase::getInt4(int cmd)
+    void HapticAvatar_DriverBase::recordErrors(const int* cmds, int numCmds)
     {
-        updateIfUnsubscribed(cmd);
-        sofa::type::fixed_array<int, 4> results;
-        for (unsigned int i = 0; i < results.size(); i++) {
-            results[i] = (int)result_table[cmd][i];
+        for (int k = 0; k < numCmds; k++) {
+            CommandStats& stats = m_commandStats[cmds[k]];
+            stats.errors.store(stats.errors.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
         }
-        return results;
     }
-    sofa::type::fixed_array<int, 6> HapticAvatar_DriverBase::getInt6(int cmd)
+
+    void HapticAvatar_DriverBase::printCommandStats(std::ostream& out) const
     {
-        updateIfUnsubscribed(cmd);
-        sofa::type::fixed_array<int, 6> results;
-        for (unsigned int i = 0; i < results.size(); i++) {
-            results[i] = (int)result_table[cmd][i];
+        out << std::left << std::setw(30) << "command" << std::right << std::setw(8) << "p50" << std::setw(8) << "p99" << std::setw(8) << "p99.9" << std::setw(8) << "max"
+            << std::setw(10) << "requests" << std::setw(12) << "bytesSent" << std::setw(12) << "bytesRecv" << std::setw(8) << "errors" << "\n";
+        for (int k = 0; k < device_num_cmds; k++) {
+            const CommandStats& stats = m_commandStats[k];
+            const uint64_t requests = stats.requests.load(std::memory_order_relaxed);
+            if (requests == 0)
+                continue;
+
+            const char* name = getCommandName(k);
+            out << std::left << std::setw(30) << (name != nullptr ? name : std::to_string(k).c_str()) << std::right
+                << std::setw(8) << stats.latency.getPercentile(50.0) << std::setw(8) << stats.latency.getPercentile(99.0)
+                << std::setw(8) << stats.latency.getPercentile(99.9) << std::setw(8) << stats.latency.getMax()
+                << std::setw(10) << requests << std::setw(12) << stats.bytesSent.load(std::memory_order_relaxed)
+                << std::setw(12) << stats.bytesReceived.load(std::memory_order_relaxed) << std::setw(8) << stats.errors.load(std::memory_order_relaxed) << "\n";
         }
-        return results;
     }
 
+    void HapticAvatar_DriverBase::subscribeTo(int cmd, int every_nth)
+    {
+        CommandLane lane = CommandLane::Status;
+        if (every_nth == 1)
+            lane = CommandLane::Control;
+        else if (every_nth > 1000)
+            lane = CommandLane::Diagnostics;
+        subscribeTo(cmd, every_nth, lane);
+    }
+
+    void HapticAvatar_DriverBase::subscribeTo(int cmd, int every_nth, CommandLane lane)
+    {
+        update_cmd_every_nth[cmd] = every_nth;
+        m_scheduler.subscribe(cmd, every_nth, lane, num_return_vals[cmd], send_counter);
+    }
+
+    int HapticAvatar_DriverBase::getCommandId(const std::string& name) const
+    {
+        if (command_table == nullptr)
+            return -1;
+
+        for (int k = 0; k < device_num_cmds; k++) {
+            if (name == command_table[k].name)
+                return k;
+        }
+        return -1;
+    }
+
+    bool HapticAvatar_DriverBase::loadSubscriptionProfile(const std::string& filename)
+    {
+        TiXmlDocument doc(filename.c_str());
+        if (!doc.LoadFile())
+        {
+            msg_error("HapticAvatar_DriverBase") << "Failed to open subscription profile " << filename << "\n" << doc.ErrorDesc() << " at line " << doc.ErrorRow() << " row " << doc.ErrorCol();
+            return false;
+        }
+
+        const TiXmlElement* hRoot = doc.RootElement();
+        if (hRoot == nullptr || hRoot->ValueStr() != "SubscriptionProfile")
+        {
+            msg_error("HapticAvatar_DriverBase") << "File format error in " << filename << ", searching for SubscriptionProfile.";
+            return false;
+        }
+
+        // check all the entries before changing anything
+        int cmds[RESULT_SIZEX];
+        int periods[RESULT_SIZEX];
+        CommandLane lanes[RESULT_SIZEX];
+        int numCmds = 0;
+        for (const TiXmlElement* cmdNode = hRoot->FirstChildElement("Command"); cmdNode != nullptr; cmdNode = cmdNode->NextSiblingElement("Command"))
+        {
+            const char* name = cmdNode->Attribute("Name");
+            int cmd = (name != nullptr) ? getCommandId(name) : -1;
+            if (cmd < 0)
+            {
+                msg_error("HapticAvatar_DriverBase") << "Unknown command " << (name != nullptr ? name : "(no Name)") << " in subscription profile " << filename;
+                return false;
+            }
+
+            int period = 0;
+            if (cmdNode->QueryIntAttribute("Period", &period) != TIXML_SUCCESS || period < 0)
+            {
+                msg_error("HapticAvatar_DriverBase") << "Missing or invalid Period for command " << name << " in subscription profile " << filename;
+                return false;
+            }
+
+            CommandLane lane = (period == 1) ? CommandLane::Control : ((period > 1000) ? CommandLane::Diagnostics : CommandLane::Status);
+            const char* laneName = cmdNode->Attribute("Lane");
+            if (laneName != nullptr)
+            {
+                const std::string slane(laneName);
+                if (slane == "Control")
+                    lane = CommandLane::Control;
+                else if (slane == "Status")
+                    lane = CommandLane::Status;
+                else if (slane == "Diagnostics")
+                    lane = CommandLane::Diagnostics;
+                else
+                {
+                    msg_error("HapticAvatar_DriverBase") << "Unknown Lane " << slane << " for command " << name << " in subscription profile " << filename;
+                    return false;
+                }
+            }
+
+            if (numCmds == RESULT_SIZEX)
+                break;
+            cmds[numCmds] = cmd;
+            periods[numCmds] = period;
+            lanes[numCmds] = lane;
+            numCmds++;
+        }
+
+        for (int k = 0; k < RESULT_SIZEX; k++)
+            update_cmd_every_nth[k] = 0;
+        m_scheduler.clear();
+        for (int i = 0; i < numCmds; i++)
+            subscribeTo(cmds[i], periods[i], lanes[i]);
+
+        int budget = 0;
+        int linkRate = 0;
+        int cycleRate = 0;
+        if (hRoot->QueryIntAttribute("ByteBudget", &budget) == TIXML_SUCCESS)
+            m_scheduler.setByteBudget(budget);
+        else if (hRoot->QueryIntAttribute("LinkRate", &linkRate) == TIXML_SUCCESS && hRoot->QueryIntAttribute("CycleRate", &cycleRate) == TIXML_SUCCESS)
+            m_scheduler.setLinkRate(linkRate, cycleRate);
+
+        return true;
+    }
 
     void HapticAvatar_DriverBase::appendIntFloat(int cmd, int chan, float value)
     {
-        std::string arguments;
-        arguments = std::to_string(chan) + " " + 
-            std::to_string(int(value * scale_factor[cmd])) + " ";
-        appendCmd(cmd, arguments.c_str());
+        int arguments[2] = { chan, int(value * scale_factor[cmd]) };
+        appendCmd(cmd, arguments, 2);
     }
     void HapticAvatar_DriverBase::appendIntFloat(int cmd, int chan, float value1, float value2)
     {
-        std::string arguments;
-        arguments = std::to_string(chan) + " " + 
-            std::to_string(int(value1 * scale_factor[cmd])) + " " + 
-            std::to_string(int(value2 * scale_factor[cmd])) + " ";
-        appendCmd(cmd, arguments.c_str());
+        int arguments[3] = { chan, int(value1 * scale_factor[cmd]), int(value2 * scale_factor[cmd]) };
+        appendCmd(cmd, arguments, 3);
     }
     void HapticAvatar_DriverBase::appendIntFloat(int cmd, int value, sofa::type::fixed_array<float, 3> values)
     {
-        std::string arguments;
-        arguments = std::to_string(value) + " " +
-            std::to_string(int(values[0] * scale_factor[cmd])) + " " +
-            std::to_string(int(values[1] * scale_factor[cmd])) + " " +
-            std::to_string(int(values[2] * scale_factor[cmd])) + " ";
-        appendCmd(cmd, arguments.c_str());
+        int arguments[4] = { value,
+            int(values[0] * scale_factor[cmd]),
+            int(values[1] * scale_factor[cmd]),
+            int(values[2] * scale_factor[cmd]) };
+        appendCmd(cmd, arguments, 4);
     }
 
     void HapticAvatar_DriverBase::appendInt(int cmd, int value)
     {
-        std::string arguments;
-        arguments = std::to_string(value) + " ";
-        appendCmd(cmd, arguments.c_str());
+        appendCmd(cmd, &value, 1);
     }
 
     void HapticAvatar_DriverBase::appendInt(int cmd, int value1, int value2)
     {
-        std::string arguments;
-        arguments = std::to_string(value1) + " " +
-            std::to_string(value2) + " ";
-        appendCmd(cmd, arguments.c_str());
+        int arguments[2] = { value1, value2 };
+        appendCmd(cmd, arguments, 2);
     }
 
     void HapticAvatar_DriverBase::appendFloat(int cmd, float value)
     {
-        std::string arguments;
-        arguments = std::to_string(value) + " ";
-        appendCmd(cmd, arguments.c_str());
+        int argument = int(value * scale_factor[cmd]);
+        appendCmd(cmd, &argument, 1);
     }
     void HapticAvatar_DriverBase::appendFloat(int cmd, sofa::type::fixed_array<float, 4> values)
     {
-        std::string arguments;
+        int arguments[4];
         for (unsigned int i = 0; i < values.size(); i++)
-        {
-            int value = int(values[i] * scale_factor[cmd]);
-            arguments += std::to_string(value) + " ";
-        }
+            arguments[i] = int(values[i] * scale_factor[cmd]);
 
-        appendCmd(cmd, arguments.c_str());
+        appendCmd(cmd, arguments, 4);
     }
     void HapticAvatar_DriverBase::appendFloat(int cmd, float f1, float f2, float f3, float f4)
     {
-        std::string arguments;
-        arguments = std::to_string(int(f1 * scale_factor[cmd])) + " " +
-            std::to_string(int(f2 * scale_factor[cmd])) + " " +
-            std::to_string(int(f3 * scale_factor[cmd])) + " " +
-            std::to_string(int(f4 * scale_factor[cmd])) + " ";
-        appendCmd(cmd, arguments.c_str());
+        int arguments[4] = { int(f1 * scale_factor[cmd]),
+            int(f2 * scale_factor[cmd]),
+            int(f3 * scale_factor[cmd]),
+            int(f4 * scale_factor[cmd]) };
+        appendCmd(cmd, arguments, 4);
     }
 
     void HapticAvatar_DriverBase::appendFloat(int cmd, sofa::type::fixed_array<float, 6> values)
     {
-        std::string arguments;
+        int arguments[6];
         for (unsigned int i = 0; i < values.size(); i++)
-        {
-            int value = int(values[i] * scale_factor[cmd]);
-            arguments += std::to_string(value) + " ";
-        }
+            arguments[i] = int(values[i] * scale_factor[cmd]);
 
-        appendCmd(cmd, arguments.c_str());
+        appendCmd(cmd, arguments, 6);
     }
 
 }
\ No newline at end of file
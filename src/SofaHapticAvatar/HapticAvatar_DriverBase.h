@@ -23,7 +23,16 @@
 
 #include <SofaHapticAvatar/config.h>
 //#include <SofaHapticAvatar/HapticAvatar_Defines.h>
+#include <SofaHapticAvatar/HapticAvatar_Transport.h>
+#include <SofaHapticAvatar/HapticAvatar_CommandTables.h>
+#include <SofaHapticAvatar/HapticAvatar_WireProtocol.h>
+#include <SofaHapticAvatar/HapticAvatar_ReplyParser.h>
+#include <SofaHapticAvatar/HapticAvatar_CommandScheduler.h>
+#include <SofaHapticAvatar/HapticAvatar_LatencyHistogram.h>
 #include <sofa/type/Vec.h>
+#include <atomic>
+#include <chrono>
+#include <iosfwd>
 #include <string>
 
 namespace sofa::HapticAvatar
@@ -32,9 +41,11 @@ namespace sofa::HapticAvatar
 #define OUTGOING_DATA_LEN 1024
 #define INCOMING_DATA_LEN 1024
 #define NBJOINT 6
-#define ARDUINO_WAIT_TIME 2000
 #define RESULT_SIZEX  52
 #define RESULT_SIZEY  12
+#define APPENDED_ARGS_LEN 4096
+#define APPENDED_MAX_CMDS 1000
+#define PIPELINE_MAX_DEPTH 8
 
     /**
     * HapticAvatar driver
@@ -42,7 +53,11 @@ namespace sofa::HapticAvatar
     class SOFA_HAPTICAVATAR_API HapticAvatar_DriverBase
     {
     public:
-        HapticAvatar_DriverBase(const std::string& portName);
+        /** Create the driver and connect to the device.
+        * @param {string} portName: name of the serial port of the device.
+        * @param {HapticAvatar_Transport *} transport: transport to use, ownership is taken. If null the default transport of the platform is created.
+        */
+        HapticAvatar_DriverBase(const std::string& portName, HapticAvatar_Transport* transport = nullptr);
 
         virtual ~HapticAvatar_DriverBase();
 
@@ -76,6 +91,181 @@ namespace sofa::HapticAvatar
         /// Read data from device and send new commands to device
         void update();
 
+        /** Send the requests of a cycle without receiving the replies of the previous ones, the second half of @sa update.
+        * Used by a reactor servicing several devices from one thread (@sa HapticAvatar_DeviceHub): it calls @sa receiveAvailable
+        * each time the transport is readable and @sa expireReply once the reply is late, before sending again.
+        */
+        void sendRequests();
+
+        /// True while the reply of the last requests is needed before the next ones can be sent.
+        bool isWaitingReply() const;
+
+        /** Read and parse the bytes already received from the device, never waits.
+        * @returns {bool} true if no reply is awaited anymore, see @sa isWaitingReply.
+        */
+        bool receiveAvailable();
+
+        /// Give up the reply awaited, it is counted as a timeout. The rows not received keep their previous values.
+        void expireReply();
+
+        /// Handle of the transport a reactor can wait on, -1 if it can't be multiplexed.
+        int getPollHandle() const { return m_transport->getPollHandle(); }
+
+        /** Select the wire format used by @sa update. Switching to Binary is negotiated with the device,
+        * older firmware not answering the request keep the Ascii format.
+        * @param {WireProtocol} protocol: the format to use.
+        * @returns {bool} true if the device now uses the requested format.
+        */
+        bool setWireProtocol(WireProtocol protocol);
+
+        /// Get the wire format currently used with the device.
+        WireProtocol getWireProtocol() const { return m_wireProtocol; }
+
+        /** Set the maximum time to wait for a reply from the device. The calling thread sleeps in the kernel while waiting.
+        * @param {int} timeoutUs: timeout in microseconds.
+        */
+        void setReceiveTimeout(int timeoutUs) { m_receiveTimeoutUs = timeoutUs; }
+        int getReceiveTimeout() const { return m_receiveTimeoutUs; }
+
+        /** Set the number of binary frames that can be sent before the reply of the oldest one is needed by @sa update.
+        * With a depth of 1 each update waits for the reply of the previous frame. With a larger depth, update only reads the replies
+        * already received and waits on the wire only when the pipeline is full. Results are then up to depth-1 frames old.
+        * Only used with the Binary wire protocol, Ascii replies are not sequence-numbered and always use a depth of 1.
+        * @param {int} depth: number of frames in flight, between 1 and PIPELINE_MAX_DEPTH.
+        * @returns {bool} false if the depth is out of range.
+        */
+        bool setPipelineDepth(int depth);
+        int getPipelineDepth() const { return m_pipelineDepth; }
+
+        /// Statistics of the frames sent in pipelined mode, latencies are measured from the write of a frame to the parse of its reply.
+        struct PipelineStats
+        {
+            uint64_t framesSent = 0;     ///< number of binary frames sent
+            uint64_t repliesParsed = 0;  ///< number of replies matched to their frame and parsed
+            uint64_t framesLost = 0;     ///< number of frames whose reply never came or came too late
+            double lastLatencyUs = 0.0;  ///< latency of the last parsed reply, in microseconds
+            double maxLatencyUs = 0.0;   ///< largest latency since the connection
+            double sumLatencyUs = 0.0;   ///< sum of all latencies, divide by repliesParsed for the mean
+        };
+
+        const PipelineStats& getPipelineStats() const { return m_pipelineStats; }
+        /// Number of frames currently waiting for their reply.
+        int getNumFramesInFlight() const { return m_inFlightCount; }
+
+        /** Let the device push the subscribed commands (@sa subscribeTo) by itself instead of requesting them in every frame.
+        * The subscription table is registered once, then the samples pushed by the device are parsed into the result table by
+        * @sa update without any request. Commands refused by the device keep being requested. Only available with the Binary wire protocol.
+        * @param {int} basePeriodUs: push period of a command subscribed every cycle, in microseconds. A command subscribed every nth cycle is pushed every n*basePeriodUs.
+        * @returns {bool} true if the device accepted at least one subscription.
+        */
+        bool startStreaming(int basePeriodUs);
+
+        /// Remove the stream subscriptions from the device, the subscribed commands are requested again in each frame.
+        void stopStreaming();
+
+        bool isStreaming() const { return m_streaming; }
+
+        /// Statistics of the frames pushed by the device in streaming mode.
+        struct StreamStats
+        {
+            uint64_t frames = 0;   ///< number of stream frames received
+            uint64_t samples = 0;  ///< number of command samples parsed into the result table
+            uint64_t gaps = 0;     ///< number of times the stream sequence number skipped, i.e. frames lost
+        };
+
+        const StreamStats& getStreamStats() const { return m_streamStats; }
+
+        /** Replace the subscriptions of the driver by the ones of a profile file. The root element is SubscriptionProfile, with an optional
+        * ByteBudget attribute (bytes per cycle) or LinkRate (bytes per second) and CycleRate (cycles per second) attributes. Each Command child
+        * element has a Name, as in the command enum of the device, a Period in cycles and an optional Lane: Control, Status or Diagnostics.
+        * @param {string} filename: full path of the XML profile.
+        * @returns {bool} false if the file can't be read, the subscriptions of the driver are then unchanged.
+        */
+        bool loadSubscriptionProfile(const std::string& filename);
+
+        /// Set the number of bytes a cycle of @sa update can use in each direction, 0 for no limit (default). @sa HapticAvatar_CommandScheduler
+        void setCycleByteBudget(int bytes) { m_scheduler.setByteBudget(bytes); }
+        int getCycleByteBudget() const { return m_scheduler.getByteBudget(); }
+
+        /** Derive the byte budget of a cycle from the rate of the link and the rate @sa update is called at.
+        * @param {int} bytesPerSecond: usable rate of the link, e.g. baud rate / 10.
+        * @param {int} cycleRate: number of calls to update per second.
+        */
+        void setLinkRate(int bytesPerSecond, int cycleRate) { m_scheduler.setLinkRate(bytesPerSecond, cycleRate); }
+
+        const HapticAvatar_CommandScheduler::Stats& getSchedulerStats() const { return m_scheduler.getStats(); }
+
+        /// Get the id of the command named @param name in the command enum of the device, -1 if unknown.
+        int getCommandId(const std::string& name) const;
+
+        /// True if @param cmd is sent periodically, its getter then returns the last value received without waiting for the device.
+        bool isSubscribed(int cmd) const { return update_cmd_every_nth[cmd] > 0; }
+
+        /** Receive sequence number of the last values of @param cmd in the result table, 0 if they have never been received.
+        * It increases with each reply or stream frame parsed: values received after a sequence number seq have a greater one.
+        * Like the other freshness queries, to be called from the thread calling @sa update.
+        */
+        uint64_t getCommandSequence(int cmd) const { return result_stamp[cmd].seq; }
+
+        /// True if values of @param cmd newer than the reply or stream frame @param seq have been received, see @sa getCommandSequence.
+        bool isCommandNewer(int cmd, uint64_t seq) const { return result_stamp[cmd].seq > seq; }
+
+        /// Time the last values of @param cmd have been received, meaningless if @sa getCommandSequence is 0.
+        std::chrono::steady_clock::time_point getCommandTime(int cmd) const { return result_stamp[cmd].time; }
+
+        /// Age of the last values of @param cmd at @param now in microseconds, negative if they have never been received.
+        double getCommandAge(int cmd, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) const;
+
+        /// Statistics of one command since the connection. Written by the thread calling @sa update, readable from any thread.
+        struct CommandStats
+        {
+            HapticAvatar_LatencyHistogram latency;     ///< round trip from the write of the request to the parse of its reply, in microseconds
+            std::atomic<uint64_t> requests{ 0 };       ///< number of requests written
+            std::atomic<uint64_t> bytesSent{ 0 };      ///< bytes of the requests, without the frame headers
+            std::atomic<uint64_t> bytesReceived{ 0 };  ///< bytes of the replies. In Ascii the line is shared between its commands by number of values
+            std::atomic<uint64_t> errors{ 0 };         ///< requests whose reply timed out, was lost, malformed or could not be written
+        };
+
+        /// Get the statistics of command @param cmd, lower than RESULT_SIZEX.
+        const CommandStats& getCommandStats(int cmd) const { return m_commandStats[cmd]; }
+
+        /// Get the name of command @param cmd in the command enum of the device, nullptr if unknown.
+        const char* getCommandName(int cmd) const { return (command_table != nullptr && cmd >= 0 && cmd < device_num_cmds) ? command_table[cmd].name : nullptr; }
+
+        /// Write one line per command sent since the connection: latency p50, p99, p99.9 and max in microseconds, requests, bytes and errors.
+        void printCommandStats(std::ostream& out) const;
+
+        /// Number of replies not received before the timeout since the connection.
+        uint64_t getReceiveTimeoutCount() const { return m_receiveTimeouts; }
+        /// Number of errors reported by the transport while receiving since the connection.
+        uint64_t getReceiveErrorCount() const { return m_receiveErrors; }
+        /// Number of Ascii replies with missing, extra or invalid values since the connection. Incomplete rows are never committed.
+        uint64_t getMalformedReplyCount() const { return m_malformedReplies; }
+
+        /// Statistics of the output arena used by @sa update to assemble the commands sent to the device.
+        struct OutputArenaStats
+        {
+            unsigned int capacity = OUTGOING_DATA_LEN; ///< size of the arena in bytes
+            unsigned int highWater = 0;  ///< largest command set assembled so far, in bytes
+            uint64_t overflows = 0;      ///< number of cycles where commands did not fit, the appended ones are kept for the next cycle
+            uint64_t cycles = 0;         ///< number of calls to update while connected
+            uint64_t allocations = 0;    ///< heap allocations made inside update, only counted if @sa isAllocationCountTracked
+        };
+
+        const OutputArenaStats& getOutputArenaStats() const { return m_arenaStats; }
+
+        /// Statistics of the queue of the commands appended between two cycles, such as the forces. @sa appendCmd
+        struct AppendQueueStats
+        {
+            uint64_t appended = 0;   ///< calls to appendCmd
+            uint64_t coalesced = 0;  ///< setpoints replaced by a newer value before being sent
+            uint64_t dropped = 0;    ///< commands dropped because the queue was full
+            uint64_t carried = 0;    ///< commands which did not fit in the output arena and were kept for the next cycle
+            int highWater = 0;       ///< largest number of commands queued for one cycle
+        };
+
+        const AppendQueueStats& getAppendQueueStats() const { return m_appendStats; }
+
         virtual void printStatus() = 0;
   
 
@@ -85,13 +275,68 @@ namespace sofa::HapticAvatar
 
         void updateReceive();
 
-        /** Internal method to get response from the device. Will be looping while calling @sa ReadDataImplLooping with a security of 10k loop.
-        * @param {char *} buffer: array to store the response.
+        /// Encode and write the commands of the cycle, then clear the appended ones.
+        void sendRequestsImpl();
+
+        /// Error codes returned by @sa getDataImpl and @sa getFrameImpl
+        enum ReceiveError
+        {
+            RECEIVE_ERROR = -1,
+            RECEIVE_TIMEOUT = -2
+        };
+
+        /** Internal method to get an Ascii response from the device. Waits for the transport to be readable and keeps reading
+        * until a complete line is received or the deadline is reached. If previous replies timed out, their late lines are read away
+        * and only the last line is kept at the start of @param buffer.
+        * @param {char *} buffer: array to store the response, INCOMING_DATA_LEN long.
         * @param {bool} do_flush: to flush after getting response.
+        * @param {int} timeoutUs: time to wait in microseconds, the receive timeout of the driver if negative.
+        * @returns {int} the number of lines received, RECEIVE_TIMEOUT or RECEIVE_ERROR.
+        */
+        int getDataImpl(char* buffer, bool do_flush, int timeoutUs = -1);
+
+        /** Internal method to get one complete binary frame from the device into incomingData. Bytes received after the frame are kept
+        * for the next call, call @sa dropIncoming with the frame size once it has been parsed.
+        * @param {wire::FrameHeader} header: decoded header of the frame.
+        * @param {int} timeoutUs: time to wait in microseconds, the receive timeout of the driver if negative.
+        * @returns {int} the size of the frame, RECEIVE_TIMEOUT or RECEIVE_ERROR.
+        */
+        int getFrameImpl(wire::FrameHeader& header, int timeoutUs = -1);
+
+        /** Internal method to receive the Ascii reply of the last command set. Bytes are read in chunks as soon as they arrive
+        * and given to @sa m_replyParser, which commits each row of the result table once complete.
+        * @returns {int} the number of rows committed, RECEIVE_TIMEOUT or RECEIVE_ERROR. Rows completed before a timeout stay committed.
+        */
+        int receiveAsciiReply();
+
+        /// End the Ascii reply given to @sa m_replyParser so far, counting a timeout if it is not complete. Returns as @sa receiveAsciiReply.
+        int finishAsciiReply();
+
+        /// Read away the bytes received while no reply is awaited. Ascii lines read away are late replies, no longer expected.
+        void discardAvailable();
+
+        /// Remove the first @param size bytes of incomingData, keeping the bytes received after them.
+        void dropIncoming(int size);
+
+        /// Snapshot of a binary frame sent to the device, used to parse its reply.
+        struct InFlightFrame
+        {
+            uint16_t seq = 0;
+            int cmd_send_list[255]; // a binary frame has at most 255 entries
+            int cmd_send_list_size = 0;
+            int expected_num_return_vals = 0;
+            std::chrono::steady_clock::time_point sendTime;
+        };
+
+        /** Receive and parse the replies of the binary frames in flight and the frames pushed by the device. Frames already
+        * received are always parsed, the method waits on the wire only if the pipeline is full or if @param waitAll is true,
+        * and never if @param waitOnWire is false.
         */
-        int getDataImpl(char* buffer, bool do_flush);
+        void receiveFrames(bool waitAll, bool waitOnWire = true);
+        /// Remove the oldest frame in flight, @param lost if its reply has not been parsed.
+        void popInFlight(bool lost);
 
-        /** Internal low level method to really do the job of getting a response from the device
+        /** Internal low level method to really do the job of getting a response from the device. Forwarded to the transport.
         * @param {char *} buffer: array to store the response.
         * @param {uint} nbChar: size of the command array
         * @param {int *} queue: queue size to be read.
@@ -99,7 +344,7 @@ namespace sofa::HapticAvatar
         */
         int readDataImpl(char* buffer, unsigned int nbChar, int* queue, bool do_flush);
 
-        /** Internal low level method to really do the job of sending a command to the device.
+        /** Internal low level method to really do the job of sending a command to the device. Forwarded to the transport.
         * @param {char *} buffer: full command as an array.
         * @param {uint} nbChar: size of the command array
         */
@@ -111,38 +356,119 @@ namespace sofa::HapticAvatar
 
         int device_type = 0;
         int device_num_cmds = 0;  // must be set
-        int num_return_vals[RESULT_SIZEX] = { 0 }; // Shall be initialized with the number of return values from each request command
-        float scale_factor[RESULT_SIZEX] = { 1.0f }; // Data from devices are sent as integers. This array shall be initialized with the convertion factors back to float.
-        float result_table[RESULT_SIZEX][RESULT_SIZEY]; // A table that contains the latest data from a device.
+        int num_return_vals[RESULT_SIZEX] = { 0 }; // Number of return values from each request command, copied from the descriptor table by setupCommandTable
+        float scale_factor[RESULT_SIZEX] = { 1.0f }; // Data from devices are sent as integers. Convertion factors back to float, copied from the descriptor table by setupCommandTable
+        float result_table[RESULT_SIZEX][RESULT_SIZEY] = {}; // A table that contains the latest data from a device, 0 until received.
+        ResultRowStamp result_stamp[RESULT_SIZEX]; // Reply and time each row of result_table has been received with
+        uint64_t m_receiveSeq = 0; // Receive sequence number of the last reply started or frame parsed
         int update_cmd_every_nth[RESULT_SIZEX] = { 0 };
+        const CommandDescriptor* command_table = nullptr; // Descriptors of the commands, device_num_cmds long. Set by each device driver with setupCommandTable.
+        HapticAvatar_CommandScheduler m_scheduler; // Chooses the subscribed commands sent at each cycle
         
         char incomingData[INCOMING_DATA_LEN];
+        int incoming_size = 0; // Number of bytes waiting in incomingData (binary protocol)
+        char outgoing_arena[OUTGOING_DATA_LEN]; // Preallocated buffer where update() assembles the commands in place
 
-        int cmd_appended[1000];  // A list of commands that is appended based on events in the simulation, such as forces, turning force feedback on/off etc.
+        int cmd_appended[APPENDED_MAX_CMDS];  // A list of commands that is appended based on events in the simulation, such as forces, turning force feedback on/off etc.
+        int cmd_appended_num_args[APPENDED_MAX_CMDS]; // Number of arguments of each appended command
         int cmd_appended_size = 0;
         int cmd_appended_num_return_vals = 0;
-        std::string cmd_appended_str; 
+        int cmd_appended_args[APPENDED_ARGS_LEN]; // Arguments of the appended commands, already scaled, stored one after the other
+        int cmd_appended_args_size = 0;
+        int m_appendedEncoded = 0;      // appended commands written in the arena by the last encode, the others are carried over
+        int m_appendedArgsEncoded = 0;  // their arguments
 
         int cmd_send_list[1000];  // the list of all commands to be sent
+        int cmd_send_bytes[1000]; // bytes of each command of cmd_send_list in the request
         int cmd_send_list_size = 0;
         int expected_num_return_vals = 0;
-        int send_counter = 0; // 
-
+        uint64_t send_counter = 0; // number of cycles sent, drives the command scheduler
+        uint16_t send_seq = 0; // sequence number of the last binary frame sent
+        InFlightFrame m_inFlight[PIPELINE_MAX_DEPTH]; // ring of the binary frames waiting for their reply
+        int m_inFlightFirst = 0;
+        int m_inFlightCount = 0;
+        int m_pipelineDepth = 1;
+        PipelineStats m_pipelineStats;
+        std::chrono::steady_clock::time_point m_asciiSendTime; // write time of the last Ascii request
+        CommandStats m_commandStats[RESULT_SIZEX];
+
+        /// Record the round trip of the commands of a request whose reply of @param replyBytes bytes has just been parsed.
+        void recordReply(const int* cmds, int numCmds, const std::chrono::steady_clock::time_point& sendTime, int replyBytes);
+        /// Count an error for each command of a request without a usable reply.
+        void recordErrors(const int* cmds, int numCmds);
+
+        /// Subscribe to @param cmd every @param every_nth cycles, in a lane chosen from the period: Control if every cycle, Diagnostics if slower than every 1000 cycles, Status otherwise.
         void subscribeTo(int cmd, int every_nth);
-        void parseMessage();
-        void appendCmd(int cmd, const char* args);
+        void subscribeTo(int cmd, int every_nth, CommandLane lane);
+        /// Parse the reply of @param frame into the result table. Returns false if the reply does not match the frame.
+        bool parseFrame(const char* payload, const wire::FrameHeader& header, const InFlightFrame& frame);
+        void parseStreamFrame(const char* payload, const wire::FrameHeader& header);
+        /** Send the stream subscription table to the device and wait for its answer.
+        * @param {int} periodUs: base period, 0 to remove the subscriptions.
+        * @returns {int} the number of subscriptions accepted.
+        */
+        int sendStreamTable(int periodUs);
+        /** Queue @param cmd with its @param num_args arguments, already scaled, to be sent at the next cycle. The commands are sent in the order
+        * they are appended, except the setpoints of the descriptor table (@sa CommandAppend): a setpoint replaces the previous value of the same
+        * command, or of the same command and first argument, still in the queue and is moved to its end, so only the latest value goes on the wire.
+        * If the queue is full the new command is dropped and counted in @sa getAppendQueueStats, the queued ones are kept in order.
+        */
+        void appendCmd(int cmd, const int* args = nullptr, int num_args = 0);
+        /// Request bytes of the commands appended for the next cycle, without the frame header.
+        int getAppendedRequestBytes() const;
+
+        /// Collect the subscribed commands to send this cycle in @param cmds, SCHEDULER_MAX_CMDS long, within the byte budget left by the appended commands encoded
+        /// and the @param arenaBytes left in the output arena.
+        int collectScheduled(WireProtocol protocol, int arenaBytes, const bool* exclude, int* cmds);
+        /// Encode the commands to be sent this cycle in the Ascii format, in place and without allocation. Returns the number of bytes written in @param outgoingData.
+        unsigned int encodeAscii(char* outgoingData);
+        /// Encode the commands to be sent this cycle as one binary request frame. Returns the number of bytes written in @param outgoingData.
+        unsigned int encodeBinary(char* outgoingData);
+
+        OutputArenaStats m_arenaStats;
+        AppendQueueStats m_appendStats;
+        HapticAvatar_ReplyParser m_replyParser; // Parser of the Ascii replies, writing in result_table
+
+        bool stream_active[RESULT_SIZEX] = { false }; // commands pushed by the device, not requested anymore
+        bool m_streaming = false;
+        uint16_t m_streamSeq = 0;
+        StreamStats m_streamStats;
         void updateIfUnsubscribed(int cmd);
 
-        float getFloat(int cmd);
-        float getFloat(int cmd, int channel);
-        sofa::type::fixed_array<float, 3> getFloat3(int cmd);
-        sofa::type::fixed_array<float, 4> getFloat4(int cmd);
-        sofa::type::fixed_array<float, 6> getFloat6(int cmd);
-
-        int getInt(int cmd);
-        int getInt(int cmd, int channel);
-        sofa::type::fixed_array<int, 4> getInt4(int cmd);
-        sofa::type::fixed_array<int, 6> getInt6(int cmd);
+        /** Get the last values of @param cmd, requesting them first if the command is not subscribed to. The number and type of the values
+        * are template parameters taken from the descriptor table of the device, see the get method of each driver: the row is read without
+        * any runtime check, and a caller expecting another arity does not build.
+        * @returns {CommandValue::value_type} a scalar if the command returns one value, a fixed_array otherwise.
+        */
+        template <int NumReturnVals, CommandValueType Type>
+        typename CommandValue<NumReturnVals, Type>::value_type getValues(int cmd)
+        {
+            updateIfUnsubscribed(cmd);
+            return CommandValue<NumReturnVals, Type>::read(result_table[cmd]);
+        }
+
+        /// Same as @sa getValues for the value at @param channel only, 0 if the command does not return that many values.
+        template <int NumReturnVals, CommandValueType Type>
+        typename CommandValue<NumReturnVals, Type>::scalar_type getValue(int cmd, int channel)
+        {
+            updateIfUnsubscribed(cmd);
+            return CommandValue<NumReturnVals, Type>::read(result_table[cmd], channel);
+        }
+
+        /** Get the last values of @param cmd only if they are newer than a previous read, without requesting anything.
+        * @param {CommandValue::value_type} values: receives the values, unchanged if they are not newer.
+        * @param {uint64_t} seq: receive sequence number of the previous read, 0 for none. Set to the one of the values returned.
+        * @returns {bool} true if newer values have been received since @param seq.
+        */
+        template <int NumReturnVals, CommandValueType Type>
+        bool getValuesIfNewer(int cmd, typename CommandValue<NumReturnVals, Type>::value_type& values, uint64_t& seq) const
+        {
+            if (result_stamp[cmd].seq <= seq)
+                return false;
+            values = CommandValue<NumReturnVals, Type>::read(result_table[cmd]);
+            seq = result_stamp[cmd].seq;
+            return true;
+        }
 
         void appendIntFloat(int cmd, int chan, float value);
         void appendIntFloat(int cmd, int chan, float value1, float value2);
@@ -156,20 +482,49 @@ namespace sofa::HapticAvatar
         void appendFloat(int cmd, sofa::type::fixed_array<float, 6> values);
 
 
-        virtual void setupNumReturnVals() = 0;
+        /** Take the names, number of return values and scale factors of the commands of the device from its descriptor table.
+        * @param {CommandDescriptor[N]} table: descriptors indexed by the command enum of the device, with static storage.
+        */
+        template <unsigned int N>
+        void setupCommandTable(const CommandDescriptor (&table)[N])
+        {
+            static_assert(N <= RESULT_SIZEX, "More commands than rows in the result table");
+            command_table = table;
+            device_num_cmds = (int)N;
+            for (unsigned int i = 0; i < N; i++)
+            {
+                num_return_vals[i] = table[i].numReturnVals;
+                scale_factor[i] = table[i].scale;
+            }
+        }
+
         virtual void setupCmdLists() = 0;
 
+        /** Append the commands of the background transfers of the device, e.g. an upload of collision primitives, to the frame of this cycle.
+        * Called before each frame is assembled, does nothing by default.
+        * @param {int} requestBytes: request bytes the appended commands leave of the budget of the cycle, or of the output arena if there is no budget. May be negative.
+        * @param {int} arenaBytes: request bytes the appended commands leave of the output arena, whatever the budget. May be negative.
+        */
+        virtual void appendBackground(int requestBytes, int arenaBytes) { (void)requestBytes; (void)arenaBytes; }
+
     private:
 
         //Connection status
         bool m_connected;
 
-        //Serial comm handler
-        HANDLE m_hSerial;
-        //Get various information about the connection
-        COMSTAT m_status;
-        //Keep track of last error
-        DWORD m_errors;
+        // Wire format currently used with the device
+        WireProtocol m_wireProtocol;
+
+        // Time to wait for a reply, in microseconds
+        int m_receiveTimeoutUs;
+        // Number of Ascii replies that timed out and may still arrive
+        int m_staleReplies;
+        uint64_t m_receiveTimeouts;
+        uint64_t m_receiveErrors;
+        uint64_t m_malformedReplies;
+
+        //Serial transport, owned by the driver
+        HapticAvatar_Transport* m_transport;
 
         // String name of the port (ex: COM3)
         std::string m_portName;
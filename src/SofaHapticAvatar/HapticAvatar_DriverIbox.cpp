@@ -26,83 +26,19 @@
 namespace sofa::HapticAvatar
 {
 
-
     ///////////////////////////////////////////////////////////////
     /////       Methods for specific IBOX communication       /////
     ///////////////////////////////////////////////////////////////
 
-    HapticAvatar_DriverIbox::HapticAvatar_DriverIbox(const std::string& portName)
-        : HapticAvatar_DriverBase(portName)
+    HapticAvatar_DriverIbox::HapticAvatar_DriverIbox(const std::string& portName, HapticAvatar_Transport* transport)
+        : HapticAvatar_DriverBase(portName, transport)
     {
-        setupNumReturnVals();  // needs to be implemented in each device driver
+        setupCommandTable(commandDescriptors);
         setupCmdLists();   // needs to be implemented in each device driver
 
         device_type = 2;
     }
 
-    void HapticAvatar_DriverIbox::setupNumReturnVals()
-    {
-        // num_return_vals = new int[CmdIBox::ALWAYS_LAST];
-
-        num_return_vals[(int)CmdIBox::RESET] = 1;
-        num_return_vals[(int)CmdIBox::GET_DEVICE_TYPE] = 1;
-        num_return_vals[(int)CmdIBox::GET_OPENING_VALUES] = IBOX_NUM_CHANNELS;
-        num_return_vals[(int)CmdIBox::GET_HANDLE_IDS] = IBOX_NUM_CHANNELS;
-        num_return_vals[(int)CmdIBox::GET_PEDAL_STATES] = 2;
-        num_return_vals[(int)CmdIBox::SET_ALL_FORCES] = 0;
-        num_return_vals[(int)CmdIBox::SET_CHAN_FORCE] = 0;
-        num_return_vals[(int)CmdIBox::GET_STATUS] = 1;
-        num_return_vals[(int)CmdIBox::GET_CALIBRATION_STATUS] = IBOX_NUM_CHANNELS;
-        num_return_vals[(int)CmdIBox::GET_MOTOR_BOARD_STATUS] = IBOX_NUM_CHANNELS;
-        num_return_vals[(int)CmdIBox::GET_BATTERY_VOLTAGE] = 1;
-        num_return_vals[(int)CmdIBox::GET_BOARD_TEMP] = 1;
-        num_return_vals[(int)CmdIBox::SET_MANUAL_PWM] = 0;
-        num_return_vals[(int)CmdIBox::SET_POWER_ON_MANUAL] = 0;
-        num_return_vals[(int)CmdIBox::SET_FAN_ON_MANUAL] = 0;
-        num_return_vals[(int)CmdIBox::GET_LAST_PWM] = IBOX_NUM_CHANNELS;
-        num_return_vals[(int)CmdIBox::SET_FF_ENABLE] = 0;
-        num_return_vals[(int)CmdIBox::GET_CURRENT_DELTA_T] = 1;
-        num_return_vals[(int)CmdIBox::SET_LOOP_GAIN] = 0;
-        num_return_vals[(int)CmdIBox::GET_OPTO_FORCES] = IBOX_NUM_CHANNELS;
-        num_return_vals[(int)CmdIBox::SET_ZERO_FORCE] = 0;
-        num_return_vals[(int)CmdIBox::GET_POS_VOLTAGES] = IBOX_NUM_CHANNELS;
-        num_return_vals[(int)CmdIBox::GET_HANDLE_IDS_REAL] = IBOX_NUM_CHANNELS;
-        num_return_vals[(int)CmdIBox::GET_BUILD_DATE] = 1;
-        num_return_vals[(int)CmdIBox::GET_SERIAL_NUM] = 1;
-        num_return_vals[(int)CmdIBox::SET_CHARGE_ENABLE] = 0;
-        num_return_vals[(int)CmdIBox::SET_HANDLE_LED] = 0;
-        num_return_vals[(int)CmdIBox::GET_OPTO_VOLTAGES] = IBOX_NUM_CHANNELS;
-        num_return_vals[(int)CmdIBox::SET_TO_CALIBRATE] = 0;
-        num_return_vals[(int)CmdIBox::GET_PART_TEMPERATURES] = 11;
-        num_return_vals[(int)CmdIBox::SET_MAX_USB_CHARGE_CURRENT] = 0;
-        num_return_vals[(int)CmdIBox::GET_USB_CHARGING_CURRENT] = 1;
-        num_return_vals[(int)CmdIBox::GET_CONNECTION_STATES] = 1;
-        num_return_vals[(int)CmdIBox::GET_HANDLES_ACTIVITY] = 1;
-        num_return_vals[(int)CmdIBox::SET_FORCE_OFFSET] = 0;
-
-        // Set all scale factor to 1.0 to begin with ...
-        for (int i = 0; i < (int)CmdIBox::ALWAYS_LAST; i++)
-            scale_factor[i] = 1.0f;
-        // ... and now change those who are not 1.0
-        scale_factor[(int)CmdIBox::GET_OPENING_VALUES] = 10000.0f;
-        scale_factor[(int)CmdIBox::GET_HANDLE_IDS] = 10000.0f;
-        scale_factor[(int)CmdIBox::SET_ALL_FORCES] = 10000.0f;
-        scale_factor[(int)CmdIBox::SET_CHAN_FORCE] = 10000.0f;
-        scale_factor[(int)CmdIBox::GET_BATTERY_VOLTAGE] = 10000.0f;
-        scale_factor[(int)CmdIBox::GET_BOARD_TEMP] = 10000.0f;
-        scale_factor[(int)CmdIBox::GET_CURRENT_DELTA_T] = 10000.0f;
-        scale_factor[(int)CmdIBox::SET_LOOP_GAIN] = 10000.0f;
-        scale_factor[(int)CmdIBox::GET_OPTO_FORCES] = 10000.0f;;
-        scale_factor[(int)CmdIBox::GET_POS_VOLTAGES] = 10000.0f;
-        scale_factor[(int)CmdIBox::GET_HANDLE_IDS_REAL] = 10000.0f;
-        scale_factor[(int)CmdIBox::GET_OPTO_VOLTAGES] = 10000.0f;
-        scale_factor[(int)CmdIBox::SET_MAX_USB_CHARGE_CURRENT] = 10000.0f;
-        scale_factor[(int)CmdIBox::SET_FORCE_OFFSET] = 10000.0f;
-
-        device_num_cmds = (int)CmdIBox::ALWAYS_LAST;
-    }
-
-
     void HapticAvatar_DriverIbox::setupCmdLists()
     {
         // Setup the data you want to subscribe to from the port device here. Subscription commands can only be of type GET_... without input arguments.
@@ -123,7 +59,7 @@ namespace sofa::HapticAvatar
 
     float HapticAvatar_DriverIbox::getOpeningValue(int toolId)
     {
-        return getFloat((int)CmdIBox::GET_OPENING_VALUES, convertToolIdToChannel(toolId));
+        return get<CmdIBox::GET_OPENING_VALUES>(convertToolIdToChannel(toolId));
     }
     void HapticAvatar_DriverIbox::setForce(int toolId, float force)
     {
@@ -131,23 +67,23 @@ namespace sofa::HapticAvatar
     }
     int HapticAvatar_DriverIbox::getStatus()
     {
-        return getInt((int)CmdIBox::GET_STATUS);
+        return get<CmdIBox::GET_STATUS>();
     }
     int HapticAvatar_DriverIbox::getCalibrationStatus(int toolId)
     {
-        return getInt((int)CmdIBox::GET_CALIBRATION_STATUS, convertToolIdToChannel(toolId));
+        return get<CmdIBox::GET_CALIBRATION_STATUS>(convertToolIdToChannel(toolId));
     }
     float HapticAvatar_DriverIbox::getBatteryVoltage()
     {
-        return getFloat((int)CmdIBox::GET_BATTERY_VOLTAGE);
+        return get<CmdIBox::GET_BATTERY_VOLTAGE>();
     }
     float HapticAvatar_DriverIbox::getBoardTemp()
     {
-        return getFloat((int)CmdIBox::GET_BOARD_TEMP);
+        return get<CmdIBox::GET_BOARD_TEMP>();
     }
     int HapticAvatar_DriverIbox::getLastPWM(int toolId)
     {
-        return getInt((int)CmdIBox::GET_LAST_PWM, convertToolIdToChannel(toolId));
+        return get<CmdIBox::GET_LAST_PWM>(convertToolIdToChannel(toolId));
     }
     void HapticAvatar_DriverIbox::setForceFeedbackEnable(bool on)
     {
@@ -155,7 +91,7 @@ namespace sofa::HapticAvatar
     }
     float HapticAvatar_DriverIbox::getCurrentDeltaT()
     {
-        return getFloat((int)CmdIBox::GET_CURRENT_DELTA_T);
+        return get<CmdIBox::GET_CURRENT_DELTA_T>();
     }
     void HapticAvatar_DriverIbox::setLoopGain(int chan, float loopGainP, float loopGainD)
     {
@@ -163,7 +99,7 @@ namespace sofa::HapticAvatar
     }
     float HapticAvatar_DriverIbox::getSensedForce(int toolId)
     {
-        return getFloat((int)CmdIBox::GET_OPTO_FORCES, convertToolIdToChannel(toolId));
+        return get<CmdIBox::GET_OPTO_FORCES>(convertToolIdToChannel(toolId));
     }
     void HapticAvatar_DriverIbox::setZeroForce(int toolId)
     {
@@ -171,19 +107,19 @@ namespace sofa::HapticAvatar
     }
     float HapticAvatar_DriverIbox::getPosVoltage(int toolId)
     {
-        return getFloat((int)CmdIBox::SET_ZERO_FORCE, convertToolIdToChannel(toolId));
+        return get<CmdIBox::GET_POS_VOLTAGES>(convertToolIdToChannel(toolId));
     }
     int HapticAvatar_DriverIbox::getSerialNumber()
     {
-        return getInt((int)CmdIBox::GET_SERIAL_NUM);
+        return get<CmdIBox::GET_SERIAL_NUM>();
     }
     float HapticAvatar_DriverIbox::getChargingCurrent()
     {
-        return getFloat((int)CmdIBox::GET_USB_CHARGING_CURRENT);
+        return get<CmdIBox::GET_USB_CHARGING_CURRENT>();
     }
     float HapticAvatar_DriverIbox::getPartTemperature(int part)
     {
-        return getFloat((int)CmdIBox::GET_PART_TEMPERATURES, int(part));
+        return get<CmdIBox::GET_PART_TEMPERATURES>(int(part));
     }
 
 
@@ -37,7 +37,7 @@ namespace sofa::HapticAvatar
     class SOFA_HAPTICAVATAR_API HapticAvatar_DriverIbox : public HapticAvatar_DriverBase
     {
     public:
-        HapticAvatar_DriverIbox(const std::string& portName);
+        HapticAvatar_DriverIbox(const std::string& portName, HapticAvatar_Transport* transport = nullptr);
 
         // Functions that are typically used at initialization, see also the base class
         // ------------------------------------------------------------------
@@ -95,7 +95,6 @@ namespace sofa::HapticAvatar
         int getStatusCommandId() override { return CmdIBox::GET_IBOX_STATUS; }
         */
 
-        void setupNumReturnVals() override;
         void setupCmdLists() override;
 
     private:
@@ -139,6 +138,56 @@ namespace sofa::HapticAvatar
             ALWAYS_LAST
         };
 
+        // Description of each command, in the order of the enum: name, number of return values, scale factor, type of the values and,
+        // for the setpoints, how the appended commands are coalesced.
+        // The result table, the parser and the typed getters of the driver are set up from it.
+        static constexpr CommandDescriptor commandDescriptors[ALWAYS_LAST] = {
+            { "RESET",                      1,                 1.0f,     CommandValueType::Int },
+            { "GET_DEVICE_TYPE",            1,                 1.0f,     CommandValueType::Int },
+            { "GET_OPENING_VALUES",         IBOX_NUM_CHANNELS, 10000.0f, CommandValueType::Float },
+            { "GET_HANDLE_IDS",             IBOX_NUM_CHANNELS, 10000.0f, CommandValueType::Float },
+            { "GET_PEDAL_STATES",           2,                 1.0f,     CommandValueType::Int },
+            { "SET_ALL_FORCES",             0,                 10000.0f, CommandValueType::None, CommandAppend::Latest },
+            { "SET_CHAN_FORCE",             0,                 10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "GET_STATUS",                 1,                 1.0f,     CommandValueType::Int },
+            { "GET_CALIBRATION_STATUS",     IBOX_NUM_CHANNELS, 1.0f,     CommandValueType::Int },
+            { "GET_MOTOR_BOARD_STATUS",     IBOX_NUM_CHANNELS, 1.0f,     CommandValueType::Int },
+            { "GET_BATTERY_VOLTAGE",        1,                 10000.0f, CommandValueType::Float },
+            { "GET_BOARD_TEMP",             1,                 10000.0f, CommandValueType::Float },
+            { "SET_MANUAL_PWM",             0,                 1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "SET_POWER_ON_MANUAL",        0,                 1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "SET_FAN_ON_MANUAL",          0,                 1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "GET_LAST_PWM",               IBOX_NUM_CHANNELS, 1.0f,     CommandValueType::Int },
+            { "SET_FF_ENABLE",              0,                 1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "GET_CURRENT_DELTA_T",        1,                 10000.0f, CommandValueType::Float },
+            { "SET_LOOP_GAIN",              0,                 10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "GET_OPTO_FORCES",            IBOX_NUM_CHANNELS, 10000.0f, CommandValueType::Float },
+            { "SET_ZERO_FORCE",             0,                 1.0f,     CommandValueType::None },
+            { "GET_POS_VOLTAGES",           IBOX_NUM_CHANNELS, 10000.0f, CommandValueType::Float },
+            { "GET_HANDLE_IDS_REAL",        IBOX_NUM_CHANNELS, 10000.0f, CommandValueType::Float },
+            { "GET_BUILD_DATE",             1,                 1.0f,     CommandValueType::Int },
+            { "GET_SERIAL_NUM",             1,                 1.0f,     CommandValueType::Int },
+            { "SET_CHARGE_ENABLE",          0,                 1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "SET_HANDLE_LED",             0,                 1.0f,     CommandValueType::None },
+            { "GET_OPTO_VOLTAGES",          IBOX_NUM_CHANNELS, 10000.0f, CommandValueType::Float },
+            { "SET_TO_CALIBRATE",           0,                 1.0f,     CommandValueType::None },
+            { "GET_PART_TEMPERATURES",      11,                1.0f,     CommandValueType::Float },
+            { "SET_MAX_USB_CHARGE_CURRENT", 0,                 10000.0f, CommandValueType::None, CommandAppend::Latest },
+            { "GET_USB_CHARGING_CURRENT",   1,                 1.0f,     CommandValueType::Float },
+            { "GET_CONNECTION_STATES",      1,                 1.0f,     CommandValueType::Int },
+            { "GET_HANDLES_ACTIVITY",       1,                 1.0f,     CommandValueType::Int },
+            { "SET_FORCE_OFFSET",           0,                 10000.0f, CommandValueType::None },
+        };
+        static_assert(isValidCommandTable(commandDescriptors, RESULT_SIZEY), "Incomplete or inconsistent CmdIBox descriptor table");
+
+        /// Last values of command @tparam Cmd, their number and type taken from its descriptor. @sa HapticAvatar_DriverBase::getValues
+        template <CmdIBox Cmd>
+        auto get() { return getValues<commandDescriptors[Cmd].numReturnVals, commandDescriptors[Cmd].type>((int)Cmd); }
+
+        /// Last value at @param channel of command @tparam Cmd. @sa HapticAvatar_DriverBase::getValue
+        template <CmdIBox Cmd>
+        auto get(int channel) { return getValue<commandDescriptors[Cmd].numReturnVals, commandDescriptors[Cmd].type>((int)Cmd, channel); }
+
         enum IboxThermalSimPart {
             MotorWinding0 = 0, MotorWinding1, MotorWinding2, MotorWinding3,
             MotorHousing0, MotorHousing1, MotorHousing2, MotorHousing3,
@@ -22,123 +22,52 @@
 
 #include <SofaHapticAvatar/HapticAvatar_DriverPort.h>
 #include <sofa/helper/logging/Messaging.h>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 
 namespace sofa::HapticAvatar
 {
 
 using namespace HapticAvatar;
 
+namespace
+{
+    /// True if @param value moved away from @param sent by more than @param epsilon and by at least one step of the device.
+    bool exceeds(float value, float sent, float epsilon, float scale)
+    {
+        return std::abs(value - sent) > epsilon && int(value * scale) != int(sent * scale);
+    }
+
+    bool exceeds(const sofa::type::fixed_array<float, 3>& value, const sofa::type::fixed_array<float, 3>& sent, float epsilon, float scale)
+    {
+        float dist2 = 0.0f;
+        bool step = false;
+        for (int i = 0; i < 3; i++) {
+            dist2 += (value[i] - sent[i]) * (value[i] - sent[i]);
+            step = step || int(value[i] * scale) != int(sent[i] * scale);
+        }
+        return step && dist2 > epsilon * epsilon;
+    }
+}
 
 ///////////////////////////////////////////////////////////////
 /////      Methods for specific device communication      /////
 ///////////////////////////////////////////////////////////////
 
-HapticAvatar_DriverPort::HapticAvatar_DriverPort(const std::string& portName)
-    : HapticAvatar_DriverBase(portName)
+HapticAvatar_DriverPort::HapticAvatar_DriverPort(const std::string& portName, HapticAvatar_Transport* transport)
+    : HapticAvatar_DriverBase(portName, transport)
 {
-    setupNumReturnVals();  // needs to be implemented in each device driver
+    setupCommandTable(commandDescriptors);
     setupCmdLists();   // needs to be implemented in each device driver
 
-    device_type = 1;
+    // the lowest index is allocated first
+    m_numFreePrimitives = MAX_NUM_PRIMITIVES;
+    for (int i = 0; i < MAX_NUM_PRIMITIVES; i++)
+        m_freePrimitives[i] = MAX_NUM_PRIMITIVES - 1 - i;
 
-}
+    device_type = 1;
 
-void HapticAvatar_DriverPort::setupNumReturnVals()
-{
-    // num_return_vals = new int[CmdPort::ALWAYS_LAST];
-
-    num_return_vals[(int)CmdPort::RESET] = 1;
-    num_return_vals[(int)CmdPort::GET_DEVICE_TYPE] = 1;
-    num_return_vals[(int)CmdPort::GET_ANGLES_AND_LENGTH] = 4;
-    num_return_vals[(int)CmdPort::GET_TOOL_ID] = 1;
-    num_return_vals[(int)CmdPort::GET_CURRENT_DELTA_T] = 1;
-    num_return_vals[(int)CmdPort::GET_STATUS] = 1;
-    num_return_vals[(int)CmdPort::SET_MOTOR_FORCE_AND_TORQUES] = 0;
-    num_return_vals[(int)CmdPort::SET_TIP_FORCE_AND_ROT_TORQUE] = 0;
-    num_return_vals[(int)CmdPort::SET_YAW_PITCH_ZERO_ANG] = 0;
-    num_return_vals[(int)CmdPort::SET_LED_BLINK_MODE] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT_ACTIVE] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT_P0] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT_V0] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT_N] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT_Q] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT_R] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT_S] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT_T] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT_STIFFNESS] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT_DAMPING] = 0;
-    num_return_vals[(int)CmdPort::SET_COLLISION_OBJECT_FRICTION] = 0;
-    num_return_vals[(int)CmdPort::GET_LAST_COLLISION_FORCE] = 3;
-    num_return_vals[(int)CmdPort::GET_LAST_PWM] = 4;
-    num_return_vals[(int)CmdPort::GET_LAST_COLLISION_DATA] = 1;
-    num_return_vals[(int)CmdPort::SET_TOOL_JAW_OPENING_ANGLE] = 0;
-    num_return_vals[(int)CmdPort::GET_TOOL_JAW_TORQUE] = 1;
-    num_return_vals[(int)CmdPort::SET_TOOL_DATA] = 0;
-    num_return_vals[(int)CmdPort::GET_TOOL_INSERTED] = 1;
-    num_return_vals[(int)CmdPort::GET_TOOL_TIP_VELOCITY] = 3;
-    num_return_vals[(int)CmdPort::GET_TOOL_TIP_POSITION] = 3;
-    num_return_vals[(int)CmdPort::GET_TOOL_DIRECTION] = 3;
-    num_return_vals[(int)CmdPort::GET_RAW_ENCODER_VALUES] = 4;
-    num_return_vals[(int)CmdPort::GET_ENCODER_SCALING_VALUES] = 4;
-    num_return_vals[(int)CmdPort::GET_MOTOR_SCALING_VALUES] = 4;
-    num_return_vals[(int)CmdPort::SET_MANUAL_PWM] = 0;
-    num_return_vals[(int)CmdPort::GET_BOARD_TEMP] = 1;
-    num_return_vals[(int)CmdPort::GET_BATTERY_VOLTAGE] = 1;
-    num_return_vals[(int)CmdPort::GET_CALIBRATION_STATUS] = 3;
-    num_return_vals[(int)CmdPort::GET_AMPLIFIERS_STATUS] = 4;
-    num_return_vals[(int)CmdPort::GET_HALL_STATES] = 2;
-    num_return_vals[(int)CmdPort::SET_POWER_ON_MANUAL] = 0;
-    num_return_vals[(int)CmdPort::SET_FAN_ON_MANUAL] = 0;
-    num_return_vals[(int)CmdPort::SET_FF_ENABLE] = 0;
-    num_return_vals[(int)CmdPort::GET_SERIAL_NUM] = 1;
-    num_return_vals[(int)CmdPort::GET_BUILD_DATE] = 1;
-    num_return_vals[(int)CmdPort::SET_CHARGE_ENABLE] = 0;
-    num_return_vals[(int)CmdPort::GET_TIP_LENGTH] = 1;
-    num_return_vals[(int)CmdPort::GET_PART_TEMPERATURES] = 12;
-    num_return_vals[(int)CmdPort::SET_MAX_USB_CHARGE_CURRENT] = 0;
-    num_return_vals[(int)CmdPort::GET_USB_CHARGING_CURRENT] = 1;
-    num_return_vals[(int)CmdPort::SET_DEADBAND_PWM_WIDTH] = 1;
-
-    // Set all scale factor to 1.0 to begin with ...
-    for (int i = 0; i < (int)CmdPort::ALWAYS_LAST; i++)
-        scale_factor[i] = 1.0f;
-
-    // ... and now change those who are not 1.0
-    scale_factor[(int)CmdPort::GET_ANGLES_AND_LENGTH] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_CURRENT_DELTA_T] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_MOTOR_FORCE_AND_TORQUES] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_TIP_FORCE_AND_ROT_TORQUE] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_YAW_PITCH_ZERO_ANG] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_COLLISION_OBJECT] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_COLLISION_OBJECT_P0] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_COLLISION_OBJECT_V0] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_COLLISION_OBJECT_N] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_COLLISION_OBJECT_Q] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_COLLISION_OBJECT_R] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_COLLISION_OBJECT_S] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_COLLISION_OBJECT_T] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_COLLISION_OBJECT_STIFFNESS] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_COLLISION_OBJECT_DAMPING] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_COLLISION_OBJECT_FRICTION] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_LAST_COLLISION_FORCE] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_LAST_COLLISION_DATA] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_TOOL_JAW_OPENING_ANGLE] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_TOOL_JAW_TORQUE] = 10000.0f;
-    scale_factor[(int)CmdPort::SET_TOOL_DATA] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_TOOL_TIP_VELOCITY] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_TOOL_TIP_POSITION] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_TOOL_DIRECTION] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_ENCODER_SCALING_VALUES] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_MOTOR_SCALING_VALUES] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_BOARD_TEMP] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_BATTERY_VOLTAGE] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_AMPLIFIERS_STATUS] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_TIP_LENGTH] = 10000.0f;
-    scale_factor[(int)CmdPort::GET_PART_TEMPERATURES] = 10.0f;
-    scale_factor[(int)CmdPort::GET_USB_CHARGING_CURRENT] = 10000.0f;
-
-    device_num_cmds = (int)CmdPort::ALWAYS_LAST;
 }
 
 void HapticAvatar_DriverPort::setupCmdLists()
@@ -161,42 +90,52 @@ void HapticAvatar_DriverPort::setupCmdLists()
 
 sofa::type::fixed_array<float, 4> HapticAvatar_DriverPort::getAnglesAndLength()
 {
-    return getFloat4((int)CmdPort::GET_ANGLES_AND_LENGTH);
+    return get<CmdPort::GET_ANGLES_AND_LENGTH>();
+}
+
+bool HapticAvatar_DriverPort::getAnglesAndLengthIfNewer(sofa::type::fixed_array<float, 4>& anglesAndLength, uint64_t& seq) const
+{
+    return getIfNewer<CmdPort::GET_ANGLES_AND_LENGTH>(anglesAndLength, seq);
+}
+
+std::chrono::steady_clock::time_point HapticAvatar_DriverPort::getAnglesAndLengthTime() const
+{
+    return getCommandTime((int)CmdPort::GET_ANGLES_AND_LENGTH);
 }
 
 sofa::type::fixed_array<float, 4> HapticAvatar_DriverPort::getLastPWM()
 {
-    return getFloat4((int)CmdPort::GET_LAST_PWM);
+    return get<CmdPort::GET_LAST_PWM>();
 }
 
 int HapticAvatar_DriverPort::getToolID()
 {
-    return getInt((int)CmdPort::GET_TOOL_ID);
+    return get<CmdPort::GET_TOOL_ID>();
 }
 
 bool HapticAvatar_DriverPort::getToolInserted()
 {
-    return (bool) getInt((int)CmdPort::GET_TOOL_INSERTED);
+    return (bool) get<CmdPort::GET_TOOL_INSERTED>();
 }
 
 float HapticAvatar_DriverPort::getBoardTemp() 
 { 
-    return getFloat((int)CmdPort::GET_BOARD_TEMP); 
+    return get<CmdPort::GET_BOARD_TEMP>(); 
 }
 
 float HapticAvatar_DriverPort::getBatteryVoltage()
 {
-    return getFloat((int)CmdPort::GET_BATTERY_VOLTAGE);
+    return get<CmdPort::GET_BATTERY_VOLTAGE>();
 }
 
 sofa::type::fixed_array<int, 4> HapticAvatar_DriverPort::getRawEncoderValues()
 {
-    return getInt4((int)CmdPort::GET_RAW_ENCODER_VALUES);
+    return get<CmdPort::GET_RAW_ENCODER_VALUES>();
 }
 
 sofa::type::fixed_array<float, 4> HapticAvatar_DriverPort::getEncoderScalingValues()
 {
-    return getFloat4((int)CmdPort::GET_ENCODER_SCALING_VALUES);
+    return get<CmdPort::GET_ENCODER_SCALING_VALUES>();
 }
 
 
@@ -207,12 +146,12 @@ bool HapticAvatar_DriverPort::getYawPitchCalibrated()
 
 sofa::type::fixed_array<float, 4> HapticAvatar_DriverPort::getMotorScalingValues()
 {
-    return getFloat4((int)CmdPort::GET_MOTOR_SCALING_VALUES);
+    return get<CmdPort::GET_MOTOR_SCALING_VALUES>();
 }
 
 int HapticAvatar_DriverPort::getStatus()
 {
-    return getInt((int)CmdPort::GET_STATUS);
+    return get<CmdPort::GET_STATUS>();
 }
 
 void HapticAvatar_DriverPort::setMotorForceAndTorques(float rot, float pitch, float z, float yaw)
@@ -237,7 +176,7 @@ void HapticAvatar_DriverPort::setForceFeedbackEnable(bool on)
 
 float  HapticAvatar_DriverPort::getCurrentDeltaT()
 {
-    return getFloat((int)CmdPort::GET_CURRENT_DELTA_T);
+    return get<CmdPort::GET_CURRENT_DELTA_T>();
 }
 
 int cptF = 0;
@@ -258,18 +197,40 @@ void HapticAvatar_DriverPort::setManualPWM(int rot, int pitch, int z, int yaw)
 
 int HapticAvatar_DriverPort::getSerialNumber()
 {
-    return getInt((int)CmdPort::GET_SERIAL_NUM);
+    return get<CmdPort::GET_SERIAL_NUM>();
 }
 float HapticAvatar_DriverPort::getPartTemperature(int part)
 {
-    return getFloat((int)CmdPort::GET_PART_TEMPERATURES, part);
+    return get<CmdPort::GET_PART_TEMPERATURES>(part);
 }
 
 float HapticAvatar_DriverPort::getChargingCurrent()
 {
-    return getFloat((int)CmdPort::GET_USB_CHARGING_CURRENT);
+    return get<CmdPort::GET_USB_CHARGING_CURRENT>();
+}
+
+bool HapticAvatar_DriverPort::sampleHealth(HealthSample& sample) const
+{
+    // the low rate diagnostics arrive long after the subscription, the rows are only meaningful once received
+    auto received = [this](CmdPort cmd) { return isSubscribed((int)cmd) && getCommandSequence((int)cmd) > 0; };
+    if (!received(CmdPort::GET_STATUS))
+        return false;
+
+    const float unknown = std::numeric_limits<float>::quiet_NaN();
+    sample.status = (unsigned int)result_table[(int)CmdPort::GET_STATUS][0];
+    sample.boardTemperature = received(CmdPort::GET_BOARD_TEMP) ? result_table[(int)CmdPort::GET_BOARD_TEMP][0] : unknown;
+    sample.batteryVoltage = received(CmdPort::GET_BATTERY_VOLTAGE) ? result_table[(int)CmdPort::GET_BATTERY_VOLTAGE][0] : unknown;
+    sample.chargingCurrent = received(CmdPort::GET_USB_CHARGING_CURRENT) ? result_table[(int)CmdPort::GET_USB_CHARGING_CURRENT][0] : unknown;
+
+    const bool temperatures = received(CmdPort::GET_PART_TEMPERATURES);
+    const int parts[4] = { YMotorWinding, PMotorWinding, ZMotorWinding, RMotorWinding };
+    for (int i = 0; i < 4; i++)
+        sample.motorTemperatures[i] = temperatures ? result_table[(int)CmdPort::GET_PART_TEMPERATURES][parts[i]] : unknown;
+
+    return true;
 }
 
+
 void HapticAvatar_DriverPort::printStatus()
 {
     std::cout << "Status for Port device S/N " << getSerialNumber() << " at " << getPortName() << std::endl;
@@ -338,151 +299,652 @@ void HapticAvatar_DriverPort::setJawOpeningAngle(float ang)
 }
 float HapticAvatar_DriverPort::getJawTorque()
 {
-    return getFloat((int)CmdPort::GET_TOOL_JAW_TORQUE);
+    return get<CmdPort::GET_TOOL_JAW_TORQUE>();
 }
 
 int HapticAvatar_DriverPort::reserveNextPrimitiveIndex()
 {
-    int retval = -1;
-    for (int i = 0; i < MAX_NUM_PRIMITIVES; i++)
-    {
-        if (!primitive_index_used[i]) {
-            primitive_index_used[i] = true;
-            retval = i;
-            break;
-        }
-    }
-    return retval;
+    if (m_numFreePrimitives == 0)
+        return -1;
+
+    return m_freePrimitives[--m_numFreePrimitives];
 }
-int HapticAvatar_DriverPort::addSphere(sofa::type::fixed_array<float, 3> pos, float radius, float stiffness, float damping, float friction)
+
+void HapticAvatar_DriverPort::releasePrimitiveIndex(int index)
 {
-    int index = reserveNextPrimitiveIndex();
-    if (index >= 0) {
-        sofa::type::fixed_array<float, 3> v0 = { 1, 0, 0 };
-        sofa::type::fixed_array<float, 3> n = { 0, 0, 1 };
-        appendPrimitive(index, (int)CoType::CO_SPHERE, true, pos, v0, n, 0, radius, 0, 0, stiffness, friction, damping);
-    }
+    PrimitiveHandle& handle = m_primitiveHandles[index];
+    handle.used = false;
+    handle.staged = false;
+    handle.generation++;
+    m_freePrimitives[m_numFreePrimitives++] = index;
+}
+
+int HapticAvatar_DriverPort::getPrimitiveIndex(int handle) const
+{
+    if (handle < 0)
+        return -1;
+
+    const int index = handle & PRIMITIVE_HANDLE_INDEX_MASK;
+    if (index >= MAX_NUM_PRIMITIVES || !m_primitiveHandles[index].used)
+        return -1;
+
+    const unsigned int generation = (unsigned int)handle >> PRIMITIVE_HANDLE_INDEX_BITS;
+    if (generation != (m_primitiveHandles[index].generation & PRIMITIVE_HANDLE_GENERATION_MASK))
+        return -1;
+
     return index;
 }
 
-int HapticAvatar_DriverPort::addCapsule(sofa::type::fixed_array<float, 3> pos, sofa::type::fixed_array<float, 3> ori, float radius, float length, float stiffness, float damping, float friction)
+bool HapticAvatar_DriverPort::isPrimitiveValid(int handle) const
+{
+    return getPrimitiveIndex(handle) >= 0;
+}
+
+bool HapticAvatar_DriverPort::pushPrimitiveOp(const PrimitiveOp& op)
+{
+    if (m_primitiveOps.push(op))
+        return true;
+
+    // only the first one is logged, the caller may be in a loop
+    if (m_primitiveOps.getDropped() == 1)
+        msg_error("HapticAvatar_DriverPort") << "Collision primitive operation queue full, operation dropped.";
+    return false;
+}
+
+int HapticAvatar_DriverPort::addPrimitive(const Primitive& prim)
 {
     int index = reserveNextPrimitiveIndex();
-    if (index >= 0) {
-        sofa::type::fixed_array<float, 3> n = { 0, 0, 1 };
-        appendPrimitive(index, (int)CoType::CO_CYLINDER, true, pos, ori, n, 0, radius, length, 0, stiffness, friction, damping);
+    if (index < 0)
+        return -1;
+
+    PrimitiveOp op;
+    op.type = PrimitiveOpType::Add;
+    op.index = index;
+    op.prim = prim;
+    op.prim.state = m_batchOpen ? PrimitiveState::Staged : PrimitiveState::Live;
+    if (!pushPrimitiveOp(op)) {
+        // never used, the handles to it are still valid
+        m_freePrimitives[m_numFreePrimitives++] = index;
+        return -1;
     }
-    return index;
+
+    PrimitiveHandle& handle = m_primitiveHandles[index];
+    handle.used = true;
+    handle.staged = m_batchOpen;
+    if (m_batchOpen)
+        m_numBatchPrimitives++;
+
+    return index | (int)((handle.generation & PRIMITIVE_HANDLE_GENERATION_MASK) << PRIMITIVE_HANDLE_INDEX_BITS);
+}
+
+int HapticAvatar_DriverPort::addSphere(sofa::type::fixed_array<float, 3> pos, float radius, float stiffness, float damping, float friction)
+{
+    Primitive prim;
+    prim.type = (int)CoType::CO_SPHERE;
+    prim.active = true;
+    prim.p0 = pos;
+    prim.v0 = { 1, 0, 0 };
+    prim.n = { 0, 0, 1 };
+    prim.r = radius;
+    prim.stiffness = stiffness;
+    prim.friction = friction;
+    prim.damping = damping;
+    return addPrimitive(prim);
+}
+
+int HapticAvatar_DriverPort::addCapsule(sofa::type::fixed_array<float, 3> pos, sofa::type::fixed_array<float, 3> ori, float radius, float length, float stiffness, float damping, float friction)
+{
+    Primitive prim;
+    prim.type = (int)CoType::CO_CYLINDER;
+    prim.active = true;
+    prim.p0 = pos;
+    prim.v0 = ori;
+    prim.n = { 0, 0, 1 };
+    prim.r = radius;
+    prim.s = length;
+    prim.stiffness = stiffness;
+    prim.friction = friction;
+    prim.damping = damping;
+    return addPrimitive(prim);
 }
 
 int HapticAvatar_DriverPort::addTorus(sofa::type::fixed_array<float, 3> pos, sofa::type::fixed_array<float, 3> ori, float major_radius, float minor_radius, float stiffness, float damping, float friction)
 {
-    int index = reserveNextPrimitiveIndex();
-    if (index >= 0) {
-        sofa::type::fixed_array<float, 3> n = { 0, 0, 1 };
-        appendPrimitive(index, (int)CoType::CO_CYLINDER, true, pos, ori, n, 0, major_radius, minor_radius, 0, stiffness, friction, damping);
-    }
-    return index;
+    Primitive prim;
+    prim.type = (int)CoType::CO_CYLINDER;
+    prim.active = true;
+    prim.p0 = pos;
+    prim.v0 = ori;
+    prim.n = { 0, 0, 1 };
+    prim.r = major_radius;
+    prim.s = minor_radius;
+    prim.stiffness = stiffness;
+    prim.friction = friction;
+    prim.damping = damping;
+    return addPrimitive(prim);
 }
 
-void HapticAvatar_DriverPort::deletePrimitive(int index)
+void HapticAvatar_DriverPort::deletePrimitive(int handle)
 {
-    if (index >= 0 && index < MAX_NUM_PRIMITIVES) {
-        appendInt((CmdPort::SET_COLLISION_OBJECT_ACTIVE), index, 0);
-        primitive_index_used[index] = false;
-    }
+    int index = getPrimitiveIndex(handle);
+    if (index < 0)
+        return;
+
+    PrimitiveOp op;
+    op.type = PrimitiveOpType::Delete;
+    op.index = index;
+    if (!pushPrimitiveOp(op))
+        return;
+
+    // the index can be reused at once, its next addition is queued after the deletion
+    if (m_primitiveHandles[index].staged)
+        m_numBatchPrimitives--;
+    releasePrimitiveIndex(index);
 }
+
 void HapticAvatar_DriverPort::deleteAllPrimitives()
 {
-    for (int i = 0; i < MAX_NUM_PRIMITIVES; i++) {
-        deletePrimitive(i);
+    PrimitiveOp op;
+    op.type = PrimitiveOpType::DeleteAll;
+    if (!pushPrimitiveOp(op))
+        return;
+
+    // the lowest index is allocated first
+    m_numFreePrimitives = 0;
+    for (int i = MAX_NUM_PRIMITIVES - 1; i >= 0; i--) {
+        PrimitiveHandle& handle = m_primitiveHandles[i];
+        if (handle.used)
+            handle.generation++;
+        handle.used = false;
+        handle.staged = false;
+        m_freePrimitives[m_numFreePrimitives++] = i;
     }
+    m_numBatchPrimitives = 0;
 }
 
-void HapticAvatar_DriverPort::setActive(int index, bool active)
+void HapticAvatar_DriverPort::beginPrimitiveBatch()
 {
-    if (index >= 0 && index < MAX_NUM_PRIMITIVES) {
-        appendInt((CmdPort::SET_COLLISION_OBJECT_ACTIVE), index, (int) active);
+    m_batchOpen = true;
+}
+
+int HapticAvatar_DriverPort::commitPrimitiveBatch()
+{
+    const int numPrimitives = m_numBatchPrimitives;
+    if (numPrimitives > 0)
+    {
+        PrimitiveOp op;
+        op.type = PrimitiveOpType::Commit;
+        if (!pushPrimitiveOp(op))
+            return 0;
+
+        for (int i = 0; i < MAX_NUM_PRIMITIVES; i++)
+            m_primitiveHandles[i].staged = false;
+    }
+
+    m_batchOpen = false;
+    m_numBatchPrimitives = 0;
+    return numPrimitives;
+}
+
+void HapticAvatar_DriverPort::setPrimitiveThresholds(const PrimitiveThresholds& thresholds)
+{
+    PrimitiveOp op;
+    op.type = PrimitiveOpType::SetThresholds;
+    op.thresholds = thresholds;
+    if (pushPrimitiveOp(op))
+        m_primitiveThresholds = thresholds;
+}
+
+void HapticAvatar_DriverPort::applyPrimitiveOps()
+{
+    PrimitiveOp op;
+    while (m_primitiveOps.pop(op))
+    {
+        switch (op.type)
+        {
+        case PrimitiveOpType::Add:
+            storePrimitive(op.index, op.prim);
+            break;
+        case PrimitiveOpType::Delete:
+            removePrimitive(op.index);
+            break;
+        case PrimitiveOpType::DeleteAll:
+            removeAllPrimitives();
+            break;
+        case PrimitiveOpType::Commit:
+            commitStagedPrimitives();
+            break;
+        case PrimitiveOpType::SetActive:
+            applyActive(op.index, op.prim.active);
+            break;
+        case PrimitiveOpType::SetThresholds:
+            m_deviceThresholds = op.thresholds;
+            break;
+        case PrimitiveOpType::Update:
+            applyProperty(op.index, op.property, op.prim);
+            break;
+        }
     }
 }
-void HapticAvatar_DriverPort::updatePosition(int index, sofa::type::fixed_array<float, 3> new_pos)
+
+void HapticAvatar_DriverPort::storePrimitive(int index, const Primitive& prim)
+{
+    m_primitives[index] = prim;
+    m_primitives[index].changed = false;
+
+    if (prim.state == PrimitiveState::Staged)
+        m_numStaged++;
+    else
+        appendPrimitive(index, prim.active);
+}
+
+void HapticAvatar_DriverPort::releasePrimitive(int index)
 {
-    if (index >= 0 && index < MAX_NUM_PRIMITIVES) {
-        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_P0), index, new_pos);
+    Primitive& prim = m_primitives[index];
+    if (prim.changed) {
+        prim.changed = false;
+        m_numChangedPrimitives--;
     }
+    prim.state = PrimitiveState::Free;
 }
-void HapticAvatar_DriverPort::updateOrientation(int index, sofa::type::fixed_array<float, 3> new_ori)
+
+void HapticAvatar_DriverPort::removePrimitive(int index)
 {
-    if (index >= 0 && index < MAX_NUM_PRIMITIVES) {
-        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_V0), index, new_ori);
+    switch (m_primitives[index].state)
+    {
+    case PrimitiveState::Free:
+        return;
+    case PrimitiveState::Staged:
+        m_numStaged--;
+        break;
+    case PrimitiveState::Pending:
+        // never sent, only leaves the upload
+        m_numPending--;
+        m_batchStatus.numPrimitives--;
+        publishBatchStatus();
+        break;
+    case PrimitiveState::Uploaded:
+        m_numUploaded--;
+        m_batchStatus.numPrimitives--;
+        m_batchStatus.numUploaded--;
+        publishBatchStatus();
+        appendInt((CmdPort::SET_COLLISION_OBJECT_ACTIVE), index, 0);
+        break;
+    default:
+        appendInt((CmdPort::SET_COLLISION_OBJECT_ACTIVE), index, 0);
+        break;
     }
+
+    releasePrimitive(index);
 }
-void HapticAvatar_DriverPort::updateRadius1(int index, float radius)
+
+void HapticAvatar_DriverPort::removeAllPrimitives()
 {
-    if (index >= 0 && index < MAX_NUM_PRIMITIVES) {
-        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_R), index, radius);
+    // all the entries of the device are cleared, also those left by a previous session
+    for (int i = 0; i < MAX_NUM_PRIMITIVES; i++) {
+        appendInt((CmdPort::SET_COLLISION_OBJECT_ACTIVE), i, 0);
+        if (m_primitives[i].state != PrimitiveState::Free)
+            releasePrimitive(i);
     }
+
+    m_numStaged = 0;
+    m_numPending = 0;
+    m_numUploaded = 0;
+    m_batchStatus = PrimitiveBatchStatus();
+    publishBatchStatus();
 }
-void HapticAvatar_DriverPort::updateRadius2(int index, float radius)
+
+void HapticAvatar_DriverPort::commitStagedPrimitives()
 {
-    if (index >= 0 && index < MAX_NUM_PRIMITIVES) {
-        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_Q), index, radius);
+    const int numPrimitives = m_numStaged;
+    if (numPrimitives == 0)
+        return;
+
+    for (int i = 0; i < MAX_NUM_PRIMITIVES; i++) {
+        if (m_primitives[i].state == PrimitiveState::Staged)
+            m_primitives[i].state = PrimitiveState::Pending;
     }
+
+    // a batch committed during an upload joins it, the activation waits for all the primitives
+    if (m_batchStatus.complete)
+        m_batchStatus = PrimitiveBatchStatus();
+    m_batchStatus.numPrimitives += numPrimitives;
+    m_batchStatus.complete = false;
+    publishBatchStatus();
+
+    m_numPending += numPrimitives;
+    m_numStaged = 0;
 }
-void HapticAvatar_DriverPort::updateLength(int index, float length)
+
+void HapticAvatar_DriverPort::appendBackground(int requestBytes, int arenaBytes)
 {
-    if (index >= 0 && index < MAX_NUM_PRIMITIVES) {
-        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_T), index, length);
+    // the operations queued since the last cycle first, the commands they append take their share of the frame like the setpoints
+    const int appendedBytes = getAppendedRequestBytes();
+    applyPrimitiveOps();
+    requestBytes -= getAppendedRequestBytes() - appendedBytes;
+    arenaBytes -= getAppendedRequestBytes() - appendedBytes;
+
+    // the updates of the primitives in use are setpoints, they are not limited by the budget
+    for (int i = 0; i < MAX_NUM_PRIMITIVES && m_numChangedPrimitives > 0; i++)
+    {
+        if (m_primitives[i].changed)
+        {
+            const int bytes = appendPrimitiveChanges(i);
+            requestBytes -= bytes;
+            arenaBytes -= bytes;
+        }
+    }
+
+    if (m_batchStatus.complete)
+        return;
+
+    // The upload takes at most half of what the appended commands leave, the subscribed commands keep the other half.
+    // At least one command is sent per frame, so that the upload ends even if the budget is spent by the appended commands.
+    const WireProtocol protocol = getWireProtocol();
+    const int objectBytes = HapticAvatar_CommandScheduler::requestBytes(protocol, PRIMITIVE_NUM_ARGS);
+    const int activeBytes = HapticAvatar_CommandScheduler::requestBytes(protocol, 2);
+    int budget = std::min(requestBytes, arenaBytes) / 2;
+    int numSent = 0;
+
+    // first the definitions, all inactive
+    for (int i = 0; i < MAX_NUM_PRIMITIVES && m_numPending > 0; i++)
+    {
+        Primitive& prim = m_primitives[i];
+        if (prim.state != PrimitiveState::Pending)
+            continue;
+        if (numSent > 0 && budget < objectBytes)
+            break;
+
+        appendPrimitive(i, false);
+        budget -= objectBytes;
+        arenaBytes -= objectBytes;
+        numSent++;
+        m_numPending--;
+        m_batchStatus.numUploaded++;
+        if (prim.active) {
+            prim.state = PrimitiveState::Uploaded;
+            m_numUploaded++;
+        }
+        else {
+            prim.state = PrimitiveState::Live;
+            m_batchStatus.numActivated++;
+        }
     }
+
+    // Then, once the whole set is on the device, its activation in one frame. Like the setpoints it is not limited by the budget, and
+    // waits a few cycles for a frame with room for all of it in the arena. A set which still does not fit is activated in as few frames as possible.
+    int activationBytes = 0;
+    if (m_numPending == 0 && m_numUploaded > 0)
+    {
+        for (int i = 0; i < MAX_NUM_PRIMITIVES; i++)
+        {
+            if (m_primitives[i].state == PrimitiveState::Uploaded && m_primitives[i].active)
+                activationBytes += activeBytes;
+        }
+        if (activationBytes > arenaBytes && m_activationWait++ < PRIMITIVE_ACTIVATION_MAX_WAIT)
+            activationBytes = -1;
+    }
+
+    for (int i = 0; i < MAX_NUM_PRIMITIVES && activationBytes >= 0 && m_numPending == 0 && m_numUploaded > 0; i++)
+    {
+        Primitive& prim = m_primitives[i];
+        if (prim.state != PrimitiveState::Uploaded)
+            continue;
+        if (numSent > 0 && prim.active && arenaBytes < activeBytes)
+            break;
+
+        // deactivated during the upload, it stays as sent
+        if (prim.active) {
+            appendInt((CmdPort::SET_COLLISION_OBJECT_ACTIVE), i, 1);
+            m_devicePrimitives[i].active = true;
+            arenaBytes -= activeBytes;
+            numSent++;
+        }
+        prim.state = PrimitiveState::Live;
+        m_numUploaded--;
+        m_batchStatus.numActivated++;
+    }
+
+    if (numSent > 0)
+        m_batchStatus.numFrames++;
+
+    // the completion is only published, nothing is logged from the haptic loop
+    if (m_numPending == 0 && m_numUploaded == 0)
+    {
+        m_activationWait = 0;
+        m_batchStatus.complete = true;
+    }
+
+    if (numSent > 0 || m_batchStatus.complete)
+        publishBatchStatus();
+}
+
+void HapticAvatar_DriverPort::setActive(int handle, bool active)
+{
+    int index = getPrimitiveIndex(handle);
+    if (index < 0)
+        return;
+
+    PrimitiveOp op;
+    op.type = PrimitiveOpType::SetActive;
+    op.index = index;
+    op.prim.active = active;
+    pushPrimitiveOp(op);
 }
-void HapticAvatar_DriverPort::updateStiffness(int index, float stiffness)
+
+void HapticAvatar_DriverPort::applyActive(int index, bool active)
 {
-    if (index >= 0 && index < MAX_NUM_PRIMITIVES) {
-        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_STIFFNESS), index, stiffness);
+    // a primitive being uploaded gets its state with the activation of its batch
+    m_primitives[index].active = active;
+    if (m_primitives[index].state == PrimitiveState::Live) {
+        appendInt((CmdPort::SET_COLLISION_OBJECT_ACTIVE), index, (int) active);
+        m_devicePrimitives[index].active = active;
     }
 }
-void HapticAvatar_DriverPort::updateDamping(int index, float damping)
+void HapticAvatar_DriverPort::updatePosition(int handle, sofa::type::fixed_array<float, 3> new_pos)
+{
+    PrimitiveOp op;
+    op.prim.p0 = new_pos;
+    pushPrimitiveUpdate(handle, PrimitiveProperty::Position, op);
+}
+void HapticAvatar_DriverPort::updateOrientation(int handle, sofa::type::fixed_array<float, 3> new_ori)
+{
+    PrimitiveOp op;
+    op.prim.v0 = new_ori;
+    pushPrimitiveUpdate(handle, PrimitiveProperty::Orientation, op);
+}
+void HapticAvatar_DriverPort::updateRadius1(int handle, float radius)
 {
-    if (index >= 0 && index < MAX_NUM_PRIMITIVES) {
-        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_DAMPING), index, damping);
+    PrimitiveOp op;
+    op.prim.r = radius;
+    pushPrimitiveUpdate(handle, PrimitiveProperty::Radius1, op);
+}
+void HapticAvatar_DriverPort::updateRadius2(int handle, float radius)
+{
+    PrimitiveOp op;
+    op.prim.q = radius;
+    pushPrimitiveUpdate(handle, PrimitiveProperty::Radius2, op);
+}
+void HapticAvatar_DriverPort::updateLength(int handle, float length)
+{
+    PrimitiveOp op;
+    op.prim.t = length;
+    pushPrimitiveUpdate(handle, PrimitiveProperty::Length, op);
+}
+void HapticAvatar_DriverPort::updateStiffness(int handle, float stiffness)
+{
+    PrimitiveOp op;
+    op.prim.stiffness = stiffness;
+    pushPrimitiveUpdate(handle, PrimitiveProperty::Stiffness, op);
+}
+void HapticAvatar_DriverPort::updateDamping(int handle, float damping)
+{
+    PrimitiveOp op;
+    op.prim.damping = damping;
+    pushPrimitiveUpdate(handle, PrimitiveProperty::Damping, op);
+}
+void HapticAvatar_DriverPort::updateFriction(int handle, float friction)
+{
+    PrimitiveOp op;
+    op.prim.friction = friction;
+    pushPrimitiveUpdate(handle, PrimitiveProperty::Friction, op);
+}
+
+void HapticAvatar_DriverPort::pushPrimitiveUpdate(int handle, PrimitiveProperty property, PrimitiveOp& op)
+{
+    int index = getPrimitiveIndex(handle);
+    if (index < 0)
+        return;
+
+    op.type = PrimitiveOpType::Update;
+    op.index = index;
+    op.property = property;
+    pushPrimitiveOp(op);
+}
+
+void HapticAvatar_DriverPort::applyProperty(int index, PrimitiveProperty property, const Primitive& value)
+{
+    Primitive& prim = m_primitives[index];
+    switch (property)
+    {
+    case PrimitiveProperty::Position:
+        prim.p0 = value.p0;
+        break;
+    case PrimitiveProperty::Orientation:
+        prim.v0 = value.v0;
+        break;
+    case PrimitiveProperty::Radius1:
+        prim.r = value.r;
+        break;
+    case PrimitiveProperty::Radius2:
+        prim.q = value.q;
+        break;
+    case PrimitiveProperty::Length:
+        prim.t = value.t;
+        break;
+    case PrimitiveProperty::Stiffness:
+        prim.stiffness = value.stiffness;
+        break;
+    case PrimitiveProperty::Damping:
+        prim.damping = value.damping;
+        break;
+    case PrimitiveProperty::Friction:
+        prim.friction = value.friction;
+        break;
     }
+    markPrimitiveChanged(index);
 }
-void HapticAvatar_DriverPort::updateFriction(int index, float friction)
+
+void HapticAvatar_DriverPort::markPrimitiveChanged(int index)
 {
-    if (index >= 0 && index < MAX_NUM_PRIMITIVES) {
-        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_FRICTION), index, friction);
+    // not on the device yet, the properties are sent with its definition
+    if (!isPrimitiveOnDevice(index))
+        return;
+
+    m_primitiveUpdateStats.updates++;
+    if (!m_primitives[index].changed) {
+        m_primitives[index].changed = true;
+        m_numChangedPrimitives++;
+    }
+}
+
+int HapticAvatar_DriverPort::appendPrimitiveChanges(int index)
+{
+    Primitive& prim = m_primitives[index];
+    Primitive& sent = m_devicePrimitives[index];
+    prim.changed = false;
+    m_numChangedPrimitives--;
+
+    const PrimitiveThresholds& eps = m_deviceThresholds;
+    // each property is quantized with the scale of its own command
+    const bool p0 = exceeds(prim.p0, sent.p0, eps.position, scale_factor[CmdPort::SET_COLLISION_OBJECT_P0]);
+    const bool v0 = exceeds(prim.v0, sent.v0, eps.orientation, scale_factor[CmdPort::SET_COLLISION_OBJECT_V0]);
+    const bool q = exceeds(prim.q, sent.q, eps.size, scale_factor[CmdPort::SET_COLLISION_OBJECT_Q]);
+    const bool r = exceeds(prim.r, sent.r, eps.size, scale_factor[CmdPort::SET_COLLISION_OBJECT_R]);
+    const bool t = exceeds(prim.t, sent.t, eps.size, scale_factor[CmdPort::SET_COLLISION_OBJECT_T]);
+    const bool stiffness = exceeds(prim.stiffness, sent.stiffness, eps.material, scale_factor[CmdPort::SET_COLLISION_OBJECT_STIFFNESS]);
+    const bool damping = exceeds(prim.damping, sent.damping, eps.material, scale_factor[CmdPort::SET_COLLISION_OBJECT_DAMPING]);
+    const bool friction = exceeds(prim.friction, sent.friction, eps.material, scale_factor[CmdPort::SET_COLLISION_OBJECT_FRICTION]);
+
+    const int numVectors = int(p0) + int(v0);
+    const int numScalars = int(q) + int(r) + int(t) + int(stiffness) + int(damping) + int(friction);
+    if (numVectors + numScalars == 0)
+        return 0;
+
+    // several changes go in one definition of the primitive when it is shorter than their commands
+    const WireProtocol protocol = getWireProtocol();
+    const int changesBytes = numVectors * HapticAvatar_CommandScheduler::requestBytes(protocol, 4)
+        + numScalars * HapticAvatar_CommandScheduler::requestBytes(protocol, 2);
+    const int objectBytes = HapticAvatar_CommandScheduler::requestBytes(protocol, PRIMITIVE_NUM_ARGS);
+    if (numVectors + numScalars > 1 && objectBytes <= changesBytes)
+    {
+        appendPrimitive(index, sent.active);
+        m_primitiveUpdateStats.commands++;
+        m_primitiveUpdateStats.merged++;
+        return objectBytes;
+    }
+
+    if (p0) {
+        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_P0), index, prim.p0);
+        sent.p0 = prim.p0;
+    }
+    if (v0) {
+        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_V0), index, prim.v0);
+        sent.v0 = prim.v0;
+    }
+    if (q) {
+        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_Q), index, prim.q);
+        sent.q = prim.q;
+    }
+    if (r) {
+        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_R), index, prim.r);
+        sent.r = prim.r;
+    }
+    if (t) {
+        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_T), index, prim.t);
+        sent.t = prim.t;
+    }
+    if (stiffness) {
+        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_STIFFNESS), index, prim.stiffness);
+        sent.stiffness = prim.stiffness;
+    }
+    if (damping) {
+        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_DAMPING), index, prim.damping);
+        sent.damping = prim.damping;
+    }
+    if (friction) {
+        appendIntFloat((CmdPort::SET_COLLISION_OBJECT_FRICTION), index, prim.friction);
+        sent.friction = prim.friction;
     }
+    m_primitiveUpdateStats.commands += numVectors + numScalars;
+    return changesBytes;
 }
 
-void HapticAvatar_DriverPort::appendPrimitive(int index, int type, int active,
-    sofa::type::fixed_array<float, 3> p0,
-    sofa::type::fixed_array<float, 3> v0,
-    sofa::type::fixed_array<float, 3> n,
-    float q, float r, float s, float t, float stiffness, float friction, float damping)
+void HapticAvatar_DriverPort::appendPrimitive(int index, bool active)
 {
+    const Primitive& prim = m_primitives[index];
+    m_devicePrimitives[index] = prim;
+    m_devicePrimitives[index].active = active;
     int cmd = (int)CmdPort::SET_COLLISION_OBJECT;
-    std::string arguments;
-    arguments = std::to_string(index) + " " +
-        std::to_string(type) + " " +
-        std::to_string(active) + " " +
-        std::to_string(int(p0[0] * scale_factor[cmd])) + " " +
-        std::to_string(int(p0[1] * scale_factor[cmd])) + " " +
-        std::to_string(int(p0[2] * scale_factor[cmd])) + " " +
-        std::to_string(int(v0[0] * scale_factor[cmd])) + " " +
-        std::to_string(int(v0[1] * scale_factor[cmd])) + " " +
-        std::to_string(int(v0[2] * scale_factor[cmd])) + " " +
-        std::to_string(int(n[0] * scale_factor[cmd])) + " " +
-        std::to_string(int(n[1] * scale_factor[cmd])) + " " +
-        std::to_string(int(n[2] * scale_factor[cmd])) + " " +
-        std::to_string(int(q * scale_factor[cmd])) + " " +
-        std::to_string(int(r * scale_factor[cmd])) + " " +
-        std::to_string(int(s * scale_factor[cmd])) + " " +
-        std::to_string(int(t * scale_factor[cmd])) + " " +
-        std::to_string(int(stiffness * scale_factor[cmd])) + " " +
-        std::to_string(int(friction * scale_factor[cmd])) + " " +
-        std::to_string(int(damping * scale_factor[cmd])) + " ";
-
-    appendCmd((int)CmdPort::SET_COLLISION_OBJECT, arguments.c_str());
+    int arguments[PRIMITIVE_NUM_ARGS] = { index, prim.type, (int)active,
+        int(prim.p0[0] * scale_factor[cmd]),
+        int(prim.p0[1] * scale_factor[cmd]),
+        int(prim.p0[2] * scale_factor[cmd]),
+        int(prim.v0[0] * scale_factor[cmd]),
+        int(prim.v0[1] * scale_factor[cmd]),
+        int(prim.v0[2] * scale_factor[cmd]),
+        int(prim.n[0] * scale_factor[cmd]),
+        int(prim.n[1] * scale_factor[cmd]),
+        int(prim.n[2] * scale_factor[cmd]),
+        int(prim.q * scale_factor[cmd]),
+        int(prim.r * scale_factor[cmd]),
+        int(prim.s * scale_factor[cmd]),
+        int(prim.t * scale_factor[cmd]),
+        int(prim.stiffness * scale_factor[cmd]),
+        int(prim.friction * scale_factor[cmd]),
+        int(prim.damping * scale_factor[cmd]) };
+
+    appendCmd(cmd, arguments, PRIMITIVE_NUM_ARGS);
 }
 
 } // namespace sofa::HapticAvatar
@@ -23,6 +23,9 @@
 
 #include <SofaHapticAvatar/config.h>
 #include <SofaHapticAvatar/HapticAvatar_DriverBase.h>
+#include <SofaHapticAvatar/HapticAvatar_HealthMonitor.h>
+#include <SofaHapticAvatar/HapticAvatar_TripleBuffer.h>
+#include <SofaHapticAvatar/HapticAvatar_SpscRing.h>
 #include <sofa/type/Vec.h>
 #include <string>
 
@@ -38,11 +41,17 @@ namespace sofa::HapticAvatar
     };
 
 #define MAX_NUM_PRIMITIVES 100
+#define PRIMITIVE_HANDLE_INDEX_BITS 8     // a handle is the index in the table of the device, with the generation of the index above
+#define PRIMITIVE_HANDLE_INDEX_MASK 0xff
+#define PRIMITIVE_HANDLE_GENERATION_MASK 0x7fffff   // the handles stay positive
+#define PRIMITIVE_NUM_ARGS 19             // arguments of SET_COLLISION_OBJECT
+#define PRIMITIVE_ACTIVATION_MAX_WAIT 10  // cycles the activation of a batch waits for a frame with room for all of it
+#define PRIMITIVE_OP_QUEUE_SIZE 1024      // operations on the primitives waiting for the next cycle, a power of two
 
     class SOFA_HAPTICAVATAR_API HapticAvatar_DriverPort : public HapticAvatar_DriverBase
     {
     public:
-        HapticAvatar_DriverPort(const std::string& portName);
+        HapticAvatar_DriverPort(const std::string& portName, HapticAvatar_Transport* transport = nullptr);
 
         // Functions that are typically used at initialization or shutdown
         // ---------------------------------------------------------------
@@ -89,6 +98,17 @@ namespace sofa::HapticAvatar
         */
         sofa::type::fixed_array<float, 4> getAnglesAndLength();
 
+        /** Get the angles and insertion length only if they have been received after a previous sample. Nothing is requested, the values
+        * come from the subscription of the command.
+        * @param {vec4f} anglesAndLength: receives the values as in @sa getAnglesAndLength, unchanged if no newer sample has been received.
+        * @param {uint64_t} seq: receive sequence number of the previous sample, 0 for none. Set to the one of the sample returned.
+        * @returns {bool} true if a newer sample has been received.
+        */
+        bool getAnglesAndLengthIfNewer(sofa::type::fixed_array<float, 4>& anglesAndLength, uint64_t& seq) const;
+
+        /// Time the last angles and insertion length have been received, @sa getCommandAge
+        std::chrono::steady_clock::time_point getAnglesAndLengthTime() const;
+
         /** Get the ID of the inserted tool, i.e. the simulated medical instrument (if any).
         * @returns {int} where -1=no tool inserted, 0=tool inserted but not identified, 1,2,3 ... is an identified tool
         */        
@@ -120,24 +140,92 @@ namespace sofa::HapticAvatar
 
         // Functions for collision primitives
         // ------------------------------------------------------------------
+        // Primitives are addressed by handles, allocated in constant time. The generation stored in a handle changes each time its index
+        // is freed, the functions given the handle of a deleted primitive do nothing rather than modify the primitive reusing the index.
+        // The functions of the primitives are to be called from one thread, e.g. the simulation one. They allocate the handle at once and
+        // queue the operation, applied by the thread running the cycles at its next cycle. If the queue is full the operation is dropped,
+        // like a full table, @sa getDroppedPrimitiveOperations.
+        // The update functions only change the host copy of the primitive. At each cycle, the properties which moved away from the values
+        // last sent by more than the thresholds (@sa setPrimitiveThresholds) are sent, merged in one SET_COLLISION_OBJECT when it is shorter.
 
         void setInstrumentData(float shaft_diameter, float jaw1_diameter, float jaw2_diameter, float jaw_length);
         void setJawOpeningAngle(float ang);
         float getJawTorque();
+        /// Add a sphere, @returns {int} its handle, -1 if the table of the device is full. Only staged if a batch is open, @sa beginPrimitiveBatch
         int addSphere(sofa::type::fixed_array<float, 3> pos, float radius, float stiffness, float damping, float friction);
         int addCapsule(sofa::type::fixed_array<float, 3> pos, sofa::type::fixed_array<float, 3> ori, float radius, float length, float stiffness, float damping, float friction);
         int addTorus(sofa::type::fixed_array<float, 3> pos, sofa::type::fixed_array<float, 3> ori, float major_radius, float minor_radius, float stiffness, float damping, float friction);
-        void deletePrimitive(int index);
+        void deletePrimitive(int handle);
         void deleteAllPrimitives();
-        void setActive(int index, bool active);
-        void updatePosition(int index, sofa::type::fixed_array<float, 3> new_pos);
-        void updateOrientation(int index, sofa::type::fixed_array<float, 3> new_ori);
-        void updateRadius1(int index, float radius);
-        void updateRadius2(int index, float radius);
-        void updateLength(int index, float length);
-        void updateStiffness(int index, float stiffness);
-        void updateDamping(int index, float damping);
-        void updateFriction(int index, float friction);
+        void setActive(int handle, bool active);
+        void updatePosition(int handle, sofa::type::fixed_array<float, 3> new_pos);
+        void updateOrientation(int handle, sofa::type::fixed_array<float, 3> new_ori);
+        void updateRadius1(int handle, float radius);
+        void updateRadius2(int handle, float radius);
+        void updateLength(int handle, float length);
+        void updateStiffness(int handle, float stiffness);
+        void updateDamping(int handle, float damping);
+        void updateFriction(int handle, float friction);
+        /// True if @param handle addresses a primitive which has not been deleted since.
+        bool isPrimitiveValid(int handle) const;
+
+        /** Open a batch of primitives: until @sa commitPrimitiveBatch the primitives added are only staged on the host, their handles
+        * can already be used with the other functions. Used to load a scene with many primitives without delaying the force commands.
+        */
+        void beginPrimitiveBatch();
+
+        /** Close the batch and start its upload at the next cycle. The primitives are sent inactive in as many cycles as needed, using at most half of
+        * what the appended commands leave of the budget of each frame, then activated together in one frame, so that the device never
+        * collides with only a part of the set. Only a set whose activation does not fit in the output arena with the setpoints, e.g. more
+        * than about 45 primitives in Ascii, is activated over several consecutive frames. A batch committed during an upload joins it.
+        * @returns {int} the number of primitives of the batch, 0 if the operation queue is full: the batch then stays open.
+        */
+        int commitPrimitiveBatch();
+
+        /// Number of operations on the primitives dropped because the queue to the thread running the cycles was full.
+        uint64_t getDroppedPrimitiveOperations() const { return m_primitiveOps.getDropped(); }
+
+        /// Progress of the upload of the committed batches
+        struct PrimitiveBatchStatus
+        {
+            int numPrimitives = 0;  ///< primitives committed since the last completed upload
+            int numUploaded = 0;    ///< primitives whose definition has been sent
+            int numActivated = 0;   ///< primitives in their final state on the device
+            int numFrames = 0;      ///< frames used by the upload
+            bool complete = true;   ///< all the primitives committed are on the device
+        };
+
+        /** Progress of the last upload, complete once all its primitives are activated. Published by the thread running the cycles,
+        * to be polled from one other thread such as the simulation one. The driver does not log the completion, the caller may.
+        * @param {PrimitiveBatchStatus} status: receives the latest progress if it changed since the last call, unchanged otherwise.
+        * @returns {bool} true if @param status has been updated.
+        */
+        bool getPrimitiveBatchStatus(PrimitiveBatchStatus& status) { return m_batchStatusBuffer.fetch(status); }
+
+        /** Changes of the properties of the primitives not worth sending, in the units of the update functions. A change is measured from the
+        * value last sent to the device, so a slow drift is sent once it adds up. Changes below the resolution of the device are never sent.
+        */
+        struct PrimitiveThresholds
+        {
+            float position = 0.0f;      ///< distance to the position sent
+            float orientation = 0.0f;   ///< norm of the difference to the orientation vector sent
+            float size = 0.0f;          ///< radii and length
+            float material = 0.0f;      ///< stiffness, damping and friction
+        };
+
+        /// Set the thresholds of the property updates, 0 by default: every change the device can represent is sent. Queued like the primitives.
+        void setPrimitiveThresholds(const PrimitiveThresholds& thresholds);
+        const PrimitiveThresholds& getPrimitiveThresholds() const { return m_primitiveThresholds; }
+
+        /// Statistics of the property updates of the primitives on the device
+        struct PrimitiveUpdateStats
+        {
+            uint64_t updates = 0;   ///< calls to the update functions
+            uint64_t commands = 0;  ///< commands sent for them
+            uint64_t merged = 0;    ///< primitives whose changes were sent as one SET_COLLISION_OBJECT
+        };
+
+        const PrimitiveUpdateStats& getPrimitiveUpdateStats() const { return m_primitiveUpdateStats; }
 
 
 
@@ -196,25 +284,154 @@ namespace sofa::HapticAvatar
         void releaseForce();
 
         // Will output to cout a resport of the status of the device, such as temperatures, battery voltage etc.
+        // Blocking for the values not subscribed to, not to be called from the haptic loop, see sampleHealth
         void printStatus() override;
 
+        /** Get the diagnostics last received from the device, without requesting anything: they are subscribed to in the Diagnostics lane
+        * and piggyback on the spare budget of the frames. Can be called from the haptic loop.
+        * @param {HealthSample} sample: receives the status word and temperatures, the values not subscribed to or not received yet are NaN.
+        * @returns {bool} false if the status word is not subscribed to or not received yet, @param sample is then unchanged.
+        */
+        bool sampleHealth(HealthSample& sample) const;
+
     protected:
-        /// Internal method to setup how many return values each command is expecting and how to scale outgoing and incoming data.
-        void setupNumReturnVals() override;
         /// Internal method to setup which data from the device to subscribe to, and how often.
         void setupCmdLists() override;
 
+        /// Property updates of the primitives, then upload of the committed ones, @sa commitPrimitiveBatch
+        void appendBackground(int requestBytes, int arenaBytes) override;
+
+        /// State of an entry of the primitive table
+        enum class PrimitiveState
+        {
+            Free = 0,
+            Staged,     ///< in the open batch
+            Pending,    ///< committed, not sent yet
+            Uploaded,   ///< sent inactive, waiting for the activation of its batch
+            Live        ///< on the device, the setters are appended directly
+        };
+
+        /// Host copy of a primitive, as sent with SET_COLLISION_OBJECT
+        struct Primitive
+        {
+            int type = 0;
+            bool active = false;
+            sofa::type::fixed_array<float, 3> p0, v0, n;
+            float q = 0, r = 0, s = 0, t = 0;
+            float stiffness = 0, friction = 0, damping = 0;
+            PrimitiveState state = PrimitiveState::Free;
+            bool changed = false;   ///< updated since the properties were last compared to the device
+        };
+
+        /// Handle side of an entry of the primitive table, owned by the thread calling the primitive functions
+        struct PrimitiveHandle
+        {
+            unsigned int generation = 0;
+            bool used = false;
+            bool staged = false;    ///< added to the open batch
+        };
+
+        enum class PrimitiveOpType
+        {
+            Add = 0,
+            Delete,
+            DeleteAll,
+            Commit,
+            SetActive,
+            SetThresholds,
+            Update
+        };
+
+        /// Property changed by an update function
+        enum class PrimitiveProperty
+        {
+            Position = 0,
+            Orientation,
+            Radius1,
+            Radius2,
+            Length,
+            Stiffness,
+            Damping,
+            Friction
+        };
+
+        /// Operation on the primitive table, handed over to the thread running the cycles
+        struct PrimitiveOp
+        {
+            PrimitiveOpType type = PrimitiveOpType::Add;
+            int index = 0;
+            Primitive prim;                 ///< Add: the definition, staged or live. SetActive: the state in active. Update: the value in the field of the property
+            PrimitiveThresholds thresholds; ///< SetThresholds
+            PrimitiveProperty property = PrimitiveProperty::Position;   ///< Update
+        };
+
+        /// Queue @param op for the next cycle, @returns false if the queue is full. Only the first drop is logged.
+        bool pushPrimitiveOp(const PrimitiveOp& op);
+        /// Pop a free index, @returns -1 if there is none.
         int reserveNextPrimitiveIndex();
-        void appendPrimitive(int index, int type, int active,
-            sofa::type::fixed_array<float, 3> p0,
-            sofa::type::fixed_array<float, 3> v0,
-            sofa::type::fixed_array<float, 3> n,
-            float q, float r, float s, float t, float stiffness, float friction, float damping);
+        /// Free @param index, the handles to it become stale.
+        void releasePrimitiveIndex(int index);
+        /// @returns the index addressed by @param handle, -1 if it is stale or invalid.
+        int getPrimitiveIndex(int handle) const;
+        /// Queue the update of @param property of the primitive addressed by @param handle, the value is in the field of @param op.prim.
+        void pushPrimitiveUpdate(int handle, PrimitiveProperty property, PrimitiveOp& op);
+        /// Allocate a handle for @param prim and queue its addition, staged if a batch is open. @returns its handle, -1 if the table or the queue is full.
+        int addPrimitive(const Primitive& prim);
+
+        // The functions below run on the thread running the cycles
+
+        /// Apply the operations queued since the last cycle, their commands are appended like the setpoints.
+        void applyPrimitiveOps();
+        /// Store @param prim at @param index and append it, or stage it.
+        void storePrimitive(int index, const Primitive& prim);
+        /// Deactivate the primitive at @param index on the device, or take it out of the upload, and free its entry.
+        void removePrimitive(int index);
+        /// Deactivate all the entries of the device, also those left by a previous session, and clear the table.
+        void removeAllPrimitives();
+        /// Start the upload of the staged primitives.
+        void commitStagedPrimitives();
+        /// Set the state of the primitive at @param index, sent directly if it is live.
+        void applyActive(int index, bool active);
+        /// Copy @param property from @param value to the primitive at @param index.
+        void applyProperty(int index, PrimitiveProperty property, const Primitive& value);
+        /// Clear the entry at @param index.
+        void releasePrimitive(int index);
+        /// Make the progress of the upload visible to @sa getPrimitiveBatchStatus
+        void publishBatchStatus() { m_batchStatusBuffer.publish(m_batchStatus); }
+        /// True if the primitive at @param index exists on the device, its properties are then updated by appended commands.
+        bool isPrimitiveOnDevice(int index) const { return m_primitives[index].state == PrimitiveState::Uploaded || m_primitives[index].state == PrimitiveState::Live; }
+        /// Append the SET_COLLISION_OBJECT command of the primitive at @param index.
+        void appendPrimitive(int index, bool active);
+        /// Record an update of the primitive at @param index, to be compared with the device at the next cycle.
+        void markPrimitiveChanged(int index);
+        /// Append the properties of the primitive at @param index exceeding the thresholds, @returns the request bytes appended.
+        int appendPrimitiveChanges(int index);
         void updatePrimitiveProperty(int index, int prop, float value);
         void updatePrimitiveProperty(int index, int prop, sofa::type::fixed_array<float, 3> vec);
     private:
 
-        bool primitive_index_used[MAX_NUM_PRIMITIVES];
+        // handles, on the thread calling the primitive functions
+        PrimitiveHandle m_primitiveHandles[MAX_NUM_PRIMITIVES];
+        int m_freePrimitives[MAX_NUM_PRIMITIVES];   // stack of the free indices
+        int m_numFreePrimitives;
+        bool m_batchOpen = false;
+        int m_numBatchPrimitives = 0;
+        PrimitiveThresholds m_primitiveThresholds;
+
+        HapticAvatar_SpscRing<PrimitiveOp, PRIMITIVE_OP_QUEUE_SIZE> m_primitiveOps;
+
+        // primitive table, on the thread running the cycles
+        Primitive m_primitives[MAX_NUM_PRIMITIVES];
+        Primitive m_devicePrimitives[MAX_NUM_PRIMITIVES];   // values last sent for the primitives on the device
+        int m_numChangedPrimitives = 0;
+        PrimitiveThresholds m_deviceThresholds;
+        PrimitiveUpdateStats m_primitiveUpdateStats;
+        int m_numStaged = 0;
+        int m_numPending = 0;
+        int m_numUploaded = 0;
+        int m_activationWait = 0;   // cycles the activation has waited for room in the arena
+        PrimitiveBatchStatus m_batchStatus;
+        HapticAvatar_TripleBuffer<PrimitiveBatchStatus> m_batchStatusBuffer;
         // This enum is a list of all commands. The same list exists in the device.
         enum CmdPort
         {
@@ -273,6 +490,77 @@ namespace sofa::HapticAvatar
             ALWAYS_LAST
         };
 
+        // Description of each command, in the order of the enum: name, number of return values, scale factor, type of the values and,
+        // for the setpoints, how the appended commands are coalesced.
+        // The result table, the parser and the typed getters of the driver are set up from it.
+        static constexpr CommandDescriptor commandDescriptors[ALWAYS_LAST] = {
+            { "RESET",                          1,  1.0f,     CommandValueType::Int },
+            { "GET_DEVICE_TYPE",                1,  1.0f,     CommandValueType::Int },
+            { "GET_ANGLES_AND_LENGTH",          4,  10000.0f, CommandValueType::Float },
+            { "GET_TOOL_ID",                    1,  1.0f,     CommandValueType::Int },
+            { "GET_CURRENT_DELTA_T",            1,  10000.0f, CommandValueType::Float },
+            { "GET_STATUS",                     1,  1.0f,     CommandValueType::Int },
+            { "SET_MOTOR_FORCE_AND_TORQUES",    0,  10000.0f, CommandValueType::None, CommandAppend::Latest },
+            { "SET_TIP_FORCE_AND_ROT_TORQUE",   0,  10000.0f, CommandValueType::None, CommandAppend::Latest },
+            { "SET_YAW_PITCH_ZERO_ANG",         0,  10000.0f, CommandValueType::None },
+            { "SET_LED_BLINK_MODE",             0,  1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "SET_COLLISION_OBJECT",           0,  10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "SET_COLLISION_OBJECT_ACTIVE",    0,  1.0f,     CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "SET_COLLISION_OBJECT_P0",        0,  10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "SET_COLLISION_OBJECT_V0",        0,  10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "SET_COLLISION_OBJECT_N",         0,  10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "SET_COLLISION_OBJECT_Q",         0,  10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "SET_COLLISION_OBJECT_R",         0,  10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "SET_COLLISION_OBJECT_S",         0,  10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "SET_COLLISION_OBJECT_T",         0,  10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "SET_COLLISION_OBJECT_STIFFNESS", 0,  10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "SET_COLLISION_OBJECT_DAMPING",   0,  10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "SET_COLLISION_OBJECT_FRICTION",  0,  10000.0f, CommandValueType::None, CommandAppend::LatestPerChannel },
+            { "GET_LAST_COLLISION_FORCE",       3,  10000.0f, CommandValueType::Float },
+            { "GET_LAST_PWM",                   4,  1.0f,     CommandValueType::Float },
+            { "GET_LAST_COLLISION_DATA",        1,  10000.0f, CommandValueType::Float },
+            { "SET_TOOL_JAW_OPENING_ANGLE",     0,  10000.0f, CommandValueType::None, CommandAppend::Latest },
+            { "GET_TOOL_JAW_TORQUE",            1,  10000.0f, CommandValueType::Float },
+            { "SET_TOOL_DATA",                  0,  10000.0f, CommandValueType::None, CommandAppend::Latest },
+            { "GET_TOOL_INSERTED",              1,  1.0f,     CommandValueType::Int },
+            { "GET_TOOL_TIP_VELOCITY",          3,  10000.0f, CommandValueType::Float },
+            { "GET_TOOL_TIP_POSITION",          3,  10000.0f, CommandValueType::Float },
+            { "GET_TOOL_DIRECTION",             3,  10000.0f, CommandValueType::Float },
+            { "GET_RAW_ENCODER_VALUES",         4,  1.0f,     CommandValueType::Int },
+            { "GET_ENCODER_SCALING_VALUES",     4,  10000.0f, CommandValueType::Float },
+            { "GET_MOTOR_SCALING_VALUES",       4,  10000.0f, CommandValueType::Float },
+            { "SET_MANUAL_PWM",                 0,  1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "GET_BOARD_TEMP",                 1,  10000.0f, CommandValueType::Float },
+            { "GET_BATTERY_VOLTAGE",            1,  10000.0f, CommandValueType::Float },
+            { "GET_CALIBRATION_STATUS",         3,  1.0f,     CommandValueType::Int },
+            { "GET_AMPLIFIERS_STATUS",          4,  10000.0f, CommandValueType::Float },
+            { "GET_HALL_STATES",                2,  1.0f,     CommandValueType::Int },
+            { "SET_POWER_ON_MANUAL",            0,  1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "SET_FAN_ON_MANUAL",              0,  1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "SET_FF_ENABLE",                  0,  1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "GET_SERIAL_NUM",                 1,  1.0f,     CommandValueType::Int },
+            { "GET_BUILD_DATE",                 1,  1.0f,     CommandValueType::Int },
+            { "SET_CHARGE_ENABLE",              0,  1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "GET_TIP_LENGTH",                 1,  10000.0f, CommandValueType::Float },
+            { "GET_PART_TEMPERATURES",          12, 10.0f,    CommandValueType::Float },
+            { "SET_MAX_USB_CHARGE_CURRENT",     0,  1.0f,     CommandValueType::None, CommandAppend::Latest },
+            { "GET_USB_CHARGING_CURRENT",       1,  10000.0f, CommandValueType::Float },
+            { "SET_DEADBAND_PWM_WIDTH",         1,  1.0f,     CommandValueType::Int },
+        };
+        static_assert(isValidCommandTable(commandDescriptors, RESULT_SIZEY), "Incomplete or inconsistent CmdPort descriptor table");
+
+        /// Last values of command @tparam Cmd, their number and type taken from its descriptor. @sa HapticAvatar_DriverBase::getValues
+        template <CmdPort Cmd>
+        auto get() { return getValues<commandDescriptors[Cmd].numReturnVals, commandDescriptors[Cmd].type>((int)Cmd); }
+
+        /// Last value at @param channel of command @tparam Cmd. @sa HapticAvatar_DriverBase::getValue
+        template <CmdPort Cmd>
+        auto get(int channel) { return getValue<commandDescriptors[Cmd].numReturnVals, commandDescriptors[Cmd].type>((int)Cmd, channel); }
+
+        /// Last values of command @tparam Cmd if newer than @param seq, without requesting them. @sa HapticAvatar_DriverBase::getValuesIfNewer
+        template <CmdPort Cmd, class Value>
+        bool getIfNewer(Value& values, uint64_t& seq) const { return getValuesIfNewer<commandDescriptors[Cmd].numReturnVals, commandDescriptors[Cmd].type>((int)Cmd, values, seq); }
+
         // Enums for the thermal simulation in the device. The motor winding temperatures are the most interesting.
         enum PortThermalSimPart {
             RMotorWinding = 0, PMotorWinding, ZMotorWinding, YMotorWinding,
@@ -22,49 +22,27 @@
 
 #include <SofaHapticAvatar/HapticAvatar_DriverScope.h>
 #include <sofa/helper/logging/Messaging.h>
+#include <iostream>
 
 namespace sofa::HapticAvatar
 {
 
 using namespace HapticAvatar;
 
-
 ///////////////////////////////////////////////////////////////
 /////      Methods for specific device communication      /////
 ///////////////////////////////////////////////////////////////
 
-HapticAvatar_DriverScope::HapticAvatar_DriverScope(const std::string& portName)
-    : HapticAvatar_DriverBase(portName)
+HapticAvatar_DriverScope::HapticAvatar_DriverScope(const std::string& portName, HapticAvatar_Transport* transport)
+    : HapticAvatar_DriverBase(portName, transport)
 {
-    setupNumReturnVals();  // needs to be implemented in each device driver
+    setupCommandTable(commandDescriptors);
     setupCmdLists();   // needs to be implemented in each device driver
 
     device_type = 3;
 
 }
 
-void HapticAvatar_DriverScope::setupNumReturnVals()
-{
-    num_return_vals[(int)CmdScope::RESET] = 1;
-    num_return_vals[(int)CmdScope::GET_DEVICE_TYPE] = 1;
-    num_return_vals[(int)CmdScope::GET_BUTTON_STATES] = 3;
-    num_return_vals[(int)CmdScope::GET_ZOOM_LEVEL] = 1;
-    num_return_vals[(int)CmdScope::GET_CAMERA_ANGLE] = 1;
-    num_return_vals[(int)CmdScope::GET_CRC_POLY] = 1;
-    num_return_vals[(int)CmdScope::GET_CURRENT_DELTA_T] = 1;
-
-
-    // Set all scale factor to 1.0 to begin with ...
-    for (int i = 0; i < (int)CmdScope::ALWAYS_LAST; i++)
-        scale_factor[i] = 1.0f;
-
-    // ... and now change those who are not 1.0
-    scale_factor[(int)CmdScope::GET_CAMERA_ANGLE] = 10000.0f;
-    scale_factor[(int)CmdScope::GET_CURRENT_DELTA_T] = 10000.0f;
-
-    device_num_cmds = (int)CmdScope::ALWAYS_LAST;
-}
-
 void HapticAvatar_DriverScope::setupCmdLists()
 {
     // Setup the data you want to subscribe to from the port device here. Subscription commands can only be of type GET_... without input arguments.
@@ -79,7 +57,7 @@ void HapticAvatar_DriverScope::setupCmdLists()
 bool HapticAvatar_DriverScope::getButtonPressed(int button)
 {
     if (button >= 0 && button < 3) {
-        return (getInt((int)CmdScope::GET_BUTTON_STATES, button) != 0);
+        return (get<CmdScope::GET_BUTTON_STATES>(button) != 0);
     }
     else {
         return false;
@@ -88,23 +66,34 @@ bool HapticAvatar_DriverScope::getButtonPressed(int button)
 
 int HapticAvatar_DriverScope::getZoomLevel()
 {
-    return getInt((int)CmdScope::GET_ZOOM_LEVEL);
+    return get<CmdScope::GET_ZOOM_LEVEL>();
 }
 
 float HapticAvatar_DriverScope::getCameraAngle()
 {
-    return getFloat((int)CmdScope::GET_CAMERA_ANGLE);
+    return get<CmdScope::GET_CAMERA_ANGLE>();
 }
 
 
 float  HapticAvatar_DriverScope::getCurrentDeltaT()
 {
-    return getFloat((int)CmdScope::GET_CURRENT_DELTA_T);
+    return get<CmdScope::GET_CURRENT_DELTA_T>();
 }
 
 int HapticAvatar_DriverScope::getSerialNumber()
 {
-    return getInt((int)CmdScope::GET_SERIAL_NUM);
+    return get<CmdScope::GET_SERIAL_NUM>();
+}
+
+void HapticAvatar_DriverScope::printStatus()
+{
+    std::cout << "Status for Scope device S/N " << getSerialNumber() << " at " << getPortName() << std::endl;
+    std::cout << "--------------------------------------------" << std::endl;
+
+    std::cout << "  Camera angle " << getCameraAngle() << " rad" << std::endl;
+    std::cout << "  Buttons " << getButtonPressed(0) << " " << getButtonPressed(1) << " " << getButtonPressed(2) << std::endl;
+    std::cout << "  Zoom level " << getZoomLevel() << std::endl;
+    std::cout << "  Loop time " << getCurrentDeltaT() << " ms" << std::endl;
 }
 
 
@@ -32,7 +32,7 @@ namespace sofa::HapticAvatar
     class SOFA_HAPTICAVATAR_API HapticAvatar_DriverScope : public HapticAvatar_DriverBase
     {
     public:
-        HapticAvatar_DriverScope(const std::string& portName);
+        HapticAvatar_DriverScope(const std::string& portName, HapticAvatar_Transport* transport = nullptr);
 
         // Functions that are typically used at initialization or shutdown
         // ---------------------------------------------------------------
@@ -72,9 +72,10 @@ namespace sofa::HapticAvatar
         */
         float getCurrentDeltaT();
 
+        /// Print the state of the buttons, the zoom level and the loop time of the device.
+        void printStatus() override;
+
     protected:
-        /// Internal method to setup how many return values each command is expecting and how to scale outgoing and incoming data.
-        void setupNumReturnVals() override;
         /// Internal method to setup which data from the device to subscribe to, and how often.
         void setupCmdLists() override;
 
@@ -93,5 +94,27 @@ namespace sofa::HapticAvatar
             GET_SERIAL_NUM,
             ALWAYS_LAST
         };
+
+        // Description of each command, in the order of the enum: name, number of return values, scale factor and type of the values.
+        // The result table, the parser and the typed getters of the driver are set up from it.
+        static constexpr CommandDescriptor commandDescriptors[ALWAYS_LAST] = {
+            { "RESET",               1, 1.0f,     CommandValueType::Int },
+            { "GET_DEVICE_TYPE",     1, 1.0f,     CommandValueType::Int },
+            { "GET_BUTTON_STATES",   3, 1.0f,     CommandValueType::Int },
+            { "GET_ZOOM_LEVEL",      1, 1.0f,     CommandValueType::Int },
+            { "GET_CAMERA_ANGLE",    1, 10000.0f, CommandValueType::Float },
+            { "GET_CRC_POLY",        1, 1.0f,     CommandValueType::Int },
+            { "GET_CURRENT_DELTA_T", 1, 10000.0f, CommandValueType::Float },
+            { "GET_SERIAL_NUM",      1, 1.0f,     CommandValueType::Int },
+        };
+        static_assert(isValidCommandTable(commandDescriptors, RESULT_SIZEY), "Incomplete or inconsistent CmdScope descriptor table");
+
+        /// Last values of command @tparam Cmd, their number and type taken from its descriptor. @sa HapticAvatar_DriverBase::getValues
+        template <CmdScope Cmd>
+        auto get() { return getValues<commandDescriptors[Cmd].numReturnVals, commandDescriptors[Cmd].type>((int)Cmd); }
+
+        /// Last value at @param channel of command @tparam Cmd. @sa HapticAvatar_DriverBase::getValue
+        template <CmdScope Cmd>
+        auto get(int channel) { return getValue<commandDescriptors[Cmd].numReturnVals, commandDescriptors[Cmd].type>((int)Cmd, channel); }
     };
 } // namespace sofa::HapticAvatar
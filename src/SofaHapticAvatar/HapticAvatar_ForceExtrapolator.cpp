@@ -0,0 +1,162 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_ForceExtrapolator.h>
+
+namespace sofa::HapticAvatar
+{
+
+    HapticAvatar_ForceExtrapolator::HapticAvatar_ForceExtrapolator()
+        : m_history(4)
+        , m_horizonMs(50.0)
+        , m_fadeOutMs(100.0)
+        , m_maxStiffness(0.0)
+    {
+        reset();
+    }
+
+
+    void HapticAvatar_ForceExtrapolator::setup(int history, double horizonMs, double fadeOutMs, double maxStiffness)
+    {
+        m_history = history < 2 ? 2 : (history > FORCE_EXTRAPOLATOR_MAX_SAMPLES ? FORCE_EXTRAPOLATOR_MAX_SAMPLES : history);
+        m_horizonMs = horizonMs > 0.0 ? horizonMs : 0.0;
+        m_fadeOutMs = fadeOutMs > 0.0 ? fadeOutMs : 0.0;
+        m_maxStiffness = maxStiffness > 0.0 ? maxStiffness : 0.0;
+        reset();
+    }
+
+
+    void HapticAvatar_ForceExtrapolator::reset()
+    {
+        m_numSamples = 0;
+        m_newest = -1;
+        m_size = 0;
+        m_lastStep = 0;
+        for (int i = 0; i < FORCE_EXTRAPOLATOR_MAX_DOFS; i++)
+            m_stiffness[i] = 0.0;
+    }
+
+
+    void HapticAvatar_ForceExtrapolator::addSample(uint64_t step, const double* positions, const double* forces, unsigned int size, const Clock::time_point& time)
+    {
+        if (m_numSamples > 0 && step == m_lastStep)
+            return;
+
+        if (size > FORCE_EXTRAPOLATOR_MAX_DOFS)
+            size = FORCE_EXTRAPOLATOR_MAX_DOFS;
+        if (size != m_size)
+        {
+            // other articulations, the previous samples do not apply anymore
+            reset();
+            m_size = size;
+        }
+
+        m_newest = (m_newest + 1) % m_history;
+        for (unsigned int i = 0; i < m_size; i++)
+        {
+            m_positions[m_newest][i] = positions[i];
+            m_forces[m_newest][i] = forces[i];
+        }
+        if (m_numSamples < m_history)
+            m_numSamples++;
+        m_lastStep = step;
+        m_lastTime = time;
+
+        fitStiffness();
+    }
+
+
+    void HapticAvatar_ForceExtrapolator::fitStiffness()
+    {
+        for (unsigned int i = 0; i < m_size; i++)
+        {
+            if (m_forces[m_newest][i] == 0.0)
+            {
+                // no contact on this articulation, nothing to extrapolate
+                m_stiffness[i] = 0.0;
+                continue;
+            }
+
+            double meanX = 0.0;
+            double meanF = 0.0;
+            for (int k = 0; k < m_numSamples; k++)
+            {
+                meanX += m_positions[k][i];
+                meanF += m_forces[k][i];
+            }
+            meanX /= double(m_numSamples);
+            meanF /= double(m_numSamples);
+
+            double sumXX = 0.0;
+            double sumXF = 0.0;
+            for (int k = 0; k < m_numSamples; k++)
+            {
+                const double dx = m_positions[k][i] - meanX;
+                sumXX += dx * dx;
+                sumXF += dx * (m_forces[k][i] - meanF);
+            }
+
+            // the device did not move between the steps: the previous stiffness is kept
+            if (sumXX <= 1e-12)
+                continue;
+
+            double stiffness = sumXF / sumXX;
+            if (stiffness > 0.0)
+                stiffness = 0.0;
+            if (m_maxStiffness > 0.0 && stiffness < -m_maxStiffness)
+                stiffness = -m_maxStiffness;
+            m_stiffness[i] = stiffness;
+        }
+    }
+
+
+    double HapticAvatar_ForceExtrapolator::evaluate(const double* positions, const Clock::time_point& now, double* forces) const
+    {
+        if (m_numSamples == 0)
+        {
+            for (unsigned int i = 0; i < m_size; i++)
+                forces[i] = 0.0;
+            return 0.0;
+        }
+
+        double gain = 1.0;
+        const double elapsedMs = std::chrono::duration<double, std::milli>(now - m_lastTime).count();
+        if (elapsedMs > m_horizonMs)
+        {
+            // the simulation is late or stalled: fade out instead of extrapolating further
+            gain = (m_fadeOutMs > 0.0) ? 1.0 - (elapsedMs - m_horizonMs) / m_fadeOutMs : 0.0;
+            if (gain < 0.0)
+                gain = 0.0;
+        }
+
+        for (unsigned int i = 0; i < m_size; i++)
+        {
+            const double force0 = m_forces[m_newest][i];
+            double force = force0 + m_stiffness[i] * (positions[i] - m_positions[m_newest][i]);
+            if (force * force0 < 0.0)
+                force = 0.0;
+            forces[i] = gain * force;
+        }
+        return gain;
+    }
+
+} // namespace sofa::HapticAvatar
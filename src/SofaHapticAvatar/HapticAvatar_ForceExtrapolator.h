@@ -0,0 +1,103 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <chrono>
+#include <cstdint>
+
+namespace sofa::HapticAvatar
+{
+
+#define FORCE_EXTRAPOLATOR_MAX_DOFS 8
+#define FORCE_EXTRAPOLATOR_MAX_SAMPLES 8
+
+    /**
+    * Extrapolation of the force feedback between two simulation steps. The force computed by the simulation only changes at each step,
+    * while the device moves at the rate of the haptic loop. At each step, the articulations of the simulation and the force computed for them
+    * are added as a sample; the response of each articulation is fitted as a stiffness, the least squares slope of force versus displacement
+    * over the last samples. Between steps, the force is the one of the last step plus this stiffness times the displacement of the device since.
+    * Only restoring stiffnesses are kept and the extrapolated force never changes sign: a contact can push back harder or release, never pull.
+    * If no step comes within the horizon, the simulation is considered stalled and the force fades out linearly to zero.
+    * Only to be used from one thread, the haptic one.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_ForceExtrapolator
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        HapticAvatar_ForceExtrapolator();
+
+        /** Set the parameters of the extrapolation and forget the previous samples.
+        * @param {int} history: number of simulation steps the stiffness is fitted on, at least 2.
+        * @param {double} horizonMs: time after the last step during which the force is extrapolated at full strength.
+        * @param {double} fadeOutMs: time after the horizon over which the force fades out to zero.
+        * @param {double} maxStiffness: bound of the fitted stiffnesses, in force per unit of articulation. No bound if 0.
+        */
+        void setup(int history, double horizonMs, double fadeOutMs, double maxStiffness);
+
+        /// Forget the samples, the force is zero until the next one.
+        void reset();
+
+        /** Add the articulations of a simulation step and the force computed for them.
+        * @param {uint64_t} step: number of the step, the sample is ignored if it is the same as the last one.
+        * @param {double*} positions, forces: @param size values each, only the first FORCE_EXTRAPOLATOR_MAX_DOFS are used.
+        * @param {time_point} time: time at which the step reached the haptic loop.
+        */
+        void addSample(uint64_t step, const double* positions, const double* forces, unsigned int size, const Clock::time_point& time);
+
+        /** Evaluate the force at the current articulations of the device.
+        * @param {double*} positions: articulations of the device, as many as in the samples.
+        * @param {time_point} now: current time, compared to the time of the last sample.
+        * @param {double*} forces: receives the force on each articulation.
+        * @returns {double} the gain applied to the force: 1 within the horizon, decreasing to 0 during the fade-out. 0 if there is no sample yet.
+        */
+        double evaluate(const double* positions, const Clock::time_point& now, double* forces) const;
+
+        /// Step of the last sample, 0 if none.
+        uint64_t getLastStep() const { return m_lastStep; }
+
+        /// Fitted stiffness of articulation @param dof, negative or zero.
+        double getStiffness(unsigned int dof) const { return dof < m_size ? m_stiffness[dof] : 0.0; }
+
+    protected:
+        /// Fit the stiffness of each articulation on the samples in the history.
+        void fitStiffness();
+
+        int m_history;
+        double m_horizonMs;
+        double m_fadeOutMs;
+        double m_maxStiffness;
+
+        // ring of the last samples, m_newest is the index of the last one
+        double m_positions[FORCE_EXTRAPOLATOR_MAX_SAMPLES][FORCE_EXTRAPOLATOR_MAX_DOFS];
+        double m_forces[FORCE_EXTRAPOLATOR_MAX_SAMPLES][FORCE_EXTRAPOLATOR_MAX_DOFS];
+        int m_numSamples;
+        int m_newest;
+        unsigned int m_size;
+        uint64_t m_lastStep;
+        Clock::time_point m_lastTime;
+
+        double m_stiffness[FORCE_EXTRAPOLATOR_MAX_DOFS];
+    };
+
+} // namespace sofa::HapticAvatar
@@ -14,6 +14,7 @@
 #include <sofa/simulation/AnimateEndEvent.h>
 #include <sofa/simulation/CollisionEndEvent.h>
 #include <sofa/core/collision/DetectionOutput.h>
+#include <SofaConstraint/LCPConstraintSolver.h>
 
 #include <sofa/core/visual/VisualParams.h>
 #include <chrono>
@@ -35,8 +36,24 @@ int HapticAvatar_GrasperDeviceControllerClass = core::RegisterObject("Driver all
 HapticAvatar_GrasperDeviceController::HapticAvatar_GrasperDeviceController()
     : HapticAvatar_ArticulatedDeviceController()
     , d_MaxOpeningAngle(initData(&d_MaxOpeningAngle, SReal(60.0f), "MaxOpeningAngle", "Max jaws opening angle"))
+    , d_forceExtrapolation(initData(&d_forceExtrapolation, false, "forceExtrapolation", "Extrapolate the force feedback between simulation steps from the motion of the device, instead of holding the force of the last step"))
+    , d_extrapolationHistory(initData(&d_extrapolationHistory, 4, "extrapolationHistory", "Number of simulation steps the response of each articulation is fitted on"))
+    , d_extrapolationHorizon(initData(&d_extrapolationHorizon, 50.0, "extrapolationHorizon", "Time in milliseconds after the last simulation step during which the force is extrapolated"))
+    , d_extrapolationFadeOut(initData(&d_extrapolationFadeOut, 100.0, "extrapolationFadeOut", "Time in milliseconds after the horizon over which the force fades out to zero if no simulation step comes"))
+    , d_extrapolationMaxStiffness(initData(&d_extrapolationMaxStiffness, 0.0, "extrapolationMaxStiffness", "Bound of the fitted stiffness of each articulation, no bound if 0"))
+    , d_localContactSolver(initData(&d_localContactSolver, false, "localContactSolver", "Solve the contacts of the last simulation step again at each haptic cycle for the current position of the device, instead of calling the ForceFeedback"))
+    , d_localContactMaxIterations(initData(&d_localContactMaxIterations, 100, "localContactMaxIterations", "Gauss-Seidel iterations of the local contact solver per haptic cycle at most"))
+    , d_localContactTolerance(initData(&d_localContactTolerance, 1e-6, "localContactTolerance", "Sum of the changes of the contact forces below which the local contact solver stops iterating"))
     , l_iboxCtrl(initLink("iboxController", "link to IBoxController"))
     , m_iboxCtrl(nullptr)
+    , m_extrapolateForce(false)
+    , m_hapticMaxOpeningAngle(60.0)
+    , m_solveContactsLocally(false)
+    , m_constraintSolver(nullptr)
+    , m_articulationState(nullptr)
+    , m_contactStep(0)
+    , m_stepTime(0.0)
+    , m_contactOverflowReported(false)
 {
     this->f_listening.setValue(true);
     
@@ -54,6 +71,8 @@ HapticAvatar_GrasperDeviceController::HapticAvatar_GrasperDeviceController()
     articulations[4] = 0;
     articulations[5] = 0;
     d_toolPosition.endEdit();
+
+    m_hapticForces.resize(6);
 }
 
 
@@ -80,14 +99,61 @@ void HapticAvatar_GrasperDeviceController::initImpl()
     {
         msg_warning() << "ForceFeedback not found";
     }
+    else if (d_localContactSolver.getValue())
+    {
+        // the contacts are taken from the constraint solver and articulations the ForceFeedback works with
+        m_articulationState = dynamic_cast<sofa::core::behavior::MechanicalState<Vec1Types>*>(m_forceFeedback->getContext()->getMechanicalState());
+        m_constraintSolver = m_forceFeedback->getContext()->get<sofa::component::constraintset::ConstraintSolverImpl>(sofa::core::objectmodel::BaseContext::SearchRoot);
+        if (m_articulationState == nullptr || m_constraintSolver == nullptr)
+        {
+            msg_warning() << "localContactSolver needs the Vec1d articulations of the ForceFeedback and a ConstraintSolver in the scene, the ForceFeedback is used instead.";
+            m_articulationState = nullptr;
+            m_constraintSolver = nullptr;
+        }
+    }
 }
 
 
 bool HapticAvatar_GrasperDeviceController::createHapticThreads()
 {   
+    m_healthSamplePeriod = d_healthSamplePeriod.getValue();
+    m_healthCountdown = m_healthSamplePeriod;
+    if (m_healthSamplePeriod > 0)
+        m_healthMonitor.start(d_portName.getValue());
+
+    m_extrapolateForce = d_forceExtrapolation.getValue();
+    m_hapticMaxOpeningAngle = d_MaxOpeningAngle.getValue();
+    m_extrapolator.setup(d_extrapolationHistory.getValue(), d_extrapolationHorizon.getValue(), d_extrapolationFadeOut.getValue(), d_extrapolationMaxStiffness.getValue());
+    m_solveContactsLocally = (m_constraintSolver != nullptr && m_articulationState != nullptr);
+    m_contactSolver.setup(d_localContactMaxIterations.getValue(), d_localContactTolerance.getValue());
+    if (m_solveContactsLocally && m_extrapolateForce)
+    {
+        msg_warning() << "forceExtrapolation is not used with localContactSolver, the contacts are solved at each haptic cycle.";
+        m_extrapolateForce = false;
+    }
+
+    // the haptic cycle commands the IBox: both are serviced by the same hub, or both by the thread of the device
+    if (m_iboxCtrl != nullptr && m_iboxCtrl->getDeviceHub() != m_deviceHub)
+    {
+        msg_error() << "The device and its IBox " << m_iboxCtrl->getName() << " must be serviced by the same DeviceHub, or neither by one.";
+        return false;
+    }
+
+    if (m_deviceHub)
+    {
+        // a device serviced by the hub is at best at the period of the hub
+        m_telemetry.start(m_deviceHub->d_loopPeriod.getValue(), d_loopJitterTolerance.getValue());
+        // no thread of its own, the cycles are run by the hub after each reply of the device, on the worker of its IBox
+        HapticAvatar_DriverBase* iboxDriver = (m_iboxCtrl != nullptr) ? m_deviceHub->getIboxDriver(m_iboxCtrl->d_portName.getValue()) : nullptr;
+        return m_deviceHub->registerDevice(m_HA_driver, [this]() { hapticCycle(); }, iboxDriver);
+    }
+
     m_terminate = false;
+    m_loopScheduler.setTiming(d_loopPeriod.getValue(), d_loopSpinMargin.getValue(), d_loopSlack.getValue());
+    m_telemetry.start(d_loopPeriod.getValue(), d_loopJitterTolerance.getValue());
+    prepareRealTime();
     haptic_thread = std::thread(Haptics, std::ref(this->m_terminate), this, m_HA_driver);
-    copy_thread = std::thread(CopyData, std::ref(this->m_terminate), this);
+    configureHapticThread(haptic_thread);
 
     return true;
 }
@@ -114,173 +180,243 @@ void HapticAvatar_GrasperDeviceController::Haptics(std::atomic<bool>& terminate,
 
     /// Pointer to the IBoxController component
     HapticAvatar_IBoxController * _iboxCtrl = _deviceCtrl->m_iboxCtrl;
+    HapticAvatar_LoopTelemetry& telemetry = _deviceCtrl->m_telemetry;
 
-    // Loop Timer
-    long targetSpeedLoop = 1; // Target loop speed: 1ms
-
-    // Use computer tick for timer
-    ctime_t refTicksPerMs = CTime::getRefTicksPerSec() / 1000;
-    ctime_t targetTicksPerLoop = targetSpeedLoop * refTicksPerMs;
-
-	auto startSimulationTime = std::chrono::high_resolution_clock::now();
-
-    VecDeriv resForces;
-    resForces.resize(6);
-    int cptLoop = 0;
-    ctime_t startTimePrev = CTime::getRefTime();
-    ctime_t summedLoopDuration = 0;
-	
-	//log file
-	//std::ofstream logFile("HapticAvatarLog.txt");
-	bool contact = false;
+    _deviceCtrl->m_loopScheduler.start();
     while (!terminate)
     {
-        //auto t1 = std::chrono::high_resolution_clock::now();
-        
-        ctime_t startTime = CTime::getRefTime();
-        summedLoopDuration += (startTime - startTimePrev);
-        startTimePrev = startTime;
-
-        // Get all info from devices
-        _deviceCtrl->m_hapticData.anglesAndLength = _driver->getAnglesAndLength();
-        _deviceCtrl->m_hapticData.toolId = _driver->getToolID();
-        //_deviceCtrl->m_hapticData.motorValues = _driver->getLastPWM();
-
-         if (_iboxCtrl)
+        telemetry.beginCycle();
+        _deviceCtrl->hapticCycle();
+
+        _driver->update();
+        telemetry.endPhase(LoopPhase::DriverUpdate);
+        // does nothing if the IBox is serviced by a DeviceHub
+        if (_iboxCtrl)
         {
-            float angle = _iboxCtrl->getJawOpeningAngle(_deviceCtrl->m_hapticData.toolId);
-            _deviceCtrl->m_hapticData.jawOpening = angle;
+            _iboxCtrl->update();
+            telemetry.endPhase(LoopPhase::IBoxUpdate);
         }
+        telemetry.endCycle();
 
-        // Force feedback computation
-        if (_deviceCtrl->m_simulationStarted && _deviceCtrl->m_forceFeedback)
-        {
-            const HapticAvatar_GrasperDeviceController::VecCoord& articulations = _deviceCtrl->d_toolPosition.getValue();
-            _deviceCtrl->m_forceFeedback->computeForce(articulations, resForces);
+        // Sleep until the next deadline, spinning only for its last microseconds
+        _deviceCtrl->m_loopScheduler.waitNextCycle();
+    }
 
-            /// ** resForces: **             
-            /// articulations[0] => dofV[Dof::YAW];
-            /// articulations[1] => -dofV[Dof::PITCH];
-            /// articulations[2] => dofV[Dof::ROT];
-            /// articulations[3] => dofV[Dof::Z];
+    // ensure no force
+    _driver->releaseForce();
+    std::cout << "Haptics thread END!!" << std::endl;
+}
 
-            /// articulations[4] => Grasper up
-            /// articulations[5] => Grasper Down 
 
-            //_driver->setManualPWM(float(-resForces[2][0]), float(-resForces[1][0]), float(resForces[3][0]), float(-resForces[0][0]));
-            _driver->setMotorForceAndTorques(-resForces[2][0], resForces[1][0], resForces[3][0], -resForces[0][0]);
+void HapticAvatar_GrasperDeviceController::hapticCycle()
+{
+    HapticAvatar_DriverPort* _driver = m_HA_driver;
+    HapticAvatar_IBoxController* _iboxCtrl = m_iboxCtrl;
+
+    // the cycles run by the hub start here, its driver updates are not part of the phases of the device
+    if (m_deviceHub)
+        m_telemetry.beginCycle();
+
+    // Get all info from devices. The angles keep their value and time if no newer sample has been received since the last cycle,
+    // they are requested only if the driver has none yet, e.g. if they are not subscribed to.
+    if (!_driver->getAnglesAndLengthIfNewer(m_hapticData.anglesAndLength, m_hapticData.sequence) && m_hapticData.sequence == 0)
+        m_hapticData.anglesAndLength = _driver->getAnglesAndLength();
+    m_hapticData.timestamp = _driver->getAnglesAndLengthTime();
+    m_hapticData.toolId = _driver->getToolID();
+    //m_hapticData.motorValues = _driver->getLastPWM();
+    m_telemetry.endPhase(LoopPhase::DriverRead);
+
+    if (_iboxCtrl)
+    {
+        float angle = _iboxCtrl->getJawOpeningAngle(m_hapticData.toolId);
+        m_hapticData.jawOpening = angle;
+        m_telemetry.endPhase(LoopPhase::IBoxRead);
+    }
+    // make the sample available to the simulation thread
+    m_deviceData.publish(m_hapticData);
 
-            if (_iboxCtrl)
+    // Force feedback computation
+    if (m_simulationStarted && m_forceFeedback && fetchArticulations(m_hapticArticulations, m_hapticSnapshot))
+    {
+        if (m_solveContactsLocally)
+        {
+            // the contact set of the last step is kept until the next one is published
+            m_contactProblems.fetch(m_contactSolver.getProblem());
+
+            const unsigned int nbrDofs = m_contactSolver.getProblem().numDofs;
+            SReal deviceArticulations[MAX_ARTICULATIONS] = {};
+            computeArticulations(m_hapticData, m_hapticMaxOpeningAngle, deviceArticulations);
+            double positions[LOCAL_CONTACT_MAX_DOFS];
+            double forces[LOCAL_CONTACT_MAX_DOFS];
+            for (unsigned int i = 0; i < nbrDofs; i++)
+                positions[i] = (i < MAX_ARTICULATIONS) ? deviceArticulations[i] : 0.0;
+            m_contactSolver.solve(positions, forces);
+            for (unsigned int i = 0; i < m_hapticForces.size(); i++)
+                m_hapticForces[i][0] = (i < nbrDofs) ? forces[i] : 0.0;
+        }
+        else if (!m_extrapolateForce)
+        {
+            m_forceFeedback->computeForce(m_hapticArticulations, m_hapticForces);
+        }
+        else
+        {
+            // the force of the simulation only changes at each step: computed once per step, then extrapolated from the motion of the device
+            const unsigned int nbrArticulations = (unsigned int)(m_hapticArticulations.size() < MAX_ARTICULATIONS ? m_hapticArticulations.size() : MAX_ARTICULATIONS);
+            double positions[MAX_ARTICULATIONS];
+            double forces[MAX_ARTICULATIONS];
+            if (m_hapticSnapshot.step != m_extrapolator.getLastStep())
             {
-                // TODO: implement Grasper ForceFeedback here, should be a conversion from 1D angular constraint into force
-                float jaw_momentum_arm = 25.0f * sin(0.38f + _deviceCtrl->m_hapticData.jawOpening);
-                float handleForce = (resForces[4][0] - resForces[5][0]) / jaw_momentum_arm; // in Newtons
-
-                _iboxCtrl->setHandleForce(_deviceCtrl->m_hapticData.toolId, handleForce*3);
-                //if (cptLoop == 50)
-                //{
-                //    std::cout << "handleForce (toolId=" << _deviceCtrl->m_hapticData.toolId << ") " << handleForce << std::endl;
-                //    cptLoop = 0;
-                //}
-            }
-
-            //if (cptLoop == 50)
-            //{
-            //    std::cout << "resForces: " << resForces << std::endl;
-            //    cptLoop = 0;
-            //}
-
-            cptLoop++;
-            if (cptLoop % 1000 == 0) {
-                float updateFreq = 1000*1000 / ((float)summedLoopDuration / (float) refTicksPerMs); // in Hz
-                std::cout << "Average haptic loop frequency " << std::to_string(int(updateFreq)) << std::endl;
-                summedLoopDuration = 0;
-            }
-            if (cptLoop % 30000 == 0) {
-                _driver->printStatus();
+                m_forceFeedback->computeForce(m_hapticArticulations, m_hapticForces);
+                for (unsigned int i = 0; i < nbrArticulations; i++)
+                {
+                    positions[i] = m_hapticArticulations[i][0];
+                    forces[i] = (i < m_hapticForces.size()) ? m_hapticForces[i][0] : 0.0;
+                }
+                m_extrapolator.addSample(m_hapticSnapshot.step, positions, forces, nbrArticulations, m_hapticData.timestamp);
             }
 
+            SReal deviceArticulations[MAX_ARTICULATIONS] = {};
+            computeArticulations(m_hapticData, m_hapticMaxOpeningAngle, deviceArticulations);
+            for (unsigned int i = 0; i < nbrArticulations; i++)
+                positions[i] = deviceArticulations[i];
+            m_extrapolator.evaluate(positions, m_hapticData.timestamp, forces);
+            for (unsigned int i = 0; i < nbrArticulations && i < m_hapticForces.size(); i++)
+                m_hapticForces[i][0] = forces[i];
         }
-        else
-            _driver->releaseForce();
 
-        _driver->update();
-        _iboxCtrl->update();
-
-        ctime_t endTime = CTime::getRefTime();
-        ctime_t duration = endTime - startTime;
-		
-		//contact = false;
-		//for (int i = 0; i < 6; i++)
-		//{
-		//	if (resForces[i][0] != 0.0)
-		//	{
-		//		contact = true;
-		//		break;
-		//	}
-		//}
-		//if (contact)
-		//{
-		//	auto currentTime = std::chrono::high_resolution_clock::now();
-		//	auto timeSinceStart = std::chrono::duration_cast<std::chrono::microseconds>(currentTime - startSimulationTime);
-
-		//	if (logFile.is_open())
-		//	{
-		//		logFile << timeSinceStart.count() << " ";
-		//		logFile << contact << " "; 
-		//		logFile << duration * 1000 / refTicksPerMs << " ";
-		//		logFile << resForces << std::endl;
-		//	}
-		//}
-
-		
-        // If loop is quicker than the target loop speed. Wait here.
-        //duration = 0;
-        while (duration < targetTicksPerLoop)
+        /// ** resForces: **             
+        /// articulations[0] => dofV[Dof::YAW];
+        /// articulations[1] => -dofV[Dof::PITCH];
+        /// articulations[2] => dofV[Dof::ROT];
+        /// articulations[3] => dofV[Dof::Z];
+
+        /// articulations[4] => Grasper up
+        /// articulations[5] => Grasper Down 
+
+        const VecDeriv& resForces = m_hapticForces;
+        //_driver->setManualPWM(float(-resForces[2][0]), float(-resForces[1][0]), float(resForces[3][0]), float(-resForces[0][0]));
+        _driver->setMotorForceAndTorques(-resForces[2][0], resForces[1][0], resForces[3][0], -resForces[0][0]);
+
+        if (_iboxCtrl)
         {
-            endTime = CTime::getRefTime();
-            duration = endTime - startTime;
+            // TODO: implement Grasper ForceFeedback here, should be a conversion from 1D angular constraint into force
+            float jaw_momentum_arm = 25.0f * sin(0.38f + m_hapticData.jawOpening);
+            float handleForce = (resForces[4][0] - resForces[5][0]) / jaw_momentum_arm; // in Newtons
+
+            _iboxCtrl->setHandleForce(m_hapticData.toolId, handleForce*3);
         }
     }
-	//logFile.close();
+    else
+        _driver->releaseForce();
+    m_telemetry.endPhase(LoopPhase::ComputeForce);
 
-    // ensure no force
-    _driver->releaseForce();
-    std::cout << "Haptics thread END!!" << std::endl;
+    // diagnostics already received, reported by the health channel off this thread
+    sampleHealth();
+
+    if (m_deviceHub)
+        m_telemetry.endCycle();
 }
 
 
-void HapticAvatar_GrasperDeviceController::CopyData(std::atomic<bool>& terminate, void * p_this)
+void HapticAvatar_GrasperDeviceController::publishContactProblem()
 {
-    HapticAvatar_GrasperDeviceController* _deviceCtrl = static_cast<HapticAvatar_GrasperDeviceController*>(p_this);
-    
-    // Use computer tick for timer
-    ctime_t targetSpeedLoop = 1/2; // Target loop speed: 0.5ms
-    ctime_t refTicksPerMs = CTime::getRefTicksPerSec() / 1000;
-    ctime_t targetTicksPerLoop = targetSpeedLoop * refTicksPerMs;
-    double speedTimerMs = 1000 / double(CTime::getRefTicksPerSec());
-
-    ctime_t lastTime = CTime::getRefTime();
-    std::cout << "refTicksPerMs: " << refTicksPerMs << " targetTicksPerLoop: " << targetTicksPerLoop << std::endl;
-    int cptLoop = 0;
-    // Haptics Loop
-    while (!terminate)
+    typedef Vec1Types::MatrixDeriv MatrixDeriv;
+
+    HapticAvatar_LocalContactSolver::Problem& problem = m_simContactProblem;
+    problem.numConstraints = 0;
+    problem.mu = 0.0;
+    problem.step = ++m_contactStep;
+    problem.forceCoef = m_forceFeedback->forceCoef.getValue();
+
+    const VecCoord& freePositions = m_articulationState->read(core::ConstVecCoordId::freePosition())->getValue();
+    problem.numDofs = (unsigned int)(freePositions.size() < LOCAL_CONTACT_MAX_DOFS ? freePositions.size() : LOCAL_CONTACT_MAX_DOFS);
+    for (unsigned int k = 0; k < problem.numDofs; k++)
+        problem.freePositions[k] = freePositions[k][0];
+
+    sofa::component::constraintset::ConstraintProblem* constraintProblem = m_constraintSolver->getConstraintProblem();
+    const unsigned int dimension = (constraintProblem != nullptr) ? constraintProblem->getDimension() : 0;
+    if (dimension > 0)
     {
-        ctime_t startTime = CTime::getRefTime();
-        _deviceCtrl->m_simuData = _deviceCtrl->m_hapticData;
+        sofa::component::constraintset::LCPConstraintProblem* lcp = dynamic_cast<sofa::component::constraintset::LCPConstraintProblem*>(constraintProblem);
+        problem.mu = (lcp != nullptr) ? lcp->mu : 0.0;
+        // with friction the constraints are triples normal, tangent, tangent, kept together
+        const unsigned int blockSize = (problem.mu > 0.0) ? 3 : 1;
+
+        // index in the whole problem of each constraint acting on the articulations
+        unsigned int indices[LOCAL_CONTACT_MAX_CONSTRAINTS];
+        const MatrixDeriv& jacobian = m_articulationState->read(core::ConstMatrixDerivId::constraintJacobian())->getValue();
+        for (MatrixDeriv::RowConstIterator rowIt = jacobian.begin(); rowIt != jacobian.end(); ++rowIt)
+        {
+            const unsigned int index = (unsigned int)(rowIt.index());
+            const unsigned int first = index - index % blockSize;
+            if (first + blockSize > dimension)
+                continue;
 
-        ctime_t endTime = CTime::getRefTime();
-        ctime_t duration = endTime - startTime;
+            unsigned int local = 0;
+            while (local < problem.numConstraints && indices[local] != first)
+                local += blockSize;
 
-        // If loop is quicker than the target loop speed. Wait here.
-        while (duration < targetTicksPerLoop)
+            if (local == problem.numConstraints)
+            {
+                if (local + blockSize > LOCAL_CONTACT_MAX_CONSTRAINTS)
+                {
+                    if (!m_contactOverflowReported)
+                    {
+                        msg_warning() << "More than " << LOCAL_CONTACT_MAX_CONSTRAINTS << " constraints on the articulations, the others are left out of the local contact solver.";
+                        m_contactOverflowReported = true;
+                    }
+                    continue;
+                }
+
+                for (unsigned int r = 0; r < blockSize; r++)
+                {
+                    indices[local + r] = first + r;
+                    for (unsigned int k = 0; k < LOCAL_CONTACT_MAX_DOFS; k++)
+                        problem.J[local + r][k] = 0.0;
+                }
+                problem.numConstraints += blockSize;
+            }
+
+            const unsigned int row = local + index - first;
+            for (MatrixDeriv::ColConstIterator colIt = rowIt.begin(); colIt != rowIt.end(); ++colIt)
+            {
+                if (colIt.index() < problem.numDofs)
+                    problem.J[row][colIt.index()] += colIt.val()[0];
+            }
+        }
+
+        // compliance block, free violation and solution of the step for these constraints
+        double** W = constraintProblem->getW();
+        const double* dFree = constraintProblem->getDfree();
+        const double* f = constraintProblem->getF();
+        for (unsigned int i = 0; i < problem.numConstraints; i++)
         {
-            endTime = CTime::getRefTime();
-            duration = endTime - startTime;
+            for (unsigned int j = 0; j < problem.numConstraints; j++)
+                problem.W[i][j] = W[indices[i]][indices[j]];
+            problem.dFree[i] = dFree[indices[i]];
+            problem.f[i] = f[indices[i]];
         }
     }
+
+    m_contactProblems.publish(problem);
+}
+
+
+void HapticAvatar_GrasperDeviceController::computeArticulations(const DeviceData& data, SReal maxOpeningAngle, SReal* articulations)
+{
+    const sofa::type::fixed_array<float, 4>& dofV = data.anglesAndLength;
+    //std::cout << "YAW: " << dofV[Dof::YAW] << " | PITCH: " << dofV[Dof::PITCH] << " | ROT: " << dofV[Dof::ROT] << " | Z: " << dofV[Dof::Z] << std::endl;
+    articulations[0] = dofV[Dof::YAW];
+    articulations[1] = -dofV[Dof::PITCH];
+    articulations[2] = dofV[Dof::ROT];
+    articulations[3] = dofV[Dof::Z];
+
+    float _OpeningAngle = data.jawOpening * maxOpeningAngle * 0.01f;
+    articulations[4] = _OpeningAngle;
+    articulations[5] = -_OpeningAngle;
 }
 
+
 void HapticAvatar_GrasperDeviceController::updatePositionImpl()
 {
     if (!m_HA_driver)
@@ -289,18 +425,12 @@ void HapticAvatar_GrasperDeviceController::updatePositionImpl()
     //std::cout << "updatePositionImpl" << std::endl;
 
     // get info from simuData
-    sofa::type::fixed_array<float, 4> dofV = m_simuData.anglesAndLength;
+    SReal values[6];
+    computeArticulations(m_simuData, d_MaxOpeningAngle.getValue(), values);
 
     VecCoord & articulations = *d_toolPosition.beginEdit();
-    //std::cout << "YAW: " << dofV[Dof::YAW] << " | PITCH: " << dofV[Dof::PITCH] << " | ROT: " << dofV[Dof::ROT] << " | Z: " << dofV[Dof::Z] << std::endl;
-    articulations[0] = dofV[Dof::YAW];
-    articulations[1] = -dofV[Dof::PITCH];
-    articulations[2] = dofV[Dof::ROT];
-    articulations[3] = dofV[Dof::Z];
-
-    float _OpeningAngle = m_simuData.jawOpening * d_MaxOpeningAngle.getValue() * 0.01f;
-    articulations[4] = _OpeningAngle;
-    articulations[5] = -_OpeningAngle;
+    for (unsigned int i = 0; i < 6; i++)
+        articulations[i] = values[i];
 
     d_toolPosition.endEdit();
 }
@@ -314,7 +444,20 @@ void HapticAvatar_GrasperDeviceController::handleEvent(core::objectmodel::Event
     if (dynamic_cast<sofa::simulation::AnimateBeginEvent *>(event))
     {
         m_simulationStarted = true;
+        m_stepTime = this->getContext()->getTime();
+        m_deviceData.fetch(m_simuData);
         updatePositionImpl();
+        updateCommandStats();
+        updateLoopStats();
+    }
+    else if (dynamic_cast<sofa::simulation::AnimateEndEvent *>(event))
+    {
+        // hand the articulations of this step over to the haptic thread, now that the force feedback holds the constraints solved for them
+        if (m_simulationStarted)
+            publishArticulations(d_toolPosition.getValue(), m_stepTime);
+
+        if (m_constraintSolver != nullptr && m_articulationState != nullptr)
+            publishContactProblem();
     }
 }
 
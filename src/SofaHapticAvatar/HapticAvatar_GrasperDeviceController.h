@@ -8,6 +8,10 @@
 
 #include <SofaHapticAvatar/HapticAvatar_ArticulatedDeviceController.h>
 #include <SofaHapticAvatar/HapticAvatar_IBoxController.h>
+#include <SofaHapticAvatar/HapticAvatar_ForceExtrapolator.h>
+#include <SofaHapticAvatar/HapticAvatar_LocalContactSolver.h>
+#include <SofaConstraint/ConstraintSolverImpl.h>
+#include <sofa/core/behavior/MechanicalState.h>
 
 namespace sofa::HapticAvatar
 {
@@ -32,16 +36,22 @@ public:
     /// General Haptic thread methods
     static void Haptics(std::atomic<bool>& terminate, void * p_this, void * p_driver);
 
-    /// Thread methods to cpy data from m_hapticData to m_simuData
-    static void CopyData(std::atomic<bool>& terminate, void * p_this);
-
 protected:
     /// Internal method to init specific collision components
     void initImpl() override;
 
-    /// override method to create the different threads
+    /// override method to create the different threads, or to register the device in the DeviceHub if linked
     bool createHapticThreads() override;
 
+    /// One cycle of the haptic loop: sample the device and compute the force feedback. Run by @sa Haptics or by the DeviceHub thread
+    void hapticCycle();
+
+    /// Copy the constraints of the last step acting on the articulations for the local contact solver of the haptic thread. Simulation thread only
+    void publishContactProblem();
+
+    /// Compute the articulations of the tool from the values sampled on the devices, @param maxOpeningAngle as in @sa d_MaxOpeningAngle
+    static void computeArticulations(const DeviceData& data, SReal maxOpeningAngle, SReal* articulations);
+
     /// override method to update specific tool position
     void updatePositionImpl() override;
 
@@ -54,10 +64,50 @@ public:
 
     /// Max opening angle of the Jaws
     Data<SReal> d_MaxOpeningAngle;
+    /// Extrapolate the force feedback between simulation steps from the motion of the device, instead of holding the force of the last step
+    Data<bool> d_forceExtrapolation;
+    /// Number of simulation steps the response of each articulation is fitted on
+    Data<int> d_extrapolationHistory;
+    /// Time in milliseconds after the last simulation step during which the force is extrapolated
+    Data<double> d_extrapolationHorizon;
+    /// Time in milliseconds after the horizon over which the force fades out to zero if no simulation step comes
+    Data<double> d_extrapolationFadeOut;
+    /// Bound of the fitted stiffness of each articulation, no bound if 0
+    Data<double> d_extrapolationMaxStiffness;
+    /// Solve the contacts of the last simulation step again at each haptic cycle for the current position of the device, instead of calling the ForceFeedback
+    Data<bool> d_localContactSolver;
+    /// Gauss-Seidel iterations of the local contact solver per haptic cycle at most
+    Data<int> d_localContactMaxIterations;
+    /// Sum of the changes of the contact forces below which the local contact solver stops iterating
+    Data<double> d_localContactTolerance;
 
 protected:
     /// Pointer to the IBoxController component
     HapticAvatar_IBoxController * m_iboxCtrl;
+
+    /// Data belonging to the haptic thread only, used by @sa hapticCycle
+    VecDeriv m_hapticForces;
+    /// articulations handed over by the simulation thread, the haptic thread never reads d_toolPosition
+    VecCoord m_hapticArticulations;
+    ArticulationSnapshot m_hapticSnapshot;
+    /// extrapolation of the force between simulation steps, set from the Data when the haptic thread starts
+    HapticAvatar_ForceExtrapolator m_extrapolator;
+    bool m_extrapolateForce;
+    SReal m_hapticMaxOpeningAngle;
+    /// contacts of the last step solved again at each haptic cycle, set from the Data when the haptic thread starts
+    HapticAvatar_LocalContactSolver m_contactSolver;
+    bool m_solveContactsLocally;
+
+    /// Simulation thread side of the local contact solver: the solver and articulations of the ForceFeedback, and the problem copied at each step
+    sofa::component::constraintset::ConstraintSolverImpl* m_constraintSolver;
+    sofa::core::behavior::MechanicalState<Vec1Types>* m_articulationState;
+    HapticAvatar_LocalContactSolver::Problem m_simContactProblem;
+    uint64_t m_contactStep;
+    /// simulation time at the beginning of the step in progress
+    double m_stepTime;
+    bool m_contactOverflowReported;
+    /// contacts handed over to the haptic thread at each step
+    HapticAvatar_TripleBuffer<HapticAvatar_LocalContactSolver::Problem> m_contactProblems;
 };
 
 } // namespace sofa::HapticAvatar
@@ -0,0 +1,257 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_HealthMonitor.h>
+#include <sofa/helper/logging/Messaging.h>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace sofa::HapticAvatar
+{
+
+    // status word of the Port devices
+    static const unsigned int AMPLIFIER_TEMPERATURE_BITS[3] = { 0x80, 0x20, 0x10 };
+    static const unsigned int AMPLIFIER_UNDERVOLTAGE_BITS[3] = { 0x800, 0x200, 0x100 };
+    static const unsigned int CALIBRATED_BITS[2] = { 0x08, 0x02 };
+    // winding temperatures above which the device reduces its output
+    static const float MOTOR_TEMPERATURE_LIMITS[4] = { 135.0f, 135.0f, 105.0f, 85.0f };
+
+    static const int NUM_AXES[4] = { 3, 3, 4, 2 };
+    static const int FIRST_BIT[4] = { 0, 3, 6, 10 };
+    static const char* const TYPE_NAMES[4] = { "amplifier temperature", "amplifier undervoltage", "motor temperature", "not calibrated" };
+    static const char* const AMPLIFIER_NAMES[3] = { "Yaw", "Pitch", "Z or Rot" };
+    static const char* const MOTOR_NAMES[4] = { "Yaw", "Pitch", "Z", "Rot" };
+
+    // the consumer thread is not real-time, it only checks the queue from time to time
+    static const std::chrono::milliseconds CONSUMER_PERIOD(50);
+
+
+    HapticAvatar_HealthMonitor::HapticAvatar_HealthMonitor()
+        : m_conditions(0)
+        , m_sampled(false)
+        , m_terminate(false)
+        , m_hasSample(false)
+        , m_activeConditions(0)
+    {
+
+    }
+
+
+    HapticAvatar_HealthMonitor::~HapticAvatar_HealthMonitor()
+    {
+        stop();
+    }
+
+
+    void HapticAvatar_HealthMonitor::start(const std::string& deviceName)
+    {
+        stop();
+
+        m_deviceName = deviceName;
+        m_conditions = 0;
+        m_sampled = false;
+        m_terminate = false;
+        m_thread = std::thread(&HapticAvatar_HealthMonitor::run, this);
+    }
+
+
+    void HapticAvatar_HealthMonitor::stop()
+    {
+        if (!m_thread.joinable())
+            return;
+
+        m_terminate = true;
+        m_thread.join();
+    }
+
+
+    void HapticAvatar_HealthMonitor::sample(const HealthSample& sample)
+    {
+        m_samples.publish(sample);
+
+        const uint32_t conditions = decode(sample);
+        // the first sample reports the conditions already active, the next ones only the changes
+        const uint32_t changes = m_sampled ? (conditions ^ m_conditions) : conditions;
+        m_conditions = conditions;
+        m_sampled = true;
+        if (changes == 0)
+            return;
+
+        HealthEvent event;
+        event.time = std::chrono::steady_clock::now();
+        for (int type = 0; type < 4; type++)
+        {
+            for (int axis = 0; axis < NUM_AXES[type]; axis++)
+            {
+                const uint32_t bit = 1u << conditionBit(HealthEventType(type), axis);
+                if ((changes & bit) == 0)
+                    continue;
+
+                event.type = HealthEventType(type);
+                event.axis = axis;
+                event.active = (conditions & bit) != 0;
+                event.value = (event.type == HealthEventType::MotorTemperature) ? sample.motorTemperatures[axis] : 0.0f;
+                m_events.push(event);
+            }
+        }
+    }
+
+
+    uint32_t HapticAvatar_HealthMonitor::decode(const HealthSample& sample)
+    {
+        uint32_t conditions = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (sample.status & AMPLIFIER_TEMPERATURE_BITS[axis])
+                conditions |= 1u << conditionBit(HealthEventType::AmplifierTemperature, axis);
+            if (sample.status & AMPLIFIER_UNDERVOLTAGE_BITS[axis])
+                conditions |= 1u << conditionBit(HealthEventType::AmplifierUndervoltage, axis);
+        }
+        for (int axis = 0; axis < 4; axis++)
+        {
+            // false if the temperature is not subscribed to, i.e. NaN
+            if (sample.motorTemperatures[axis] > MOTOR_TEMPERATURE_LIMITS[axis])
+                conditions |= 1u << conditionBit(HealthEventType::MotorTemperature, axis);
+        }
+        for (int axis = 0; axis < 2; axis++)
+        {
+            if ((sample.status & CALIBRATED_BITS[axis]) == 0)
+                conditions |= 1u << conditionBit(HealthEventType::NotCalibrated, axis);
+        }
+        return conditions;
+    }
+
+
+    unsigned int HapticAvatar_HealthMonitor::conditionBit(HealthEventType type, int axis)
+    {
+        return unsigned(FIRST_BIT[int(type)] + axis);
+    }
+
+
+    void HapticAvatar_HealthMonitor::run()
+    {
+        HealthEvent event;
+        HealthSample sample;
+        bool done = false;
+        while (!done)
+        {
+            // one last pass once asked to stop, for the events queued in the meantime
+            done = m_terminate;
+
+            while (m_events.pop(event))
+                report(event);
+
+            if (m_samples.fetch(sample))
+            {
+                std::lock_guard<std::mutex> lock(m_reportMutex);
+                m_lastSample = sample;
+                m_hasSample = true;
+            }
+
+            if (!done)
+                std::this_thread::sleep_for(CONSUMER_PERIOD);
+        }
+    }
+
+
+    void HapticAvatar_HealthMonitor::report(const HealthEvent& event)
+    {
+        std::ostringstream oss;
+        oss << getAxisName(event.type, event.axis) << " " << getTypeName(event.type);
+        if (event.type == HealthEventType::MotorTemperature)
+            oss << " " << std::fixed << std::setprecision(1) << event.value << " C, output reduced";
+        oss << (event.active ? "" : " cleared");
+
+        if (event.active)
+            msg_warning("HapticAvatar_HealthMonitor") << m_deviceName << ": " << oss.str();
+        else
+            msg_info("HapticAvatar_HealthMonitor") << m_deviceName << ": " << oss.str();
+
+        std::lock_guard<std::mutex> lock(m_reportMutex);
+        const uint32_t bit = 1u << conditionBit(event.type, event.axis);
+        if (event.active)
+            m_activeConditions |= bit;
+        else
+            m_activeConditions &= ~bit;
+
+        m_eventLog.push_back(oss.str());
+        if (m_eventLog.size() > HEALTH_EVENT_LOG_SIZE)
+            m_eventLog.pop_front();
+    }
+
+
+    std::string HapticAvatar_HealthMonitor::getReport() const
+    {
+        std::lock_guard<std::mutex> lock(m_reportMutex);
+        std::ostringstream oss;
+        if (!m_hasSample)
+        {
+            oss << "no diagnostics received yet\n";
+        }
+        else
+        {
+            oss << std::fixed << std::setprecision(1)
+                << "board " << m_lastSample.boardTemperature << " C, battery " << m_lastSample.batteryVoltage << " V, charging "
+                << std::setprecision(2) << m_lastSample.chargingCurrent << " A\n" << std::setprecision(1) << "motors";
+            for (int axis = 0; axis < 4; axis++)
+                oss << " " << MOTOR_NAMES[axis] << " " << m_lastSample.motorTemperatures[axis] << " C";
+            oss << "\n";
+        }
+
+        oss << "active:";
+        bool none = true;
+        for (int type = 0; type < 4; type++)
+        {
+            for (int axis = 0; axis < NUM_AXES[type]; axis++)
+            {
+                if (m_activeConditions & (1u << conditionBit(HealthEventType(type), axis)))
+                {
+                    oss << (none ? " " : ", ") << getAxisName(HealthEventType(type), axis) << " " << getTypeName(HealthEventType(type));
+                    none = false;
+                }
+            }
+        }
+        oss << (none ? " none\n" : "\n");
+
+        for (const std::string& line : m_eventLog)
+            oss << "  " << line << "\n";
+        if (getDroppedEvents() > 0)
+            oss << getDroppedEvents() << " events dropped\n";
+        return oss.str();
+    }
+
+
+    const char* HapticAvatar_HealthMonitor::getTypeName(HealthEventType type)
+    {
+        return TYPE_NAMES[int(type)];
+    }
+
+
+    const char* HapticAvatar_HealthMonitor::getAxisName(HealthEventType type, int axis)
+    {
+        if (axis < 0 || axis >= NUM_AXES[int(type)])
+            return "";
+        return (type == HealthEventType::MotorTemperature || type == HealthEventType::NotCalibrated) ? MOTOR_NAMES[axis] : AMPLIFIER_NAMES[axis];
+    }
+
+} // namespace sofa::HapticAvatar
@@ -0,0 +1,128 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <SofaHapticAvatar/HapticAvatar_SpscRing.h>
+#include <SofaHapticAvatar/HapticAvatar_TripleBuffer.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace sofa::HapticAvatar
+{
+
+#define HEALTH_EVENT_QUEUE_SIZE 64
+#define HEALTH_EVENT_LOG_SIZE 16
+
+    /// Diagnostics of a Port device as last received, see @sa HapticAvatar_DriverPort::sampleHealth. Values not subscribed to are NaN
+    struct HealthSample
+    {
+        unsigned int status = 0;          ///< status word of the device
+        float boardTemperature = 0.0f;    ///< amplifier board, in degrees Celsius
+        float batteryVoltage = 0.0f;      ///< fully charged 16.8V, exhausted below 12.0V
+        float chargingCurrent = 0.0f;     ///< set current of the USB charge, in Amps
+        float motorTemperatures[4] = { 0.0f, 0.0f, 0.0f, 0.0f }; ///< simulated winding temperatures of the Yaw, Pitch, Z and Rot motors
+    };
+
+    enum class HealthEventType : int
+    {
+        AmplifierTemperature = 0,  ///< temperature warning of the Yaw, Pitch or Z and Rot amplifier
+        AmplifierUndervoltage,     ///< undervoltage warning of the Yaw, Pitch or Z and Rot amplifier
+        MotorTemperature,          ///< winding of the Yaw, Pitch, Z or Rot motor hot enough for the device to reduce its output
+        NotCalibrated              ///< Yaw or Pitch not calibrated
+    };
+
+    /// Change of a condition decoded from the diagnostics of a device
+    struct HealthEvent
+    {
+        HealthEventType type = HealthEventType::AmplifierTemperature;
+        int axis = 0;        ///< index in the axes of the type, see @sa HapticAvatar_HealthMonitor::getAxisName
+        bool active = false; ///< true when the condition appears, false when it clears
+        float value = 0.0f;  ///< temperature for the temperature conditions, 0 otherwise
+        std::chrono::steady_clock::time_point time;
+    };
+
+    /**
+    * Health channel of a device. The haptic thread hands the diagnostics already received over with @sa sample: the status bitfields are
+    * decoded and each condition appearing or clearing is pushed as a @sa HealthEvent in a wait-free queue. No request, lock, allocation nor I/O
+    * on the haptic thread. A consumer thread of normal priority drains the queue, reports the events in the log and keeps a text report
+    * of the last diagnostics and events for the components.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_HealthMonitor
+    {
+    public:
+        HapticAvatar_HealthMonitor();
+        ~HapticAvatar_HealthMonitor();
+
+        /// Start the consumer thread, the events are reported as coming from @param deviceName. To be called before the haptic thread samples.
+        void start(const std::string& deviceName);
+
+        /// Stop the consumer thread once it has reported the events left in the queue.
+        void stop();
+
+        /// Haptic thread side: decode @param sample and queue the changes since the previous one. Only to be called from one thread.
+        void sample(const HealthSample& sample);
+
+        /// Diagnostics last sampled, active conditions and last events. Not to be called from the haptic thread.
+        std::string getReport() const;
+
+        /// Number of events dropped because the consumer was late, can be read from any thread.
+        uint64_t getDroppedEvents() const { return m_events.getDropped(); }
+
+        static const char* getTypeName(HealthEventType type);
+        static const char* getAxisName(HealthEventType type, int axis);
+
+    protected:
+        /// Consumer thread loop
+        void run();
+        /// Log @param event and add it to the report
+        void report(const HealthEvent& event);
+
+        /// Conditions decoded from a sample, one bit per type and axis
+        static uint32_t decode(const HealthSample& sample);
+        static unsigned int conditionBit(HealthEventType type, int axis);
+
+        // haptic thread only
+        uint32_t m_conditions;
+        bool m_sampled;
+
+        HapticAvatar_SpscRing<HealthEvent, HEALTH_EVENT_QUEUE_SIZE> m_events;
+        HapticAvatar_TripleBuffer<HealthSample> m_samples;
+
+        std::string m_deviceName;
+        std::thread m_thread;
+        std::atomic<bool> m_terminate;
+
+        // consumer side, read by getReport
+        mutable std::mutex m_reportMutex;
+        HealthSample m_lastSample;
+        bool m_hasSample;
+        uint32_t m_activeConditions;
+        std::deque<std::string> m_eventLog;
+    };
+
+} // namespace sofa::HapticAvatar
@@ -8,6 +8,8 @@
 #include <SofaHapticAvatar/HapticAvatar_IBoxController.h>
 
 #include <sofa/core/ObjectFactory.h>
+#include <sofa/simulation/AnimateBeginEvent.h>
+#include <sstream>
 
 
 namespace sofa::HapticAvatar
@@ -24,11 +26,19 @@ int HapticAvatar_IBoxControllerClass = core::RegisterObject("Driver allowing int
 HapticAvatar_IBoxController::HapticAvatar_IBoxController()
     : d_portName(initData(&d_portName, std::string("//./COM5"), "portName", "position of the base of the part of the device"))
     , d_hapticIdentity(initData(&d_hapticIdentity, "hapticIdentity", "position of the base of the part of the device"))
+    , d_binaryProtocol(initData(&d_binaryProtocol, false, "binaryProtocol", "Request the compact binary wire protocol, older firmware keep the Ascii protocol"))
+    , d_pipelineDepth(initData(&d_pipelineDepth, 1, "pipelineDepth", "Number of binary frames in flight before waiting for the oldest reply, 1 to wait for each reply"))
+    , d_streamPeriod(initData(&d_streamPeriod, 0, "streamPeriod", "Period in microseconds at which the device pushes the subscribed commands by itself, 0 to request them in each frame (binary protocol only)"))
+    , d_subscriptionProfile(initData(&d_subscriptionProfile, "subscriptionProfile", "XML file listing the commands to subscribe to, their period in cycles and priority lane. Default subscriptions of the device if empty"))
+    , d_cycleByteBudget(initData(&d_cycleByteBudget, 0, "cycleByteBudget", "Number of bytes a cycle can use in each direction of the link, overrides the budget of the subscription profile if positive"))
+    , d_commandStats(initData(&d_commandStats, "commandStats", "Round trip latency of each command sent to the device in microseconds (p50, p99, p99.9, max), requests, bytes and errors, refreshed at each animation step"))
+    , l_deviceHub(initLink("deviceHub", "link to the DeviceHub owning the driver and servicing it from its haptic thread. The IBox is updated by the haptic thread of the tools if not set"))
     , m_HA_driver(nullptr)
+    , m_deviceHub(nullptr)
     , m_deviceReady(false)    
 {
     this->f_listening.setValue(true);
-    
+    d_commandStats.setReadOnly(true);
     
 }
 
@@ -36,11 +46,11 @@ HapticAvatar_IBoxController::HapticAvatar_IBoxController()
 HapticAvatar_IBoxController::~HapticAvatar_IBoxController()
 {
     clearDevice();
-    if (m_HA_driver)
+    if (m_HA_driver && m_deviceHub == nullptr)
     {
         delete m_HA_driver;
-        m_HA_driver = nullptr;
     }
+    m_HA_driver = nullptr;
 }
 
 
@@ -48,9 +58,16 @@ HapticAvatar_IBoxController::~HapticAvatar_IBoxController()
 void HapticAvatar_IBoxController::init()
 {
     msg_info() << "HapticAvatar_IBoxController::init()";
-    m_HA_driver = new HapticAvatar_DriverIbox(d_portName.getValue());
+    if (!l_deviceHub.empty())
+        m_deviceHub = l_deviceHub.get();
+
+    // the driver belongs to the hub if any
+    if (m_deviceHub)
+        m_HA_driver = m_deviceHub->getIboxDriver(d_portName.getValue());
+    else
+        m_HA_driver = new HapticAvatar_DriverIbox(d_portName.getValue());
 
-    if (!m_HA_driver->IsConnected()) {
+    if (m_HA_driver == nullptr || !m_HA_driver->IsConnected()) {
         msg_error() << "HapticAvatar_IBoxController driver creation failed";
         return;
     }
@@ -60,21 +77,50 @@ void HapticAvatar_IBoxController::init()
     d_hapticIdentity.setValue(identity);
     std::cout << "HapticAvatar_IBoxController identity: '" << identity << "'" << std::endl;
 
+    if (d_binaryProtocol.getValue() && !m_HA_driver->setWireProtocol(WireProtocol::Binary))
+    {
+        msg_warning() << "Binary protocol not supported by device at " << d_portName.getValue() << ", using Ascii protocol.";
+    }
+    else if (!m_HA_driver->setPipelineDepth(d_pipelineDepth.getValue()))
+    {
+        msg_warning() << "Invalid pipelineDepth " << d_pipelineDepth.getValue() << ", waiting for each reply.";
+    }
+
+    if (!d_subscriptionProfile.getValue().empty() && !m_HA_driver->loadSubscriptionProfile(d_subscriptionProfile.getFullPath()))
+    {
+        msg_warning() << "Failed to load subscriptionProfile " << d_subscriptionProfile.getValue() << ", using the default subscriptions.";
+    }
+
+    if (d_cycleByteBudget.getValue() > 0)
+        m_HA_driver->setCycleByteBudget(d_cycleByteBudget.getValue());
+
+    if (d_streamPeriod.getValue() > 0 && m_HA_driver->getWireProtocol() == WireProtocol::Binary)
+        m_HA_driver->startStreaming(d_streamPeriod.getValue());
+
     for (int i = 0; i < IBOX_NUM_CHANNELS; i++) {
         setLoopGain(i, 2.5f, 0);
     }
 
+    if (m_deviceHub)
+        m_deviceHub->registerDevice(m_HA_driver);
+
     return;
 }
 
 float HapticAvatar_IBoxController::getJawOpeningAngle(int toolId)
 {
+    if (m_HA_driver == nullptr)
+        return 0.0f;
+
     return m_HA_driver->getOpeningValue(toolId);
 }
 
 
 void HapticAvatar_IBoxController::setHandleForce(int toolId, float force)
 {
+    if (m_HA_driver == nullptr)
+        return;
+
     return m_HA_driver->setForce(toolId, force);
 }
 
@@ -85,12 +131,34 @@ void HapticAvatar_IBoxController::setLoopGain(int chan, float loopGainP, float l
 
 void HapticAvatar_IBoxController::update()
 {
+    // the hub updates the IBox from its own thread
+    if (m_HA_driver == nullptr || m_deviceHub != nullptr)
+        return;
+
     m_HA_driver->update();
 }
 
+void HapticAvatar_IBoxController::updateCommandStats()
+{
+    if (m_HA_driver == nullptr || !m_HA_driver->IsConnected())
+        return;
+
+    std::ostringstream oss;
+    m_HA_driver->printCommandStats(oss);
+    d_commandStats.setValue(oss.str());
+}
+
+void HapticAvatar_IBoxController::handleEvent(core::objectmodel::Event* event)
+{
+    if (dynamic_cast<sofa::simulation::AnimateBeginEvent*>(event))
+        updateCommandStats();
+}
+
 void HapticAvatar_IBoxController::clearDevice()
 {
     msg_info() << "HapticAvatar_IBoxController::clearDevice()";
+    if (m_deviceHub)
+        m_deviceHub->stop();
    
 }
 
@@ -8,8 +8,10 @@
 
 #include <SofaHapticAvatar/config.h>
 #include <SofaHapticAvatar/HapticAvatar_DriverIbox.h>
+#include <SofaHapticAvatar/HapticAvatar_DeviceHub.h>
 
 #include <SofaUserInteraction/Controller.h>
+#include <sofa/core/objectmodel/DataFileName.h>
 
 namespace sofa::HapticAvatar
 {
@@ -33,9 +35,19 @@ public:
 	virtual ~HapticAvatar_IBoxController();
 
     virtual void init() override;
+    void handleEvent(core::objectmodel::Event* event) override;
 
     Data<std::string> d_portName;
     Data<std::string> d_hapticIdentity;
+    Data<bool> d_binaryProtocol;
+    Data<int> d_pipelineDepth;
+    Data<int> d_streamPeriod;
+    sofa::core::objectmodel::DataFileName d_subscriptionProfile;
+    Data<int> d_cycleByteBudget;
+    Data<std::string> d_commandStats;
+
+    /// Link to the DeviceHub owning the driver and servicing it from its haptic thread. The IBox is updated by the haptic thread of the tools if not set
+    SingleLink<HapticAvatar_IBoxController, HapticAvatar_DeviceHub, BaseLink::FLAG_STOREPATH | BaseLink::FLAG_STRONGLINK> l_deviceHub;
 
     float getJawOpeningAngle(int toolId);
 
@@ -43,13 +55,20 @@ public:
 
 	void setLoopGain(int chan, float loopGainP, float loopGainD);
 
+    /// Read data from the IBox and send it new commands. Does nothing if the IBox is serviced by a DeviceHub
     void update();
 
+    /// DeviceHub servicing the IBox, nullptr if none. Valid before the initialization of the controller
+    HapticAvatar_DeviceHub* getDeviceHub() const { return l_deviceHub.get(); }
+
 private:
     void clearDevice();
+    void updateCommandStats();
 
 private:
     HapticAvatar_DriverIbox * m_HA_driver;
+    /// Pointer to the DeviceHub owning @sa m_HA_driver, nullptr if the controller owns it
+    HapticAvatar_DeviceHub * m_deviceHub;
     bool m_deviceReady;
 };
 
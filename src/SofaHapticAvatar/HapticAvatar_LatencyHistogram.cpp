@@ -0,0 +1,116 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_LatencyHistogram.h>
+
+namespace sofa::HapticAvatar
+{
+
+    static constexpr int SUB_BUCKETS = 1 << LATENCY_HISTOGRAM_SUB_BITS;
+
+
+    HapticAvatar_LatencyHistogram::HapticAvatar_LatencyHistogram()
+        : m_count(0)
+        , m_max(0)
+    {
+        reset();
+    }
+
+
+    void HapticAvatar_LatencyHistogram::reset()
+    {
+        for (int i = 0; i < NUM_BUCKETS; i++)
+            m_buckets[i].store(0, std::memory_order_relaxed);
+        m_count.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+
+    void HapticAvatar_LatencyHistogram::record(uint64_t valueUs)
+    {
+        // single writer: plain load and store, no read-modify-write needed
+        std::atomic<uint64_t>& bucket = m_buckets[bucketIndex(valueUs)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (valueUs > m_max.load(std::memory_order_relaxed))
+            m_max.store(valueUs, std::memory_order_relaxed);
+    }
+
+
+    uint64_t HapticAvatar_LatencyHistogram::getPercentile(double percentile) const
+    {
+        const uint64_t count = getCount();
+        if (count == 0)
+            return 0;
+
+        uint64_t rank = uint64_t(percentile * 0.01 * double(count) + 0.5);
+        if (rank < 1)
+            rank = 1;
+        if (rank > count)
+            rank = count;
+
+        uint64_t seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++)
+        {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                const uint64_t value = bucketValue(i);
+                const uint64_t max = getMax();
+                return (value < max) ? value : max;
+            }
+        }
+        return getMax();
+    }
+
+
+    int HapticAvatar_LatencyHistogram::bucketIndex(uint64_t valueUs)
+    {
+        if (valueUs < uint64_t(2 * SUB_BUCKETS))
+            return int(valueUs);
+
+        const uint64_t maxValue = (uint64_t(1) << LATENCY_HISTOGRAM_MAX_BITS) - 1;
+        if (valueUs > maxValue)
+            valueUs = maxValue;
+
+        int msb = LATENCY_HISTOGRAM_SUB_BITS + 1;
+        while ((valueUs >> (msb + 1)) != 0)
+            msb++;
+
+        // the SUB_BITS bits after the most significant one select the bucket inside the power of two
+        const int shift = msb - LATENCY_HISTOGRAM_SUB_BITS;
+        return 2 * SUB_BUCKETS + (msb - LATENCY_HISTOGRAM_SUB_BITS - 1) * SUB_BUCKETS + int(valueUs >> shift) - SUB_BUCKETS;
+    }
+
+
+    uint64_t HapticAvatar_LatencyHistogram::bucketValue(int index)
+    {
+        if (index < 2 * SUB_BUCKETS)
+            return uint64_t(index);
+
+        const int group = (index - 2 * SUB_BUCKETS) / SUB_BUCKETS;
+        const int sub = (index - 2 * SUB_BUCKETS) % SUB_BUCKETS;
+        const int shift = group + 1;
+        return ((uint64_t(SUB_BUCKETS + sub + 1)) << shift) - 1;
+    }
+
+} // namespace sofa::HapticAvatar
@@ -0,0 +1,76 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <atomic>
+#include <cstdint>
+
+namespace sofa::HapticAvatar
+{
+
+#define LATENCY_HISTOGRAM_SUB_BITS 5
+#define LATENCY_HISTOGRAM_MAX_BITS 27 // values up to 2^27 us, about 2 minutes
+
+    /**
+    * Histogram of latencies in microseconds with a bounded relative error, in the manner of HDR histograms: values below
+    * 2^(SUB_BITS+1) are exact, larger values are counted in 2^SUB_BITS buckets per power of two, i.e. within about 3%.
+    * There is a single writer, the thread calling @sa record, and any number of readers: counters are atomics, a reader sees
+    * each of them consistent but may see a record in the count and not yet in its bucket.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_LatencyHistogram
+    {
+    public:
+        HapticAvatar_LatencyHistogram();
+
+        /// Forget all the values recorded. Only to be called from the writer thread, or before it starts.
+        void reset();
+
+        /// Add a value, larger values than the range are counted in the last bucket. Only to be called from one thread.
+        void record(uint64_t valueUs);
+
+        /// Number of values recorded.
+        uint64_t getCount() const { return m_count.load(std::memory_order_relaxed); }
+
+        /// Largest value recorded, exact.
+        uint64_t getMax() const { return m_max.load(std::memory_order_relaxed); }
+
+        /** Get the value below which a given percentage of the recorded values are.
+        * @param {double} percentile: between 0 and 100, e.g. 99.9.
+        * @returns {uint64_t} the highest value of the bucket holding the percentile, 0 if nothing has been recorded.
+        */
+        uint64_t getPercentile(double percentile) const;
+
+        static constexpr int NUM_BUCKETS = (2 << LATENCY_HISTOGRAM_SUB_BITS) + (LATENCY_HISTOGRAM_MAX_BITS - LATENCY_HISTOGRAM_SUB_BITS - 1) * (1 << LATENCY_HISTOGRAM_SUB_BITS);
+
+        /// Index of the bucket counting @param valueUs.
+        static int bucketIndex(uint64_t valueUs);
+        /// Highest value counted in bucket @param index.
+        static uint64_t bucketValue(int index);
+
+    protected:
+        std::atomic<uint64_t> m_buckets[NUM_BUCKETS];
+        std::atomic<uint64_t> m_count;
+        std::atomic<uint64_t> m_max;
+    };
+
+} // namespace sofa::HapticAvatar
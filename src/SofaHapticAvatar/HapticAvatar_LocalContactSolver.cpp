@@ -0,0 +1,138 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_LocalContactSolver.h>
+#include <cmath>
+
+namespace sofa::HapticAvatar
+{
+
+    HapticAvatar_LocalContactSolver::HapticAvatar_LocalContactSolver()
+        : m_maxIterations(100)
+        , m_tolerance(1e-6)
+        , m_lastError(0.0)
+    {
+
+    }
+
+
+    void HapticAvatar_LocalContactSolver::setup(int maxIterations, double tolerance)
+    {
+        m_maxIterations = maxIterations > 0 ? maxIterations : 1;
+        m_tolerance = tolerance > 0.0 ? tolerance : 0.0;
+    }
+
+
+    int HapticAvatar_LocalContactSolver::solve(const double* positions, double* forces)
+    {
+        const Problem& p = m_problem;
+        for (unsigned int k = 0; k < p.numDofs; k++)
+            forces[k] = 0.0;
+
+        m_lastError = 0.0;
+        if (p.numConstraints == 0)
+            return 0;
+
+        // violation of the constraints at the current articulations of the device
+        for (unsigned int i = 0; i < p.numConstraints; i++)
+        {
+            double d = p.dFree[i];
+            for (unsigned int k = 0; k < p.numDofs; k++)
+                d += p.J[i][k] * (positions[k] - p.freePositions[k]);
+            m_d[i] = d;
+        }
+
+        int iterations = 0;
+        while (iterations < m_maxIterations)
+        {
+            iterations++;
+            m_lastError = iterate();
+            if (m_lastError < m_tolerance)
+                break;
+        }
+
+        // forces on the articulations: J^T.f
+        for (unsigned int i = 0; i < p.numConstraints; i++)
+        {
+            if (p.f[i] == 0.0)
+                continue;
+            for (unsigned int k = 0; k < p.numDofs; k++)
+                forces[k] += p.J[i][k] * p.f[i];
+        }
+        for (unsigned int k = 0; k < p.numDofs; k++)
+            forces[k] *= p.forceCoef;
+
+        return iterations;
+    }
+
+
+    double HapticAvatar_LocalContactSolver::iterate()
+    {
+        Problem& p = m_problem;
+        const bool friction = p.mu > 0.0;
+        const unsigned int blockSize = friction ? 3 : 1;
+        double error = 0.0;
+
+        for (unsigned int c = 0; c + blockSize <= p.numConstraints; c += blockSize)
+        {
+            double previous[3];
+            for (unsigned int r = 0; r < blockSize; r++)
+                previous[r] = p.f[c + r];
+
+            for (unsigned int r = 0; r < blockSize; r++)
+            {
+                const unsigned int i = c + r;
+                if (p.W[i][i] <= 0.0)
+                    continue;
+
+                double violation = m_d[i];
+                for (unsigned int j = 0; j < p.numConstraints; j++)
+                    violation += p.W[i][j] * p.f[j];
+
+                double fi = p.f[i] - violation / p.W[i][i];
+                // normal forces only push
+                if (r == 0 && fi < 0.0)
+                    fi = 0.0;
+                p.f[i] = fi;
+            }
+
+            if (friction)
+            {
+                // tangential forces inside the Coulomb cone of the normal one
+                const double normal = p.f[c];
+                const double tangent = std::sqrt(p.f[c + 1] * p.f[c + 1] + p.f[c + 2] * p.f[c + 2]);
+                const double bound = p.mu * normal;
+                if (tangent > bound)
+                {
+                    const double scale = (tangent > 0.0) ? bound / tangent : 0.0;
+                    p.f[c + 1] *= scale;
+                    p.f[c + 2] *= scale;
+                }
+            }
+
+            for (unsigned int r = 0; r < blockSize; r++)
+                error += std::fabs(p.f[c + r] - previous[r]);
+        }
+        return error;
+    }
+
+} // namespace sofa::HapticAvatar
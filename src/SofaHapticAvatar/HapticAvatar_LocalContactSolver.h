@@ -0,0 +1,94 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <cstdint>
+
+namespace sofa::HapticAvatar
+{
+
+#define LOCAL_CONTACT_MAX_CONSTRAINTS 24
+#define LOCAL_CONTACT_MAX_DOFS 8
+
+    /**
+    * Contact solver evaluated at the rate of the haptic loop, between two simulation steps. At each step, the constraints acting on the
+    * articulations of the tool are copied with their compliance block W, their free violation dFree and their Jacobian J versus the articulations.
+    * At each haptic cycle, the violation is updated with the motion of the device since the free positions of the step, dFree + J.dx, and the small
+    * LCP is solved again by projected Gauss-Seidel, warm started from the previous solution. The contact set is the one of the step until the next.
+    * With friction, the constraints are triples normal, tangent, tangent and the tangential forces are projected on the Coulomb cone.
+    * Only to be used from one thread, the haptic one. The problem is a plain struct so that it can be handed over by a @sa HapticAvatar_TripleBuffer.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_LocalContactSolver
+    {
+    public:
+        /// Constraints of one simulation step acting on the articulations
+        struct Problem
+        {
+            unsigned int numConstraints = 0;
+            unsigned int numDofs = 0;
+            double mu = 0.0;           ///< friction coefficient, the constraints are triples if positive
+            double forceCoef = 1.0;    ///< scale of the force applied to the device
+            uint64_t step = 0;         ///< number of the step, 0 if none yet
+            double W[LOCAL_CONTACT_MAX_CONSTRAINTS][LOCAL_CONTACT_MAX_CONSTRAINTS];
+            double dFree[LOCAL_CONTACT_MAX_CONSTRAINTS];
+            double J[LOCAL_CONTACT_MAX_CONSTRAINTS][LOCAL_CONTACT_MAX_DOFS];
+            double f[LOCAL_CONTACT_MAX_CONSTRAINTS];                ///< solution of the step, then of the last haptic cycle
+            double freePositions[LOCAL_CONTACT_MAX_DOFS];          ///< articulations at which dFree was computed
+        };
+
+        HapticAvatar_LocalContactSolver();
+
+        /** Set the stopping criteria of the Gauss-Seidel iterations.
+        * @param {int} maxIterations: iterations per haptic cycle at most.
+        * @param {double} tolerance: the iterations stop when the sum of the changes of the forces is below it.
+        */
+        void setup(int maxIterations, double tolerance);
+
+        /// Problem solved by @sa solve, to be filled in place with a new step, its forces are the warm start
+        Problem& getProblem() { return m_problem; }
+        const Problem& getProblem() const { return m_problem; }
+
+        /** Solve the contacts for the current articulations of the device.
+        * @param {double*} positions: articulations of the device, @sa Problem::numDofs values.
+        * @param {double*} forces: receives the force on each articulation, zero if there is no contact.
+        * @returns {int} number of iterations run, 0 if there is no constraint.
+        */
+        int solve(const double* positions, double* forces);
+
+        /// Sum of the changes of the forces at the last iteration of the last @sa solve
+        double getLastError() const { return m_lastError; }
+
+    protected:
+        /// One Gauss-Seidel pass over the constraints, @returns the sum of the changes of the forces
+        double iterate();
+
+        Problem m_problem;
+        int m_maxIterations;
+        double m_tolerance;
+        double m_lastError;
+
+        /// violation of the constraints at the current articulations, before the contact forces
+        double m_d[LOCAL_CONTACT_MAX_CONSTRAINTS];
+    };
+
+} // namespace sofa::HapticAvatar
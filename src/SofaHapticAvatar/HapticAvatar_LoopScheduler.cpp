@@ -0,0 +1,183 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_LoopScheduler.h>
+#include <thread>
+
+#ifdef __linux__
+#include <time.h>
+#include <cerrno>
+#endif
+
+#ifdef WIN32
+#include <windows.h>
+#include <algorithm>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#define WIN32_DEFAULT_TIMER_RESOLUTION_US 15625 // resolution of the sleeps without high resolution timer
+#endif
+
+namespace sofa::HapticAvatar
+{
+
+#ifdef WIN32
+    namespace
+    {
+        /// High resolution waitable timer of the calling thread, null before Windows 10 1803
+        struct ThreadTimer
+        {
+            HANDLE handle;
+            ThreadTimer() : handle(CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS)) {}
+            ~ThreadTimer() { if (handle != nullptr) CloseHandle(handle); }
+        };
+    }
+#endif
+
+    HapticAvatar_LoopScheduler::HapticAvatar_LoopScheduler()
+        : m_period(1000)
+        , m_spinMargin(100)
+        , m_slack(1000)
+        , m_cycles(0)
+        , m_overruns(0)
+        , m_lastWakeErrorNs(0)
+        , m_sumWakeErrorNs(0)
+        , m_maxWakeErrorNs(0)
+        , m_maxOversleepNs(0)
+    {
+
+    }
+
+
+    void HapticAvatar_LoopScheduler::setTiming(int periodUs, int spinMarginUs, int slackUs)
+    {
+        m_period = std::chrono::microseconds(periodUs > 0 ? periodUs : 1);
+        m_spinMargin = std::chrono::microseconds(spinMarginUs > 0 ? spinMarginUs : 0);
+        m_slack = std::chrono::microseconds(slackUs > 0 ? slackUs : 0);
+    }
+
+
+    void HapticAvatar_LoopScheduler::start()
+    {
+        m_cycles.store(0, std::memory_order_relaxed);
+        m_overruns.store(0, std::memory_order_relaxed);
+        m_lastWakeErrorNs.store(0, std::memory_order_relaxed);
+        m_sumWakeErrorNs.store(0, std::memory_order_relaxed);
+        m_maxWakeErrorNs.store(0, std::memory_order_relaxed);
+        m_maxOversleepNs.store(0, std::memory_order_relaxed);
+        m_deadline = Clock::now() + m_period;
+    }
+
+
+    void HapticAvatar_LoopScheduler::waitNextCycle()
+    {
+        Clock::time_point now = Clock::now();
+        const uint64_t cycles = m_cycles.load(std::memory_order_relaxed) + 1;
+        m_cycles.store(cycles, std::memory_order_relaxed);
+
+        if (now > m_deadline + m_slack)
+        {
+            // the work took too long: start again from now instead of catching up
+            m_overruns.store(m_overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            m_deadline = now + m_period;
+            return;
+        }
+
+        const Clock::time_point wakeTime = m_deadline - m_spinMargin;
+        if (now < wakeTime)
+        {
+            sleepUntil(wakeTime);
+            now = Clock::now();
+            const int64_t oversleep = std::chrono::duration_cast<std::chrono::nanoseconds>(now - wakeTime).count();
+            if (oversleep > m_maxOversleepNs.load(std::memory_order_relaxed))
+                m_maxOversleepNs.store(oversleep, std::memory_order_relaxed);
+        }
+
+        // spin for the last microseconds
+        while (now < m_deadline)
+            now = Clock::now();
+
+        const int64_t wakeError = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_deadline).count();
+        m_lastWakeErrorNs.store(wakeError, std::memory_order_relaxed);
+        m_sumWakeErrorNs.store(m_sumWakeErrorNs.load(std::memory_order_relaxed) + wakeError, std::memory_order_relaxed);
+        if (wakeError > m_maxWakeErrorNs.load(std::memory_order_relaxed))
+            m_maxWakeErrorNs.store(wakeError, std::memory_order_relaxed);
+
+        m_deadline += m_period;
+    }
+
+
+    HapticAvatar_LoopScheduler::Stats HapticAvatar_LoopScheduler::getStats() const
+    {
+        Stats stats;
+        stats.cycles = m_cycles.load(std::memory_order_relaxed);
+        stats.overruns = m_overruns.load(std::memory_order_relaxed);
+        stats.lastWakeErrorUs = double(m_lastWakeErrorNs.load(std::memory_order_relaxed)) * 1e-3;
+        const uint64_t onTime = stats.cycles - stats.overruns;
+        if (onTime > 0)
+            stats.meanWakeErrorUs = double(m_sumWakeErrorNs.load(std::memory_order_relaxed)) * 1e-3 / double(onTime);
+        stats.maxWakeErrorUs = double(m_maxWakeErrorNs.load(std::memory_order_relaxed)) * 1e-3;
+        stats.maxOversleepUs = double(m_maxOversleepNs.load(std::memory_order_relaxed)) * 1e-3;
+        return stats;
+    }
+
+
+    void HapticAvatar_LoopScheduler::sleepUntil(const Clock::time_point& wakeTime)
+    {
+#ifdef __linux__
+        // steady_clock is CLOCK_MONOTONIC on Linux: sleep on the absolute time, an interrupted sleep resumes on the same deadline
+        const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wakeTime.time_since_epoch()).count();
+        struct timespec ts;
+        ts.tv_sec = time_t(ns / 1000000000);
+        ts.tv_nsec = long(ns % 1000000000);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+        {
+        }
+#elif defined(WIN32)
+        // the default timer of Windows wakes up ~15.6 ms late, far beyond the period of the loop
+        thread_local ThreadTimer timer;
+        const Clock::duration remaining = wakeTime - Clock::now();
+        if (remaining <= Clock::duration::zero())
+            return;
+
+        if (timer.handle != nullptr)
+        {
+            // relative due time, in 100 ns units
+            LARGE_INTEGER dueTime;
+            dueTime.QuadPart = -std::max<LONGLONG>(1, LONGLONG(std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count() / 100));
+            if (SetWaitableTimerEx(timer.handle, &dueTime, 0, nullptr, nullptr, nullptr, 0))
+            {
+                WaitForSingleObject(timer.handle, INFINITE);
+                return;
+            }
+        }
+
+        // no high resolution timer: only sleep what the default timer cannot overshoot, the caller spins the rest
+        const std::chrono::microseconds resolution(WIN32_DEFAULT_TIMER_RESOLUTION_US);
+        if (remaining > 2 * resolution)
+            std::this_thread::sleep_for(remaining - 2 * resolution);
+#else
+        std::this_thread::sleep_until(wakeTime);
+#endif
+    }
+
+} // namespace sofa::HapticAvatar
@@ -0,0 +1,98 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace sofa::HapticAvatar
+{
+
+    /**
+    * Pacing of a periodic loop on absolute deadlines. @sa waitNextCycle sleeps in the kernel until spinMargin before the deadline
+    * of the cycle, then spins on the clock for the last microseconds only: the loop thread uses the CPU only for its work and this margin.
+    * Deadlines are absolute, the period does not drift with the duration of the work. A cycle ending more than slack after its deadline
+    * is counted as an overrun and the next deadlines restart from now, instead of running the missed cycles back to back.
+    * On Windows the sleep uses a high resolution waitable timer. Without it, the loop spins whenever the time left is below the default
+    * timer resolution. The loop thread is the only writer, the statistics can be read from any thread.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_LoopScheduler
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        HapticAvatar_LoopScheduler();
+
+        /** Set the timing of the loop, to be called before @sa start.
+        * @param {int} periodUs: period of the loop in microseconds.
+        * @param {int} spinMarginUs: time spent spinning before each deadline, to absorb the wake-up latency of the kernel.
+        * @param {int} slackUs: lateness after which a cycle is considered missed and the deadlines are reset.
+        */
+        void setTiming(int periodUs, int spinMarginUs, int slackUs);
+
+        int getPeriod() const { return int(m_period.count()); }
+        int getSpinMargin() const { return int(m_spinMargin.count()); }
+        int getSlack() const { return int(m_slack.count()); }
+
+        /// Set the first deadline one period from now. To be called from the loop thread before its first cycle.
+        void start();
+
+        /// Wait for the deadline of the current cycle and set the next one. To be called from the loop thread at the end of each cycle.
+        void waitNextCycle();
+
+        /// Deadline of the current cycle, @sa waitNextCycle returns at this time. To be called from the loop thread only.
+        const Clock::time_point& getDeadline() const { return m_deadline; }
+
+        struct Stats
+        {
+            uint64_t cycles = 0;           ///< number of cycles waited
+            uint64_t overruns = 0;         ///< cycles whose work ended more than slack after their deadline
+            double lastWakeErrorUs = 0.0;  ///< time between the deadline and the end of the wait, last cycle
+            double meanWakeErrorUs = 0.0;  ///< mean of the wake-up errors, overruns excluded
+            double maxWakeErrorUs = 0.0;   ///< largest wake-up error, overruns excluded
+            double maxOversleepUs = 0.0;   ///< largest time the kernel woke the thread after the end of its sleep. A spin margin below it makes deadlines late
+        };
+
+        /// Snapshot of the statistics since @sa start, can be called from any thread.
+        Stats getStats() const;
+
+    protected:
+        /// Sleep in the kernel until @param wakeTime, or less if the timer of the system is too coarse. The caller spins the rest.
+        static void sleepUntil(const Clock::time_point& wakeTime);
+
+        std::chrono::microseconds m_period;
+        std::chrono::microseconds m_spinMargin;
+        std::chrono::microseconds m_slack;
+        Clock::time_point m_deadline;
+
+        // statistics, in nanoseconds. Single writer, atomics so that they can be read from other threads
+        std::atomic<uint64_t> m_cycles;
+        std::atomic<uint64_t> m_overruns;
+        std::atomic<int64_t> m_lastWakeErrorNs;
+        std::atomic<int64_t> m_sumWakeErrorNs;
+        std::atomic<int64_t> m_maxWakeErrorNs;
+        std::atomic<int64_t> m_maxOversleepNs;
+    };
+
+} // namespace sofa::HapticAvatar
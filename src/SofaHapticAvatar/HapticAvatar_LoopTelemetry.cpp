@@ -0,0 +1,181 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_LoopTelemetry.h>
+#include <iomanip>
+#include <ostream>
+
+namespace sofa::HapticAvatar
+{
+
+    static const char* const PHASE_NAMES[int(LoopPhase::NbPhases)] = { "driverRead", "iboxRead", "computeForce", "driverUpdate", "iboxUpdate" };
+
+
+    HapticAvatar_LoopTelemetry::HapticAvatar_LoopTelemetry()
+        : m_targetNs(1000000)
+        , m_toleranceNs(100000)
+        , m_started(false)
+        , m_sumPeriodNs(0)
+        , m_cycles(0)
+        , m_deadlineMisses(0)
+        , m_overruns(0)
+    {
+        for (int i = 0; i < int(LoopPhase::NbPhases); i++)
+            m_sumPhaseNs[i].store(0, std::memory_order_relaxed);
+    }
+
+
+    void HapticAvatar_LoopTelemetry::start(int periodUs, int toleranceUs)
+    {
+        m_targetNs = int64_t(periodUs > 0 ? periodUs : 1) * 1000;
+        m_toleranceNs = int64_t(toleranceUs > 0 ? toleranceUs : 0) * 1000;
+        m_started = false;
+
+        m_period.reset();
+        m_jitter.reset();
+        for (int i = 0; i < int(LoopPhase::NbPhases); i++)
+        {
+            m_phases[i].reset();
+            m_sumPhaseNs[i].store(0, std::memory_order_relaxed);
+        }
+        m_sumPeriodNs.store(0, std::memory_order_relaxed);
+        m_cycles.store(0, std::memory_order_relaxed);
+        m_deadlineMisses.store(0, std::memory_order_relaxed);
+        m_overruns.store(0, std::memory_order_relaxed);
+    }
+
+
+    void HapticAvatar_LoopTelemetry::beginCycle()
+    {
+        const Clock::time_point now = Clock::now();
+        if (m_started)
+        {
+            const int64_t periodNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_cycleStart).count();
+            const int64_t jitterNs = (periodNs > m_targetNs) ? periodNs - m_targetNs : m_targetNs - periodNs;
+            m_period.record(uint64_t(periodNs / 1000));
+            m_jitter.record(uint64_t(jitterNs / 1000));
+            add(m_sumPeriodNs, uint64_t(periodNs));
+            if (periodNs > m_targetNs + m_toleranceNs)
+                add(m_deadlineMisses, 1);
+        }
+        m_started = true;
+        m_cycleStart = now;
+        m_phaseStart = now;
+        add(m_cycles, 1);
+    }
+
+
+    void HapticAvatar_LoopTelemetry::endPhase(LoopPhase phase)
+    {
+        const Clock::time_point now = Clock::now();
+        const int64_t durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_phaseStart).count();
+        m_phases[int(phase)].record(uint64_t(durationNs / 1000));
+        add(m_sumPhaseNs[int(phase)], uint64_t(durationNs));
+        m_phaseStart = now;
+    }
+
+
+    void HapticAvatar_LoopTelemetry::endCycle()
+    {
+        const int64_t workNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_cycleStart).count();
+        if (workNs > m_targetNs)
+            add(m_overruns, 1);
+    }
+
+
+    HapticAvatar_LoopTelemetry::Stats HapticAvatar_LoopTelemetry::getStats() const
+    {
+        Stats stats;
+        stats.cycles = m_cycles.load(std::memory_order_relaxed);
+        stats.deadlineMisses = m_deadlineMisses.load(std::memory_order_relaxed);
+        stats.overruns = m_overruns.load(std::memory_order_relaxed);
+
+        const uint64_t periods = m_period.getCount();
+        if (periods > 0)
+            stats.meanPeriodUs = double(m_sumPeriodNs.load(std::memory_order_relaxed)) * 1e-3 / double(periods);
+
+        const double percentiles[3] = { 50.0, 99.0, 99.9 };
+        for (int k = 0; k < 3; k++)
+        {
+            stats.periodUs[k] = m_period.getPercentile(percentiles[k]);
+            stats.jitterUs[k] = m_jitter.getPercentile(percentiles[k]);
+        }
+        stats.periodUs[3] = m_period.getMax();
+        stats.jitterUs[3] = m_jitter.getMax();
+
+        for (int i = 0; i < int(LoopPhase::NbPhases); i++)
+        {
+            PhaseStats& phase = stats.phases[i];
+            phase.count = m_phases[i].getCount();
+            if (phase.count > 0)
+                phase.meanUs = double(m_sumPhaseNs[i].load(std::memory_order_relaxed)) * 1e-3 / double(phase.count);
+            phase.p99Us = m_phases[i].getPercentile(99.0);
+            phase.maxUs = m_phases[i].getMax();
+        }
+        return stats;
+    }
+
+
+    void HapticAvatar_LoopTelemetry::print(std::ostream& out) const
+    {
+        const Stats stats = getStats();
+        out << "cycles " << stats.cycles << ", deadline misses " << stats.deadlineMisses << ", overruns " << stats.overruns
+            << ", mean period " << std::fixed << std::setprecision(1) << stats.meanPeriodUs << " us\n";
+
+        out << std::left << std::setw(14) << "us" << std::right << std::setw(8) << "p50" << std::setw(8) << "p99" << std::setw(8) << "p99.9" << std::setw(8) << "max" << "\n";
+        out << std::left << std::setw(14) << "period" << std::right;
+        for (int k = 0; k < 4; k++)
+            out << std::setw(8) << stats.periodUs[k];
+        out << "\n" << std::left << std::setw(14) << "jitter" << std::right;
+        for (int k = 0; k < 4; k++)
+            out << std::setw(8) << stats.jitterUs[k];
+        out << "\n";
+
+        out << std::left << std::setw(14) << "phase" << std::right << std::setw(8) << "mean" << std::setw(8) << "p99" << std::setw(8) << "max" << std::setw(10) << "count" << "\n";
+        for (int i = 0; i < int(LoopPhase::NbPhases); i++)
+        {
+            const PhaseStats& phase = stats.phases[i];
+            if (phase.count == 0)
+                continue;
+
+            out << std::left << std::setw(14) << PHASE_NAMES[i] << std::right << std::setw(8) << std::setprecision(2) << phase.meanUs
+                << std::setw(8) << phase.p99Us << std::setw(8) << phase.maxUs << std::setw(10) << phase.count << "\n";
+        }
+    }
+
+
+    const char* HapticAvatar_LoopTelemetry::getPhaseName(LoopPhase phase)
+    {
+        const int index = int(phase);
+        if (index < 0 || index >= int(LoopPhase::NbPhases))
+            return nullptr;
+        return PHASE_NAMES[index];
+    }
+
+
+    void HapticAvatar_LoopTelemetry::add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        // single writer: plain load and store, no read-modify-write needed
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+} // namespace sofa::HapticAvatar
@@ -0,0 +1,128 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <SofaHapticAvatar/HapticAvatar_LatencyHistogram.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+
+namespace sofa::HapticAvatar
+{
+
+    /// Phases of a haptic cycle timed by @sa HapticAvatar_LoopTelemetry, in the order they run
+    enum class LoopPhase : int
+    {
+        DriverRead = 0, ///< angles, length and tool id read from the driver
+        IBoxRead,       ///< jaw opening read from the IBox
+        ComputeForce,   ///< force feedback computed and sent to the drivers
+        DriverUpdate,   ///< requests sent to the device and its reply received
+        IBoxUpdate,     ///< same for the IBox
+        NbPhases
+    };
+
+    /**
+    * Telemetry of a haptic loop: histograms of the period between cycles and of its jitter around the target period, deadline misses,
+    * overruns and the time spent in each @sa LoopPhase. The loop thread is the only writer and only reads the clock and updates
+    * counters: no lock, allocation nor I/O. The statistics can be read from any thread, with the consistency of @sa HapticAvatar_LatencyHistogram.
+    * A cycle is a deadline miss when it starts more than the tolerance after the period of the previous one, and an overrun when
+    * its work takes longer than the period.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_LoopTelemetry
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        HapticAvatar_LoopTelemetry();
+
+        /** Forget the previous statistics and set the target of the loop. To be called before the loop thread starts.
+        * @param {int} periodUs: target period of the loop in microseconds.
+        * @param {int} toleranceUs: lateness of a cycle start after which it is counted as a deadline miss.
+        */
+        void start(int periodUs, int toleranceUs);
+
+        /// Mark the start of a cycle and record the period since the previous one. To be called from the loop thread.
+        void beginCycle();
+
+        /// Record the time since the start of the cycle or the end of the previous phase as spent in @param phase. Phases not run in a cycle are simply not ended.
+        void endPhase(LoopPhase phase);
+
+        /// Mark the end of the work of the cycle, before the loop waits for its next deadline.
+        void endCycle();
+
+        /// Time statistics of a phase, in microseconds
+        struct PhaseStats
+        {
+            uint64_t count = 0;
+            double meanUs = 0.0;
+            uint64_t p99Us = 0;
+            uint64_t maxUs = 0;
+        };
+
+        struct Stats
+        {
+            uint64_t cycles = 0;          ///< number of cycles started
+            uint64_t deadlineMisses = 0;  ///< cycles started more than the tolerance late
+            uint64_t overruns = 0;        ///< cycles whose work took longer than the period
+            double meanPeriodUs = 0.0;
+            uint64_t periodUs[4] = { 0, 0, 0, 0 };  ///< p50, p99, p99.9 and max of the period
+            uint64_t jitterUs[4] = { 0, 0, 0, 0 };  ///< same for the distance between the period and its target
+            PhaseStats phases[int(LoopPhase::NbPhases)];
+        };
+
+        /// Snapshot of the statistics since @sa start, can be called from any thread.
+        Stats getStats() const;
+
+        /// Print the statistics as a table, for the Data of the components. Not to be called from the loop thread.
+        void print(std::ostream& out) const;
+
+        const HapticAvatar_LatencyHistogram& getPeriodHistogram() const { return m_period; }
+        const HapticAvatar_LatencyHistogram& getJitterHistogram() const { return m_jitter; }
+        const HapticAvatar_LatencyHistogram& getPhaseHistogram(LoopPhase phase) const { return m_phases[int(phase)]; }
+
+        static const char* getPhaseName(LoopPhase phase);
+
+    protected:
+        static void add(std::atomic<uint64_t>& counter, uint64_t value);
+
+        int64_t m_targetNs;
+        int64_t m_toleranceNs;
+
+        // loop thread only
+        bool m_started;
+        Clock::time_point m_cycleStart;
+        Clock::time_point m_phaseStart;
+
+        HapticAvatar_LatencyHistogram m_period;
+        HapticAvatar_LatencyHistogram m_jitter;
+        HapticAvatar_LatencyHistogram m_phases[int(LoopPhase::NbPhases)];
+        // sums in nanoseconds for the means, phases are often shorter than a microsecond
+        std::atomic<uint64_t> m_sumPeriodNs;
+        std::atomic<uint64_t> m_sumPhaseNs[int(LoopPhase::NbPhases)];
+        std::atomic<uint64_t> m_cycles;
+        std::atomic<uint64_t> m_deadlineMisses;
+        std::atomic<uint64_t> m_overruns;
+    };
+
+} // namespace sofa::HapticAvatar
@@ -0,0 +1,226 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_ReplyParser.h>
+
+namespace sofa::HapticAvatar
+{
+
+    HapticAvatar_ReplyParser::HapticAvatar_ReplyParser(const int* numReturnVals, const float* scaleFactor, float* resultTable, int rowStride, ResultRowStamp* rowStamps)
+        : m_numReturnVals(numReturnVals)
+        , m_scaleFactor(scaleFactor)
+        , m_resultTable(resultTable)
+        , m_rowStride(rowStride)
+        , m_rowStamps(rowStamps)
+    {
+
+    }
+
+
+    void HapticAvatar_ReplyParser::begin(const int* cmdList, int cmdListSize, int skipLines, uint64_t seq)
+    {
+        m_seq = seq;
+        m_cmdList = cmdList;
+        m_cmdListSize = cmdListSize;
+        m_cmdIndex = 0;
+        m_valueIndex = 0;
+        m_numRowsCommitted = 0;
+        m_replySize = 0;
+        m_error = false;
+        m_skipLines = skipLines;
+        m_skippedLines = 0;
+        m_lastSkippedSize = 0;
+        m_skipLineEnded = false;
+        m_state = (skipLines > 0) ? State::SkipLine : State::Separator;
+        m_expectedValues = 0;
+        for (int k = 0; k < cmdListSize; k++)
+            m_expectedValues += m_numReturnVals[cmdList[k]];
+        nextCommand();
+    }
+
+
+    int HapticAvatar_ReplyParser::consume(const char* data, int size)
+    {
+        if (m_rowStamps != nullptr && m_state != State::Done)
+            m_receiveTime = std::chrono::steady_clock::now();
+
+        int i = 0;
+        while (i < size && m_state != State::Done)
+        {
+            const char c = data[i++];
+
+            if (m_state == State::SkipLine)
+            {
+                if (c == '\n')
+                {
+                    m_skippedLines++;
+                    m_skipLineEnded = true;
+                    if (m_skippedLines == m_skipLines)
+                        m_state = State::Separator;
+                    continue;
+                }
+                if (m_skipLineEnded)
+                {
+                    m_lastSkippedSize = 0;
+                    m_skipLineEnded = false;
+                }
+                if (m_lastSkippedSize < REPLY_PARSER_LINE_LEN)
+                    m_lastSkipped[m_lastSkippedSize++] = c;
+                continue;
+            }
+
+            m_replySize++;
+
+            if (c >= '0' && c <= '9')
+            {
+                if (m_state == State::Separator)
+                    startValue(false);
+                m_mantissa = m_mantissa * 10 + (c - '0');
+                m_hasDigits = true;
+                if (m_fractionDigits >= 0)
+                    m_fractionDigits++;
+            }
+            else if ((c == '-' || c == '+') && m_state == State::Separator)
+            {
+                startValue(c == '-');
+            }
+            else if (c == '.' && (m_state == State::Separator || m_fractionDigits < 0))
+            {
+                if (m_state == State::Separator)
+                    startValue(false);
+                m_fractionDigits = 0;
+            }
+            else
+            {
+                if (m_state == State::Value)
+                    endValue();
+
+                if (c == '\n')
+                    endLine();
+                else if (c != ' ' && c != '\t' && c != '\r')
+                    m_error = true; // not part of a value
+            }
+        }
+        return i;
+    }
+
+
+    bool HapticAvatar_ReplyParser::finish()
+    {
+        if (m_state == State::SkipLine && m_skipLineEnded && m_skippedLines < m_skipLines && countValues(m_lastSkipped, m_lastSkippedSize) == m_expectedValues)
+        {
+            // Less stale lines than expected: the device did not answer one of the old requests, the last line was ours.
+            // The value count is checked first, a stale reply of another command set must not be parsed.
+            m_state = State::Separator;
+            const int size = m_lastSkippedSize;
+            consume(m_lastSkipped, size);
+            if (m_state == State::Value)
+                endValue();
+            if (m_state != State::Done)
+                endLine();
+        }
+        return isComplete();
+    }
+
+
+    int HapticAvatar_ReplyParser::countValues(const char* line, int size)
+    {
+        int count = 0;
+        bool inValue = false;
+        for (int i = 0; i < size; i++)
+        {
+            const bool separator = (line[i] == ' ' || line[i] == '\t' || line[i] == '\r');
+            if (!separator && !inValue)
+                count++;
+            inValue = !separator;
+        }
+        return count;
+    }
+
+
+    void HapticAvatar_ReplyParser::nextCommand()
+    {
+        while (m_cmdIndex < m_cmdListSize && m_numReturnVals[m_cmdList[m_cmdIndex]] == 0)
+            m_cmdIndex++;
+        m_valueIndex = 0;
+    }
+
+
+    void HapticAvatar_ReplyParser::startValue(bool negative)
+    {
+        m_state = State::Value;
+        m_negative = negative;
+        m_mantissa = 0;
+        m_fractionDigits = -1;
+        m_hasDigits = false;
+    }
+
+
+    void HapticAvatar_ReplyParser::endValue()
+    {
+        m_state = State::Separator;
+        if (!m_hasDigits || m_cmdIndex >= m_cmdListSize)
+        {
+            // lone sign or decimal point, or more values than requested
+            m_error = true;
+            return;
+        }
+
+        double value = double(m_mantissa);
+        for (int k = 0; k < m_fractionDigits; k++)
+            value *= 0.1;
+        if (m_negative)
+            value = -value;
+
+        const int cmd = m_cmdList[m_cmdIndex];
+        if (m_valueIndex < REPLY_PARSER_MAX_ROW)
+            m_row[m_valueIndex] = float(value) / m_scaleFactor[cmd];
+        m_valueIndex++;
+
+        if (m_valueIndex == m_numReturnVals[cmd])
+        {
+            // the row is complete: commit it
+            float* row = m_resultTable + cmd * m_rowStride;
+            const int n = (m_valueIndex < m_rowStride) ? m_valueIndex : m_rowStride;
+            for (int k = 0; k < n && k < REPLY_PARSER_MAX_ROW; k++)
+                row[k] = m_row[k];
+            if (m_rowStamps != nullptr)
+            {
+                m_rowStamps[cmd].seq = m_seq;
+                m_rowStamps[cmd].time = m_receiveTime;
+            }
+            m_numRowsCommitted++;
+            m_cmdIndex++;
+            nextCommand();
+        }
+    }
+
+
+    void HapticAvatar_ReplyParser::endLine()
+    {
+        // missing values: the partial row is not committed
+        if (m_cmdIndex < m_cmdListSize)
+            m_error = true;
+        m_state = State::Done;
+    }
+
+} // namespace sofa::HapticAvatar
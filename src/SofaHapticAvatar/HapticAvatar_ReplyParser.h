@@ -0,0 +1,142 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <chrono>
+#include <cstdint>
+
+namespace sofa::HapticAvatar
+{
+
+#define REPLY_PARSER_MAX_ROW 16
+#define REPLY_PARSER_LINE_LEN 1024
+
+    /// Reception of a row of the result table: the reply or frame that carried its values and when it was received.
+    struct ResultRowStamp
+    {
+        uint64_t seq = 0;  ///< receive sequence number of the reply, 0 if the row has never been received
+        std::chrono::steady_clock::time_point time;  ///< time the values were received
+    };
+
+    /**
+    * Incremental parser of the Ascii replies of the Haptic Avatar devices.
+    * A reply is one line of whitespace separated values, num_return_vals values for each command of the request, in the order
+    * of the request. Bytes are consumed as they arrive, in chunks of any size: the values of a command are committed to the
+    * result table only once all of them have been received, so a fragmented read never leaves a partially written row.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_ReplyParser
+    {
+    public:
+        /** Create a parser writing in the result table of a driver.
+        * @param {const int *} numReturnVals: number of values returned by each command.
+        * @param {const float *} scaleFactor: values received are divided by the scale factor of their command.
+        * @param {float *} resultTable: first row of the table, one row per command.
+        * @param {int} rowStride: number of floats between two rows of @param resultTable.
+        * @param {ResultRowStamp *} rowStamps: one per row of @param resultTable, stamped when the row is committed. May be null.
+        */
+        HapticAvatar_ReplyParser(const int* numReturnVals, const float* scaleFactor, float* resultTable, int rowStride, ResultRowStamp* rowStamps = nullptr);
+
+        /** Start parsing the reply of a new request.
+        * @param {const int *} cmdList: commands of the request, in sending order. Must stay valid until the reply is complete.
+        * @param {int} cmdListSize: number of commands.
+        * @param {int} skipLines: number of stale reply lines to read away before the reply of this request.
+        * @param {uint64_t} seq: receive sequence number stamped on the rows of this reply.
+        */
+        void begin(const int* cmdList, int cmdListSize, int skipLines = 0, uint64_t seq = 0);
+
+        /** Consume received bytes. Stops after the end of line of the reply, the bytes after it are not consumed.
+        * @returns {int} the number of bytes consumed.
+        */
+        int consume(const char* data, int size);
+
+        /** To be called when no more bytes will come for this reply. If stale lines were expected but only some of them arrived,
+        * the last line read away was in fact the reply of this request: it is parsed now.
+        * @returns {bool} true if the reply is complete.
+        */
+        bool finish();
+
+        /// The end of line of the reply has been received.
+        bool isComplete() const { return m_state == State::Done; }
+
+        /// The reply had missing, extra or invalid values. Only the complete rows before the error have been committed.
+        bool hasError() const { return m_error; }
+
+        /// Number of result table rows committed for the current reply.
+        int getNumRowsCommitted() const { return m_numRowsCommitted; }
+
+        /// Number of bytes of the current reply consumed so far, stale lines excluded.
+        int getReplySize() const { return m_replySize; }
+
+    protected:
+        enum class State
+        {
+            SkipLine,   // reading away a stale line
+            Separator,  // between two values
+            Value,      // inside a value
+            Done        // end of line of the reply received
+        };
+
+        /// Number of whitespace separated values in @param line.
+        static int countValues(const char* line, int size);
+
+        /// Next command of the request with return values, from m_cmdIndex.
+        void nextCommand();
+        void startValue(bool negative);
+        void endValue();
+        void endLine();
+
+        const int* m_numReturnVals;
+        const float* m_scaleFactor;
+        float* m_resultTable;
+        int m_rowStride;
+        ResultRowStamp* m_rowStamps;
+        uint64_t m_seq = 0;
+        std::chrono::steady_clock::time_point m_receiveTime; // arrival of the chunk being consumed
+
+        const int* m_cmdList = nullptr;
+        int m_cmdListSize = 0;
+        int m_expectedValues = 0;    // total number of values of the reply
+        int m_cmdIndex = 0;          // command whose values are being received
+        int m_valueIndex = 0;        // value of this command being received
+        float m_row[REPLY_PARSER_MAX_ROW]; // values of the current command, committed once complete
+        int m_numRowsCommitted = 0;
+        int m_replySize = 0;
+
+        State m_state = State::Done;
+        bool m_error = false;
+        int m_skipLines = 0;
+
+        // current value: sign, digits and number of digits after the decimal point
+        bool m_negative = false;
+        int64_t m_mantissa = 0;
+        int m_fractionDigits = -1;
+        bool m_hasDigits = false;
+
+        // copy of the last line read away, parsed by @sa finish if the reply of this request never came after it
+        char m_lastSkipped[REPLY_PARSER_LINE_LEN];
+        int m_lastSkippedSize = 0;
+        int m_skippedLines = 0;
+        bool m_skipLineEnded = false;
+    };
+
+} // namespace sofa::HapticAvatar
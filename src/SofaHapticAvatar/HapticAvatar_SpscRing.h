@@ -0,0 +1,86 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <atomic>
+#include <cstdint>
+
+namespace sofa::HapticAvatar
+{
+
+    /**
+    * Wait-free single producer, single consumer queue of fixed capacity, for a real-time thread handing over values to a slower one.
+    * Unlike @sa HapticAvatar_TripleBuffer, every value is delivered in order. The producer never waits: if the queue is full, the value
+    * is dropped and counted. @param N is the capacity, a power of two.
+    */
+    template <class T, unsigned int N>
+    class HapticAvatar_SpscRing
+    {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "The capacity of HapticAvatar_SpscRing must be a power of two");
+
+    public:
+        HapticAvatar_SpscRing()
+            : m_head(0)
+            , m_tail(0)
+            , m_dropped(0)
+        {}
+
+        /// Producer side: append @param value. Only to be called from one thread. @returns false if the queue is full and the value dropped.
+        bool push(const T& value)
+        {
+            const uint32_t head = m_head.load(std::memory_order_relaxed);
+            if (head - m_tail.load(std::memory_order_acquire) >= N)
+            {
+                m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            m_slots[head & (N - 1)] = value;
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Consumer side: take the oldest value in @param value. Only to be called from one thread. @returns false if the queue is empty.
+        bool pop(T& value)
+        {
+            const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail == m_head.load(std::memory_order_acquire))
+                return false;
+
+            value = m_slots[tail & (N - 1)];
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Number of values dropped because the queue was full, can be read from any thread.
+        uint64_t getDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    protected:
+        T m_slots[N];
+        // the indices only increase, wrapping around the 32 bits; on different cache lines so that the two threads do not share one
+        alignas(64) std::atomic<uint32_t> m_head;
+        alignas(64) std::atomic<uint32_t> m_tail;
+        std::atomic<uint64_t> m_dropped;
+    };
+
+} // namespace sofa::HapticAvatar
@@ -0,0 +1,254 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_ThreadConfig.h>
+#include <sstream>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <cerrno>
+#include <cstring>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+
+namespace sofa::HapticAvatar
+{
+
+    bool ThreadConfigReport::isSuccess() const
+    {
+        return policy != SettingStatus::Failed && policy != SettingStatus::Unsupported
+            && affinity != SettingStatus::Failed && affinity != SettingStatus::Unsupported
+            && name != SettingStatus::Failed
+            && memoryLock != SettingStatus::Failed && memoryLock != SettingStatus::Unsupported;
+    }
+
+
+    void HapticAvatar_ThreadConfig::apply(std::thread& thread, const ThreadSettings& settings, ThreadConfigReport& report)
+    {
+        std::ostringstream messages;
+        messages << report.messages;
+
+#ifdef WIN32
+        HANDLE handle = HANDLE(thread.native_handle());
+
+        if (settings.policy != ThreadPolicy::Default)
+        {
+            // no real-time policy on Windows, the closest is the highest priority inside the priority class of the process
+            if (SetThreadPriority(handle, THREAD_PRIORITY_TIME_CRITICAL))
+                report.policy = SettingStatus::Applied;
+            else
+            {
+                report.policy = SettingStatus::Failed;
+                messages << "SetThreadPriority failed with error " << GetLastError() << ". ";
+            }
+        }
+
+        if (!settings.cpus.empty())
+        {
+            DWORD_PTR mask = 0;
+            for (int cpu : settings.cpus)
+            {
+                if (cpu >= 0 && cpu < int(sizeof(DWORD_PTR) * 8))
+                    mask |= DWORD_PTR(1) << cpu;
+            }
+            if (mask != 0 && SetThreadAffinityMask(handle, mask) != 0)
+                report.affinity = SettingStatus::Applied;
+            else
+            {
+                report.affinity = SettingStatus::Failed;
+                messages << "SetThreadAffinityMask failed with error " << GetLastError() << ". ";
+            }
+        }
+
+        if (!settings.name.empty())
+        {
+            // SetThreadDescription exists since Windows 10 1607, looked up at run time to keep loading on older systems
+            typedef HRESULT(WINAPI* SetThreadDescriptionFunc)(HANDLE, PCWSTR);
+            HMODULE kernel = GetModuleHandleW(L"kernel32.dll");
+            SetThreadDescriptionFunc setThreadDescription = (kernel != nullptr) ? SetThreadDescriptionFunc(GetProcAddress(kernel, "SetThreadDescription")) : nullptr;
+            if (setThreadDescription == nullptr)
+            {
+                report.name = SettingStatus::Unsupported;
+                messages << "SetThreadDescription is not available on this version of Windows. ";
+            }
+            else
+            {
+                wchar_t wideName[64] = { 0 };
+                const std::string name = settings.name.substr(0, 63);
+                MultiByteToWideChar(CP_UTF8, 0, name.c_str(), -1, wideName, 64);
+                const HRESULT res = setThreadDescription(handle, wideName);
+                if (SUCCEEDED(res))
+                    report.name = SettingStatus::Applied;
+                else
+                {
+                    report.name = SettingStatus::Failed;
+                    messages << "SetThreadDescription failed with error " << res << ". ";
+                }
+            }
+        }
+#else
+        pthread_t handle = thread.native_handle();
+
+        if (settings.policy != ThreadPolicy::Default)
+        {
+            const int policy = (settings.policy == ThreadPolicy::Fifo) ? SCHED_FIFO : SCHED_RR;
+            struct sched_param param;
+            std::memset(&param, 0, sizeof(param));
+            param.sched_priority = settings.priority;
+            const int res = pthread_setschedparam(handle, policy, &param);
+            if (res == 0)
+                report.policy = SettingStatus::Applied;
+            else
+            {
+                report.policy = SettingStatus::Failed;
+                messages << "pthread_setschedparam(" << policyName(settings.policy) << ", " << settings.priority << ") failed: " << std::strerror(res)
+                    << (res == EPERM ? " (needs CAP_SYS_NICE or an RLIMIT_RTPRIO limit)" : "") << ". ";
+            }
+        }
+
+#ifdef __linux__
+        if (!settings.cpus.empty())
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : settings.cpus)
+            {
+                if (cpu >= 0 && cpu < CPU_SETSIZE)
+                    CPU_SET(cpu, &set);
+            }
+            const int res = pthread_setaffinity_np(handle, sizeof(set), &set);
+            if (res == 0)
+                report.affinity = SettingStatus::Applied;
+            else
+            {
+                report.affinity = SettingStatus::Failed;
+                messages << "pthread_setaffinity_np failed: " << std::strerror(res) << ". ";
+            }
+        }
+
+        if (!settings.name.empty())
+        {
+            // 16 bytes with the terminating null
+            const std::string name = settings.name.substr(0, 15);
+            const int res = pthread_setname_np(handle, name.c_str());
+            if (res == 0)
+                report.name = SettingStatus::Applied;
+            else
+            {
+                report.name = SettingStatus::Failed;
+                messages << "pthread_setname_np failed: " << std::strerror(res) << ". ";
+            }
+        }
+#else
+        if (!settings.cpus.empty())
+        {
+            report.affinity = SettingStatus::Unsupported;
+            messages << "CPU affinity is only set on Linux and Windows. ";
+        }
+        if (!settings.name.empty())
+        {
+            report.name = SettingStatus::Unsupported;
+            messages << "Thread names are only set on Linux. ";
+        }
+#endif
+#endif
+
+        report.messages = messages.str();
+    }
+
+
+    void HapticAvatar_ThreadConfig::lockMemory(ThreadConfigReport& report)
+    {
+#ifdef WIN32
+        report.memoryLock = SettingStatus::Unsupported;
+        report.messages += "Memory locking is not supported on Windows. ";
+#else
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        {
+            report.memoryLock = SettingStatus::Failed;
+            report.messages += std::string("mlockall failed: ") + std::strerror(errno) + (errno == ENOMEM || errno == EPERM ? " (check RLIMIT_MEMLOCK)" : "") + ". ";
+            return;
+        }
+#ifdef __GLIBC__
+        // keep freed memory in the heap, already locked and mapped, and serve large blocks from it instead of new mappings
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_MAX, 0);
+#endif
+        report.memoryLock = SettingStatus::Applied;
+#endif
+    }
+
+
+    bool HapticAvatar_ThreadConfig::parsePolicy(const std::string& name, ThreadPolicy& policy)
+    {
+        if (name == "default" || name.empty())
+            policy = ThreadPolicy::Default;
+        else if (name == "fifo")
+            policy = ThreadPolicy::Fifo;
+        else if (name == "rr")
+            policy = ThreadPolicy::RoundRobin;
+        else
+            return false;
+        return true;
+    }
+
+
+    const char* HapticAvatar_ThreadConfig::policyName(ThreadPolicy policy)
+    {
+        switch (policy)
+        {
+        case ThreadPolicy::Fifo: return "fifo";
+        case ThreadPolicy::RoundRobin: return "rr";
+        default: return "default";
+        }
+    }
+
+
+    static const char* statusName(SettingStatus status)
+    {
+        switch (status)
+        {
+        case SettingStatus::Applied: return "applied";
+        case SettingStatus::Failed: return "failed";
+        case SettingStatus::Unsupported: return "unsupported";
+        default: return "not requested";
+        }
+    }
+
+
+    std::string HapticAvatar_ThreadConfig::toString(const ThreadConfigReport& report)
+    {
+        std::ostringstream oss;
+        oss << "policy: " << statusName(report.policy) << ", affinity: " << statusName(report.affinity)
+            << ", name: " << statusName(report.name) << ", memoryLock: " << statusName(report.memoryLock);
+        if (!report.messages.empty())
+            oss << ". " << report.messages;
+        return oss.str();
+    }
+
+} // namespace sofa::HapticAvatar
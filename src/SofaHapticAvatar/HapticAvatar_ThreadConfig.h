@@ -0,0 +1,103 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sofa::HapticAvatar
+{
+
+    /// Scheduling policy of a thread
+    enum class ThreadPolicy
+    {
+        Default,    ///< policy of the OS, not changed
+        Fifo,       ///< real-time, runs until it blocks or a higher priority thread is ready (SCHED_FIFO)
+        RoundRobin  ///< real-time, time-sliced with the threads of the same priority (SCHED_RR)
+    };
+
+    /// Settings of a thread, each one is only applied if set
+    struct ThreadSettings
+    {
+        ThreadPolicy policy = ThreadPolicy::Default;
+        int priority = 0;            ///< real-time priority, 1 to 99 on Linux. Used with Fifo and RoundRobin only
+        std::vector<int> cpus;       ///< CPUs the thread may run on, all if empty
+        std::string name;            ///< name shown by the OS tools, truncated to 15 characters on Linux
+    };
+
+    /// Outcome of each setting
+    enum class SettingStatus
+    {
+        NotRequested,
+        Applied,
+        Failed,
+        Unsupported
+    };
+
+    /// Outcome of @sa HapticAvatar_ThreadConfig::apply, with a readable message for each setting that was not applied.
+    struct ThreadConfigReport
+    {
+        SettingStatus policy = SettingStatus::NotRequested;
+        SettingStatus affinity = SettingStatus::NotRequested;
+        SettingStatus name = SettingStatus::NotRequested;
+        SettingStatus memoryLock = SettingStatus::NotRequested;
+        std::string messages;
+
+        /// All requested settings have been applied. A name the system cannot show is not a failure, it does not change the timing.
+        bool isSuccess() const;
+    };
+
+    /**
+    * Real-time configuration of the threads and memory of the process: scheduling policy and priority, CPU affinity, thread names
+    * and locking of the memory in RAM. The settings are applied one by one, a setting failing (e.g. no CAP_SYS_NICE or RLIMIT_RTPRIO
+    * for a real-time policy) does not prevent the others and is reported.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_ThreadConfig
+    {
+    public:
+        /** Apply @param settings to a running thread.
+        * @param {std::thread} thread: the thread to configure, must be joinable.
+        * @param {ThreadConfigReport} report: status of policy, affinity and name.
+        */
+        static void apply(std::thread& thread, const ThreadSettings& settings, ThreadConfigReport& report);
+
+        /** Lock the current and future memory of the process in RAM and keep the heap from being given back to the OS, so that
+        * the haptic loop never waits on a page fault. To be called before the threads are created, their stacks are then locked too.
+        * @param {ThreadConfigReport} report: status of memoryLock.
+        */
+        static void lockMemory(ThreadConfigReport& report);
+
+        /** Parse a policy name: "default", "fifo" or "rr".
+        * @returns {bool} false if the name is unknown.
+        */
+        static bool parsePolicy(const std::string& name, ThreadPolicy& policy);
+
+        /// Readable name of a policy, as accepted by @sa parsePolicy.
+        static const char* policyName(ThreadPolicy policy);
+
+        /// Write the status of each requested setting of @param report in a readable form.
+        static std::string toString(const ThreadConfigReport& report);
+    };
+
+} // namespace sofa::HapticAvatar
@@ -0,0 +1,119 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <chrono>
+#include <string>
+
+namespace sofa::HapticAvatar
+{
+
+#define ARDUINO_WAIT_TIME 2000
+
+    /**
+    * Settings used by a transport when opening the serial line of a device.
+    */
+    struct TransportSettings
+    {
+        /// Baud rate of the serial line. Ignored by USB CDC devices but still applied.
+        unsigned int baudRate = 9600;
+        /// Ask the kernel to flush received bytes to user space immediately (Linux ASYNC_LOW_LATENCY).
+        bool lowLatency = true;
+        /// Minimum number of bytes a blocking read waits for (termios VMIN).
+        unsigned char readMinChars = 0;
+        /// Read timeout in tenths of second (termios VTIME). 0 means non blocking if readMinChars is 0 too.
+        unsigned char readTimeoutDs = 1;
+        /// Time to wait after opening the line, the device is reset when DTR is raised. In ms.
+        int resetWaitMs = ARDUINO_WAIT_TIME;
+    };
+
+
+    /// Result of @sa HapticAvatar_Transport::waitReadable
+    enum class WaitStatus
+    {
+        Ready,      ///< bytes are waiting in the input queue
+        Timeout,    ///< the deadline has been reached without any byte received
+        Error       ///< the line is in error or has been closed
+    };
+
+    typedef std::chrono::steady_clock::time_point Deadline;
+
+
+    /**
+    * Low level serial transport used by @sa HapticAvatar_DriverBase to talk to a device.
+    * One implementation exists per platform, see @sa create.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_Transport
+    {
+    public:
+        HapticAvatar_Transport(const TransportSettings& settings) : m_settings(settings) {}
+
+        virtual ~HapticAvatar_Transport() {}
+
+        /// Create the default transport of the current platform. Ownership is given to the caller.
+        static HapticAvatar_Transport* create(const TransportSettings& settings = TransportSettings());
+
+        /** Open and configure the serial line.
+        * @param {string} portName: name of the port (ex: //./COM3 on Windows, /dev/ttyACM0 on Linux).
+        * @returns {bool} true if the line is open and configured.
+        */
+        virtual bool open(const std::string& portName) = 0;
+
+        /// Close the serial line if open.
+        virtual void close() = 0;
+
+        virtual bool isOpen() const = 0;
+
+        /** Read bytes from the serial line.
+        * @param {char *} buffer: array to store the bytes.
+        * @param {uint} nbChar: maximum number of bytes to read.
+        * @param {int *} queue: filled with the number of bytes waiting in the input queue before the read.
+        * @param {bool} do_flush: only read away what is already in the input queue, never block.
+        * @returns {int} number of bytes read, -1 on error.
+        */
+        virtual int read(char* buffer, unsigned int nbChar, int* queue, bool do_flush) = 0;
+
+        /** Wait until bytes can be read from the line, or until the deadline.
+        * The calling thread sleeps in the kernel when the platform allows it.
+        * @param {Deadline} deadline: absolute time after which the wait is abandoned.
+        * @returns {WaitStatus} Ready, Timeout or Error.
+        */
+        virtual WaitStatus waitReadable(const Deadline& deadline) = 0;
+
+        /** Write bytes on the serial line.
+        * @param {char *} buffer: bytes to send.
+        * @param {uint} nbChar: number of bytes to send.
+        * @returns {bool} true if all bytes have been written.
+        */
+        virtual bool write(const char* buffer, unsigned int nbChar) = 0;
+
+        /// Handle a reactor can wait on for incoming bytes, a file descriptor for epoll. -1 if the transport can't be multiplexed.
+        virtual int getPollHandle() const { return -1; }
+
+        const TransportSettings& getSettings() const { return m_settings; }
+
+    protected:
+        TransportSettings m_settings;
+    };
+
+} // namespace sofa::HapticAvatar
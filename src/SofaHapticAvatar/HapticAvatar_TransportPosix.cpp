@@ -0,0 +1,266 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_TransportPosix.h>
+#include <sofa/helper/logging/Messaging.h>
+
+#ifndef WIN32
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+namespace sofa::HapticAvatar
+{
+
+    namespace
+    {
+        /// Convert a baud rate into the termios speed constant. Returns B0 if not supported.
+        speed_t convertBaudRate(unsigned int baudRate)
+        {
+            switch (baudRate)
+            {
+            case 9600: return B9600;
+            case 19200: return B19200;
+            case 38400: return B38400;
+            case 57600: return B57600;
+            case 115200: return B115200;
+            case 230400: return B230400;
+#ifdef B460800
+            case 460800: return B460800;
+#endif
+#ifdef B921600
+            case 921600: return B921600;
+#endif
+            default: return B0;
+            }
+        }
+    }
+
+
+    HapticAvatar_TransportPosix::HapticAvatar_TransportPosix(const TransportSettings& settings)
+        : HapticAvatar_Transport(settings)
+        , m_fd(-1)
+    {
+
+    }
+
+
+    HapticAvatar_TransportPosix::~HapticAvatar_TransportPosix()
+    {
+        close();
+    }
+
+
+    bool HapticAvatar_TransportPosix::open(const std::string& portName)
+    {
+        m_fd = ::open(portName.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (m_fd < 0)
+        {
+            msg_error("HapticAvatar_TransportPosix") << "Handle was not attached. Reason: " << portName << " " << std::strerror(errno);
+            return false;
+        }
+
+        if (!configureLine(portName))
+        {
+            close();
+            return false;
+        }
+
+        if (m_settings.lowLatency)
+            setLowLatency(portName);
+
+        // Raise DTR, as DTR_CONTROL_ENABLE does on Windows, so the board is properly reset.
+        int modemBits = TIOCM_DTR;
+        ioctl(m_fd, TIOCMBIS, &modemBits);
+
+        //Flush any remaining characters in the buffers
+        tcflush(m_fd, TCIOFLUSH);
+        //We wait as the arduino board will be reseting
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_settings.resetWaitMs));
+
+        return true;
+    }
+
+
+    bool HapticAvatar_TransportPosix::configureLine(const std::string& portName)
+    {
+        struct termios tty;
+        if (tcgetattr(m_fd, &tty) != 0)
+        {
+            msg_warning("HapticAvatar_TransportPosix") << "Failed to get current serial parameters of " << portName << ": " << std::strerror(errno);
+            return false;
+        }
+
+        // 8N1, raw bytes, no echo, no flow control, no signal characters.
+        cfmakeraw(&tty);
+        tty.c_cflag |= (CLOCAL | CREAD);
+        tty.c_cflag &= ~(CSTOPB | PARENB);
+#ifdef CRTSCTS
+        tty.c_cflag &= ~CRTSCTS;
+#endif
+
+        speed_t speed = convertBaudRate(m_settings.baudRate);
+        if (speed == B0)
+        {
+            msg_warning("HapticAvatar_TransportPosix") << "Unsupported baud rate " << m_settings.baudRate << ", using 115200.";
+            speed = B115200;
+        }
+        cfsetispeed(&tty, speed);
+        cfsetospeed(&tty, speed);
+
+        // Blocking policy of read(): wait for VMIN bytes or VTIME tenths of second.
+        tty.c_cc[VMIN] = m_settings.readMinChars;
+        tty.c_cc[VTIME] = m_settings.readTimeoutDs;
+
+        if (tcsetattr(m_fd, TCSANOW, &tty) != 0)
+        {
+            msg_warning("HapticAvatar_TransportPosix") << "ALERT: Could not set Serial Port parameters of " << portName << ": " << std::strerror(errno);
+            return false;
+        }
+
+        return true;
+    }
+
+
+    void HapticAvatar_TransportPosix::setLowLatency(const std::string& portName)
+    {
+#ifdef __linux__
+        struct serial_struct serial;
+        if (ioctl(m_fd, TIOCGSERIAL, &serial) == 0)
+        {
+            serial.flags |= ASYNC_LOW_LATENCY;
+            if (ioctl(m_fd, TIOCSSERIAL, &serial) == 0)
+                return;
+        }
+        msg_info("HapticAvatar_TransportPosix") << "Low latency flag not supported by the driver of " << portName;
+#else
+        SOFA_UNUSED(portName);
+#endif
+    }
+
+
+    void HapticAvatar_TransportPosix::close()
+    {
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+
+    int HapticAvatar_TransportPosix::read(char* buffer, unsigned int nbChar, int* queue, bool do_flush)
+    {
+        int available = 0;
+        if (ioctl(m_fd, FIONREAD, &available) != 0)
+            available = 0;
+        *queue = available;
+
+        if (do_flush)
+        {
+            // only read away what is already there
+            if (available <= 0)
+                return 0;
+            nbChar = std::min((unsigned int)(available), nbChar);
+        }
+
+        // Blocking in the kernel until VMIN bytes or VTIME elapsed.
+        ssize_t bytesRead = ::read(m_fd, buffer, nbChar);
+        if (bytesRead < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+                return 0;
+            return -1;
+        }
+
+        return (int)bytesRead;
+    }
+
+
+    WaitStatus HapticAvatar_TransportPosix::waitReadable(const Deadline& deadline)
+    {
+        struct pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLIN;
+
+        while (true)
+        {
+            pfd.revents = 0;
+            const auto now = std::chrono::steady_clock::now();
+            const long long remainingNs = (deadline > now) ? std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count() : 0;
+
+#ifdef __linux__
+            struct timespec timeout;
+            timeout.tv_sec = time_t(remainingNs / 1000000000LL);
+            timeout.tv_nsec = long(remainingNs % 1000000000LL);
+            int res = ppoll(&pfd, 1, &timeout, nullptr);
+#else
+            int res = poll(&pfd, 1, int((remainingNs + 999999LL) / 1000000LL));
+#endif
+            if (res > 0)
+            {
+                if (pfd.revents & POLLIN)
+                    return WaitStatus::Ready;
+                return WaitStatus::Error; // POLLERR, POLLHUP or POLLNVAL
+            }
+            else if (res == 0)
+                return WaitStatus::Timeout;
+            else if (errno != EINTR)
+                return WaitStatus::Error;
+        }
+    }
+
+
+    bool HapticAvatar_TransportPosix::write(const char* buffer, unsigned int nbChar)
+    {
+        unsigned int bytesSend = 0;
+        while (bytesSend < nbChar)
+        {
+            ssize_t n = ::write(m_fd, buffer + bytesSend, nbChar - bytesSend);
+            if (n < 0)
+            {
+                if (errno == EINTR || errno == EAGAIN)
+                    continue;
+
+                msg_error("HapticAvatar_TransportPosix") << "Failed to write " << nbChar << " bytes. Error returned: " << std::strerror(errno);
+                return false;
+            }
+            bytesSend += (unsigned int)n;
+        }
+        return true;
+    }
+
+} // namespace sofa::HapticAvatar
+
+#endif // WIN32
@@ -0,0 +1,68 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/HapticAvatar_Transport.h>
+
+#ifndef WIN32
+
+namespace sofa::HapticAvatar
+{
+
+    /**
+    * Serial transport based on POSIX termios. The line is set in raw mode and reads are
+    * blocking in the kernel following the VMIN/VTIME values of @sa TransportSettings.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_TransportPosix : public HapticAvatar_Transport
+    {
+    public:
+        HapticAvatar_TransportPosix(const TransportSettings& settings);
+
+        virtual ~HapticAvatar_TransportPosix();
+
+        bool open(const std::string& portName) override;
+        void close() override;
+        bool isOpen() const override { return m_fd >= 0; }
+
+        int read(char* buffer, unsigned int nbChar, int* queue, bool do_flush) override;
+        WaitStatus waitReadable(const Deadline& deadline) override;
+        bool write(const char* buffer, unsigned int nbChar) override;
+        int getPollHandle() const override { return m_fd; }
+
+        /// File descriptor of the serial line, -1 if not open.
+        int getFileDescriptor() const { return m_fd; }
+
+    protected:
+        /// Internal method to set raw mode, baud rate and VMIN/VTIME on the line.
+        bool configureLine(const std::string& portName);
+
+        /// Internal method to request the low latency flag from the serial driver. Not fatal if refused.
+        void setLowLatency(const std::string& portName);
+
+    private:
+        // File descriptor of the serial line
+        int m_fd;
+    };
+
+} // namespace sofa::HapticAvatar
+
+#endif // WIN32
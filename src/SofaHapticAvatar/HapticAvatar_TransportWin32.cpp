@@ -0,0 +1,232 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+#include <SofaHapticAvatar/HapticAvatar_TransportWin32.h>
+#include <sofa/helper/logging/Messaging.h>
+
+#ifdef WIN32
+
+#include <algorithm>
+#include <chrono>
+
+namespace sofa::HapticAvatar
+{
+
+    HapticAvatar_TransportWin32::HapticAvatar_TransportWin32(const TransportSettings& settings)
+        : HapticAvatar_Transport(settings)
+        , m_connected(false)
+        , m_hSerial(INVALID_HANDLE_VALUE)
+        , m_errors(0)
+        , m_pendingByte(0)
+        , m_hasPendingByte(false)
+        , m_readTimeoutMs(0)
+    {
+
+    }
+
+
+    HapticAvatar_TransportWin32::~HapticAvatar_TransportWin32()
+    {
+        close();
+    }
+
+
+    bool HapticAvatar_TransportWin32::open(const std::string& portName)
+    {
+        //Try to connect to the given port throuh CreateFile
+        m_hSerial = CreateFileA(portName.c_str(),
+            GENERIC_READ | GENERIC_WRITE,
+            0,
+            NULL,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            NULL
+        );
+
+        //Check if the connection was successfull
+        if (m_hSerial == INVALID_HANDLE_VALUE)
+        {
+            //If not success full display an Error
+            if (GetLastError() == ERROR_FILE_NOT_FOUND) {
+
+                //Print Error if neccessary
+                msg_error("HapticAvatar_TransportWin32") << "Handle was not attached. Reason: " << portName << " not available.";
+            }
+            else
+            {
+                msg_error("HapticAvatar_TransportWin32") << "Unknown error occured!";
+            }
+            return false;
+        }
+
+        //If connected we try to set the comm parameters
+        DCB dcbSerialParams = { 0 };
+
+        //Try to get the current
+        if (!GetCommState(m_hSerial, &dcbSerialParams))
+        {
+            //If impossible, show an error
+            msg_warning("HapticAvatar_TransportWin32") << "Failed to get current serial parameters!";
+            CloseHandle(m_hSerial);
+            m_hSerial = INVALID_HANDLE_VALUE;
+            return false;
+        }
+
+        //Define serial connection parameters for the arduino board
+        dcbSerialParams.BaudRate = m_settings.baudRate;
+        dcbSerialParams.ByteSize = 8;
+        dcbSerialParams.StopBits = ONESTOPBIT;
+        dcbSerialParams.Parity = NOPARITY;
+        //Setting the DTR to Control_Enable ensures that the Arduino is properly
+        //reset upon establishing a connection
+        dcbSerialParams.fDtrControl = DTR_CONTROL_ENABLE;
+
+        //Set the parameters and check for their proper application
+        if (!SetCommState(m_hSerial, &dcbSerialParams))
+        {
+            msg_warning("HapticAvatar_TransportWin32") << "ALERT: Could not set Serial Port parameters";
+            CloseHandle(m_hSerial);
+            m_hSerial = INVALID_HANDLE_VALUE;
+            return false;
+        }
+
+        //If everything went fine we're connected
+        m_connected = true;
+        m_hasPendingByte = false;
+        m_readTimeoutMs = 0;
+        //Flush any remaining characters in the buffers
+        PurgeComm(m_hSerial, PURGE_RXCLEAR | PURGE_TXCLEAR);
+        //We wait 2s as the arduino board will be reseting
+        Sleep(m_settings.resetWaitMs);
+
+        return true;
+    }
+
+
+    void HapticAvatar_TransportWin32::close()
+    {
+        //Check if we are connected before trying to disconnect
+        if (m_connected)
+        {
+            //We're no longer connected
+            m_connected = false;
+            //Close the serial handler
+            CloseHandle(m_hSerial);
+            m_hSerial = INVALID_HANDLE_VALUE;
+        }
+    }
+
+
+    int HapticAvatar_TransportWin32::read(char* buffer, unsigned int nbChar, int* queue, bool do_flush)
+    {
+        //Number of bytes we'll have read
+        DWORD bytesRead = 0;
+
+        //Use the ClearCommError function to get status info on the Serial port
+        ClearCommError(m_hSerial, &m_errors, &m_status);
+
+        *queue = (int)m_status.cbInQue + (m_hasPendingByte ? 1 : 0);
+        if (nbChar == 0)
+            return 0;
+
+        // the byte read while waiting comes first
+        unsigned int offset = 0;
+        if (m_hasPendingByte)
+        {
+            buffer[0] = m_pendingByte;
+            m_hasPendingByte = false;
+            offset = 1;
+        }
+
+        // Never read more than the queue: ReadFile would otherwise wait for the missing bytes.
+        DWORD toRead = std::min((unsigned int)m_status.cbInQue, nbChar - offset);
+        if (toRead == 0)
+            return (int)offset;
+
+        if (!ReadFile(m_hSerial, buffer + offset, toRead, &bytesRead, NULL))
+            return (offset > 0) ? (int)offset : -1;
+
+        return (int)(offset + bytesRead);
+    }
+
+
+    WaitStatus HapticAvatar_TransportWin32::waitReadable(const Deadline& deadline)
+    {
+        if (m_hasPendingByte)
+            return WaitStatus::Ready;
+
+        if (!ClearCommError(m_hSerial, &m_errors, &m_status))
+            return WaitStatus::Error;
+
+        if (m_status.cbInQue > 0)
+            return WaitStatus::Ready;
+
+        const auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= std::chrono::steady_clock::duration::zero())
+            return WaitStatus::Timeout;
+
+        // MAXDWORD interval and multiplier: ReadFile returns as soon as one byte is received, or after the constant if none is
+        DWORD timeoutMs = (DWORD)std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+        timeoutMs = std::max<DWORD>(1, std::min<DWORD>(timeoutMs, MAXDWORD - 1));
+        if (timeoutMs != m_readTimeoutMs)
+        {
+            COMMTIMEOUTS timeouts = { 0 };
+            timeouts.ReadIntervalTimeout = MAXDWORD;
+            timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+            timeouts.ReadTotalTimeoutConstant = timeoutMs;
+            if (!SetCommTimeouts(m_hSerial, &timeouts))
+                return WaitStatus::Error;
+            m_readTimeoutMs = timeoutMs;
+        }
+
+        DWORD bytesRead = 0;
+        if (!ReadFile(m_hSerial, &m_pendingByte, 1, &bytesRead, NULL))
+            return WaitStatus::Error;
+
+        if (bytesRead == 0)
+            return WaitStatus::Timeout;
+
+        m_hasPendingByte = true;
+        return WaitStatus::Ready;
+    }
+
+
+    bool HapticAvatar_TransportWin32::write(const char* buffer, unsigned int nbChar)
+    {
+        DWORD bytesSend;
+
+        //Try to write the buffer on the Serial port
+        if (!WriteFile(m_hSerial, (const void*)buffer, nbChar, &bytesSend, 0))
+        {
+            //In case it don't work get comm error and return false
+            ClearCommError(m_hSerial, &m_errors, &m_status);
+
+            msg_error("HapticAvatar_TransportWin32") << "Failed to write " << nbChar << " bytes. Error returned: " << m_errors;
+            return false;
+        }
+        else
+            return true;
+    }
+
+} // namespace sofa::HapticAvatar
+
+#endif // WIN32
@@ -0,0 +1,73 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/HapticAvatar_Transport.h>
+
+#ifdef WIN32
+#include <windows.h>
+
+namespace sofa::HapticAvatar
+{
+
+    /**
+    * Serial transport based on the Win32 communication API.
+    */
+    class SOFA_HAPTICAVATAR_API HapticAvatar_TransportWin32 : public HapticAvatar_Transport
+    {
+    public:
+        HapticAvatar_TransportWin32(const TransportSettings& settings);
+
+        virtual ~HapticAvatar_TransportWin32();
+
+        bool open(const std::string& portName) override;
+        void close() override;
+        bool isOpen() const override { return m_connected; }
+
+        int read(char* buffer, unsigned int nbChar, int* queue, bool do_flush) override;
+        /** Waits in a ReadFile of one byte, with the comm timeouts set to return as soon as a byte arrives or at the deadline, rounded up to
+        * the millisecond. The byte read is kept and returned first by the next @sa read.
+        */
+        WaitStatus waitReadable(const Deadline& deadline) override;
+        bool write(const char* buffer, unsigned int nbChar) override;
+
+    private:
+        //Connection status
+        bool m_connected;
+
+        //Serial comm handler
+        HANDLE m_hSerial;
+        //Get various information about the connection
+        COMSTAT m_status;
+        //Keep track of last error
+        DWORD m_errors;
+
+        // byte read by waitReadable, not returned yet
+        char m_pendingByte;
+        bool m_hasPendingByte;
+        // ReadTotalTimeoutConstant currently set, 0 if the timeouts have not been set
+        DWORD m_readTimeoutMs;
+    };
+
+} // namespace sofa::HapticAvatar
+
+#endif // WIN32
@@ -0,0 +1,86 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <SofaHapticAvatar/config.h>
+#include <atomic>
+#include <cstdint>
+
+namespace sofa::HapticAvatar
+{
+
+    /**
+    * Wait-free single producer, single consumer exchange of the latest value of a struct between two threads.
+    * The producer writes in its own slot and swaps it with the shared middle slot on @sa publish, the consumer swaps
+    * the middle slot with its own on @sa fetch when a new value has been published. Neither side ever waits for the other,
+    * and the consumer always gets a complete value: the one of the last publish, never a mix of two.
+    * Values not fetched before the next publish are overwritten, only the latest one matters.
+    */
+    template <class T>
+    class HapticAvatar_TripleBuffer
+    {
+    public:
+        HapticAvatar_TripleBuffer()
+            : m_middle(1)
+            , m_back(0)
+            , m_front(2)
+        {}
+
+        /// Producer side: make @param value the latest value. Only to be called from one thread.
+        void publish(const T& value)
+        {
+            m_slots[m_back].value = value;
+            // hand our slot over as the new middle one, marked as fresh, and take the previous middle one
+            m_back = m_middle.exchange(uint8_t(m_back | FRESH), std::memory_order_acq_rel) & INDEX_MASK;
+        }
+
+        /** Consumer side: get the latest value published. Only to be called from one thread.
+        * @param {T} value: receives the latest value if a new one has been published since the last fetch, unchanged otherwise.
+        * @returns {bool} true if @param value has been updated.
+        */
+        bool fetch(T& value)
+        {
+            if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0)
+                return false;
+
+            m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX_MASK;
+            value = m_slots[m_front].value;
+            return true;
+        }
+
+    protected:
+        static constexpr uint8_t INDEX_MASK = 0x3;
+        static constexpr uint8_t FRESH = 0x4;
+
+        // each slot on its own cache line, the two threads write in different ones
+        struct alignas(64) Slot
+        {
+            T value{};
+        };
+
+        Slot m_slots[3];
+        alignas(64) std::atomic<uint8_t> m_middle; // index of the middle slot and FRESH flag
+        alignas(64) uint8_t m_back;   // slot owned by the producer
+        alignas(64) uint8_t m_front;  // slot owned by the consumer
+    };
+
+} // namespace sofa::HapticAvatar
@@ -0,0 +1,150 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace sofa::HapticAvatar
+{
+
+    /**
+    * Wire formats understood by the Haptic Avatar devices.
+    * Ascii is the historical "cmd args ... \n" format, always available.
+    * Binary is a framed format negotiated with @sa PROTOCOL_SELECT_CMD. All integers are little-endian:
+    *
+    *   header  : uint8 sync0 (0xA5), uint8 sync1 (0x5A), uint8 frame type, uint8 count, uint16 payload length, uint16 sequence number
+    *   request : count entries of { uint8 command id, uint8 number of args, int32 args[] }
+    *   reply   : int32 values, in the order of the request commands, num_return_vals per command. count is not used.
+    *             The sequence number is the one of the request it answers.
+    *   stream  : count entries of { uint8 command id, uint8 number of values, int32 values[] }, pushed by the device without request
+    *             for the commands registered with @sa wire::STREAM_SUBSCRIBE_CMD. The sequence number counts the stream frames.
+    *
+    * Values are the same scaled integers as in the Ascii format, see scale_factor in @sa HapticAvatar_DriverBase.
+    */
+    enum class WireProtocol
+    {
+        Ascii = 0,
+        Binary = 1
+    };
+
+    namespace wire
+    {
+        /// Ascii command id used to switch protocol. Not part of any device command table.
+        /// Sent as "255 <version> \n", a device supporting the protocol answers "<version> \n" and switches after its reply.
+        constexpr int PROTOCOL_SELECT_CMD = 255;
+        constexpr int BINARY_PROTOCOL_VERSION = 1;
+
+        /// Binary command registering a stream subscription, args { command id, period in microseconds }. A period of 0 removes it.
+        /// The device answers 1 if the subscription is accepted, 0 otherwise. Not part of any device command table.
+        constexpr int STREAM_SUBSCRIBE_CMD = 254;
+
+        constexpr uint8_t SYNC0 = 0xA5;
+        constexpr uint8_t SYNC1 = 0x5A;
+        constexpr int HEADER_SIZE = 8;
+        constexpr int ENTRY_HEADER_SIZE = 2;
+        constexpr int VALUE_SIZE = 4;
+
+        enum FrameType : uint8_t
+        {
+            FRAME_REQUEST = 1,
+            FRAME_REPLY = 2,
+            FRAME_STREAM = 3
+        };
+
+        struct FrameHeader
+        {
+            uint8_t type = 0;
+            uint8_t count = 0;
+            uint16_t payloadLength = 0;
+            uint16_t seq = 0;
+        };
+
+        inline void writeUInt16(char* out, uint16_t value)
+        {
+            out[0] = char(value & 0xFF);
+            out[1] = char((value >> 8) & 0xFF);
+        }
+
+        inline uint16_t readUInt16(const char* in)
+        {
+            return uint16_t(uint8_t(in[0]) | (uint16_t(uint8_t(in[1])) << 8));
+        }
+
+        inline void writeInt32(char* out, int32_t value)
+        {
+            const uint32_t u = uint32_t(value);
+            out[0] = char(u & 0xFF);
+            out[1] = char((u >> 8) & 0xFF);
+            out[2] = char((u >> 16) & 0xFF);
+            out[3] = char((u >> 24) & 0xFF);
+        }
+
+        inline int32_t readInt32(const char* in)
+        {
+            const uint32_t u = uint32_t(uint8_t(in[0]))
+                | (uint32_t(uint8_t(in[1])) << 8)
+                | (uint32_t(uint8_t(in[2])) << 16)
+                | (uint32_t(uint8_t(in[3])) << 24);
+            return int32_t(u);
+        }
+
+        /// Write a frame header at @param out. Returns the number of bytes written.
+        inline int writeHeader(char* out, const FrameHeader& header)
+        {
+            out[0] = char(SYNC0);
+            out[1] = char(SYNC1);
+            out[2] = char(header.type);
+            out[3] = char(header.count);
+            writeUInt16(out + 4, header.payloadLength);
+            writeUInt16(out + 6, header.seq);
+            return HEADER_SIZE;
+        }
+
+        /// Decode a frame header from @param in, which must hold at least HEADER_SIZE bytes. Returns false if the sync bytes are wrong.
+        inline bool readHeader(const char* in, FrameHeader& header)
+        {
+            if (uint8_t(in[0]) != SYNC0 || uint8_t(in[1]) != SYNC1)
+                return false;
+            header.type = uint8_t(in[2]);
+            header.count = uint8_t(in[3]);
+            header.payloadLength = readUInt16(in + 4);
+            header.seq = readUInt16(in + 6);
+            return true;
+        }
+
+        /// Write one request entry at @param out. Returns the number of bytes written.
+        inline int writeEntry(char* out, int cmd, const int* args, int numArgs)
+        {
+            out[0] = char(uint8_t(cmd));
+            out[1] = char(uint8_t(numArgs));
+            for (int i = 0; i < numArgs; i++)
+                writeInt32(out + ENTRY_HEADER_SIZE + i * VALUE_SIZE, args[i]);
+            return ENTRY_HEADER_SIZE + numArgs * VALUE_SIZE;
+        }
+
+        /// Size in bytes of a request entry with @param numArgs arguments.
+        constexpr int entrySize(int numArgs) { return ENTRY_HEADER_SIZE + numArgs * VALUE_SIZE; }
+
+    } // namespace wire
+
+} // namespace sofa::HapticAvatar
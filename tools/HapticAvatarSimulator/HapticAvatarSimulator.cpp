@@ -0,0 +1,799 @@
+/******************************************************************************
+*       SOFA, Simulation Open-Framework Architecture, development version     *
+*                (c) 2006-2019 INRIA, USTL, UJF, CNRS, MGH                    *
+*                                                                             *
+* This program is free software; you can redistribute it and/or modify it     *
+* under the terms of the GNU Lesser General Public License as published by    *
+* the Free Software Foundation; either version 2.1 of the License, or (at     *
+* your option) any later version.                                             *
+*                                                                             *
+* This program is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License *
+* for more details.                                                           *
+*                                                                             *
+* You should have received a copy of the GNU Lesser General Public License    *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.        *
+*******************************************************************************
+* Authors: The SOFA Team and external contributors (see Authors.txt)          *
+*                                                                             *
+* Contact information: contact@sofa-framework.org                             *
+******************************************************************************/
+
+/**
+* HapticAvatarSimulator: standalone simulator of the Haptic Avatar devices (Port, IBox and Scope) on a pseudo-terminal.
+* The drivers connect to the slave side of the pty (/dev/pts/N) as to a real serial port. Both the Ascii and the
+* negotiated binary wire protocols are answered, see HapticAvatar_WireProtocol.h.
+* Example: "HapticAvatarSimulator --device port --link /tmp/HA_Port --delay-us 300" then use portName="/tmp/HA_Port" in the scene.
+* Closing the port resets the simulated device to the Ascii protocol, as the DTR reset of a real device.
+* In binary mode, commands registered with wire::STREAM_SUBSCRIBE_CMD are pushed in stream frames at their period.
+*
+* The command tables below mirror the CmdPort, CmdIBox and CmdScope enums of the drivers, and must be kept in the same order.
+*/
+
+#include <SofaHapticAvatar/HapticAvatar_WireProtocol.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <csignal>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace sofa::HapticAvatar;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    /// Description of one device command: number of Ascii arguments, number of return values and the scale of the values.
+    struct SimCommand
+    {
+        const char* name;
+        int numArgs;
+        int numReturnVals;
+        float scale;
+    };
+
+    // Same order as HapticAvatar_DriverPort::CmdPort
+    const SimCommand portCommands[] = {
+        { "RESET", 1, 1, 1.0f },
+        { "GET_DEVICE_TYPE", 0, 1, 1.0f },
+        { "GET_ANGLES_AND_LENGTH", 0, 4, 10000.0f },
+        { "GET_TOOL_ID", 0, 1, 1.0f },
+        { "GET_CURRENT_DELTA_T", 0, 1, 10000.0f },
+        { "GET_STATUS", 0, 1, 1.0f },
+        { "SET_MOTOR_FORCE_AND_TORQUES", 4, 0, 10000.0f },
+        { "SET_TIP_FORCE_AND_ROT_TORQUE", 4, 0, 10000.0f },
+        { "SET_YAW_PITCH_ZERO_ANG", 2, 0, 10000.0f },
+        { "SET_LED_BLINK_MODE", 1, 0, 1.0f },
+        { "SET_COLLISION_OBJECT", 19, 0, 10000.0f },
+        { "SET_COLLISION_OBJECT_ACTIVE", 2, 0, 1.0f },
+        { "SET_COLLISION_OBJECT_P0", 4, 0, 10000.0f },
+        { "SET_COLLISION_OBJECT_V0", 4, 0, 10000.0f },
+        { "SET_COLLISION_OBJECT_N", 4, 0, 10000.0f },
+        { "SET_COLLISION_OBJECT_Q", 2, 0, 10000.0f },
+        { "SET_COLLISION_OBJECT_R", 2, 0, 10000.0f },
+        { "SET_COLLISION_OBJECT_S", 2, 0, 10000.0f },
+        { "SET_COLLISION_OBJECT_T", 2, 0, 10000.0f },
+        { "SET_COLLISION_OBJECT_STIFFNESS", 2, 0, 10000.0f },
+        { "SET_COLLISION_OBJECT_DAMPING", 2, 0, 10000.0f },
+        { "SET_COLLISION_OBJECT_FRICTION", 2, 0, 10000.0f },
+        { "GET_LAST_COLLISION_FORCE", 0, 3, 10000.0f },
+        { "GET_LAST_PWM", 0, 4, 1.0f },
+        { "GET_LAST_COLLISION_DATA", 0, 1, 10000.0f },
+        { "SET_TOOL_JAW_OPENING_ANGLE", 1, 0, 10000.0f },
+        { "GET_TOOL_JAW_TORQUE", 0, 1, 10000.0f },
+        { "SET_TOOL_DATA", 4, 0, 10000.0f },
+        { "GET_TOOL_INSERTED", 0, 1, 1.0f },
+        { "GET_TOOL_TIP_VELOCITY", 0, 3, 10000.0f },
+        { "GET_TOOL_TIP_POSITION", 0, 3, 10000.0f },
+        { "GET_TOOL_DIRECTION", 0, 3, 10000.0f },
+        { "GET_RAW_ENCODER_VALUES", 0, 4, 1.0f },
+        { "GET_ENCODER_SCALING_VALUES", 0, 4, 10000.0f },
+        { "GET_MOTOR_SCALING_VALUES", 0, 4, 10000.0f },
+        { "SET_MANUAL_PWM", 4, 0, 1.0f },
+        { "GET_BOARD_TEMP", 0, 1, 10000.0f },
+        { "GET_BATTERY_VOLTAGE", 0, 1, 10000.0f },
+        { "GET_CALIBRATION_STATUS", 0, 3, 1.0f },
+        { "GET_AMPLIFIERS_STATUS", 0, 4, 10000.0f },
+        { "GET_HALL_STATES", 0, 2, 1.0f },
+        { "SET_POWER_ON_MANUAL", 1, 0, 1.0f },
+        { "SET_FAN_ON_MANUAL", 1, 0, 1.0f },
+        { "SET_FF_ENABLE", 1, 0, 1.0f },
+        { "GET_SERIAL_NUM", 0, 1, 1.0f },
+        { "GET_BUILD_DATE", 0, 1, 1.0f },
+        { "SET_CHARGE_ENABLE", 1, 0, 1.0f },
+        { "GET_TIP_LENGTH", 0, 1, 10000.0f },
+        { "GET_PART_TEMPERATURES", 0, 12, 10.0f },
+        { "SET_MAX_USB_CHARGE_CURRENT", 1, 0, 1.0f },
+        { "GET_USB_CHARGING_CURRENT", 0, 1, 10000.0f },
+        { "SET_DEADBAND_PWM_WIDTH", 4, 1, 1.0f },
+    };
+
+    // Same order as HapticAvatar_DriverIbox::CmdIBox, with IBOX_NUM_CHANNELS = 6
+    const SimCommand iboxCommands[] = {
+        { "RESET", 1, 1, 1.0f },
+        { "GET_DEVICE_TYPE", 0, 1, 1.0f },
+        { "GET_OPENING_VALUES", 0, 6, 10000.0f },
+        { "GET_HANDLE_IDS", 0, 6, 10000.0f },
+        { "GET_PEDAL_STATES", 0, 2, 1.0f },
+        { "SET_ALL_FORCES", 6, 0, 10000.0f },
+        { "SET_CHAN_FORCE", 2, 0, 10000.0f },
+        { "GET_STATUS", 0, 1, 1.0f },
+        { "GET_CALIBRATION_STATUS", 0, 6, 1.0f },
+        { "GET_MOTOR_BOARD_STATUS", 0, 6, 1.0f },
+        { "GET_BATTERY_VOLTAGE", 0, 1, 10000.0f },
+        { "GET_BOARD_TEMP", 0, 1, 10000.0f },
+        { "SET_MANUAL_PWM", 6, 0, 1.0f },
+        { "SET_POWER_ON_MANUAL", 1, 0, 1.0f },
+        { "SET_FAN_ON_MANUAL", 1, 0, 1.0f },
+        { "GET_LAST_PWM", 0, 6, 1.0f },
+        { "SET_FF_ENABLE", 1, 0, 1.0f },
+        { "GET_CURRENT_DELTA_T", 0, 1, 10000.0f },
+        { "SET_LOOP_GAIN", 3, 0, 10000.0f },
+        { "GET_OPTO_FORCES", 0, 6, 10000.0f },
+        { "SET_ZERO_FORCE", 1, 0, 1.0f },
+        { "GET_POS_VOLTAGES", 0, 6, 10000.0f },
+        { "GET_HANDLE_IDS_REAL", 0, 6, 10000.0f },
+        { "GET_BUILD_DATE", 0, 1, 1.0f },
+        { "GET_SERIAL_NUM", 0, 1, 1.0f },
+        { "SET_CHARGE_ENABLE", 1, 0, 1.0f },
+        { "SET_HANDLE_LED", 2, 0, 1.0f },
+        { "GET_OPTO_VOLTAGES", 0, 6, 10000.0f },
+        { "SET_TO_CALIBRATE", 1, 0, 1.0f },
+        { "GET_PART_TEMPERATURES", 0, 11, 1.0f },
+        { "SET_MAX_USB_CHARGE_CURRENT", 1, 0, 10000.0f },
+        { "GET_USB_CHARGING_CURRENT", 0, 1, 1.0f },
+        { "GET_CONNECTION_STATES", 0, 1, 1.0f },
+        { "GET_HANDLES_ACTIVITY", 0, 1, 1.0f },
+        { "SET_FORCE_OFFSET", 2, 0, 10000.0f },
+    };
+
+    // Same order as HapticAvatar_DriverScope::CmdScope
+    const SimCommand scopeCommands[] = {
+        { "RESET", 1, 1, 1.0f },
+        { "GET_DEVICE_TYPE", 0, 1, 1.0f },
+        { "GET_BUTTON_STATES", 0, 3, 1.0f },
+        { "GET_ZOOM_LEVEL", 0, 1, 1.0f },
+        { "GET_CAMERA_ANGLE", 0, 1, 10000.0f },
+        { "GET_CRC_POLY", 0, 1, 1.0f },
+        { "GET_CURRENT_DELTA_T", 0, 1, 10000.0f },
+        { "GET_SERIAL_NUM", 0, 1, 1.0f },
+    };
+
+    /// Options of the simulator, set from the command line.
+    struct SimSettings
+    {
+        int deviceType = 1;          // 1 = Port, 2 = IBox, 3 = Scope, as device_type in the drivers
+        std::string link;            // optional symlink to the slave side of the pty
+        int delayUs = 200;           // time between the end of a request and its reply
+        int jitterUs = 0;            // uniform random jitter added to the delay
+        double dropRate = 0.0;       // probability to not answer a request
+        double frequency = 0.5;      // frequency of the encoder trajectories, in Hz
+        double amplitude = 1.0;      // scale of the encoder trajectories
+        int serialNumber = 1234567;
+        bool asciiOnly = false;      // behave as an older firmware without binary protocol
+        bool verbose = false;
+    };
+
+    /// Command pushed by the device at its own period, registered with wire::STREAM_SUBSCRIBE_CMD.
+    struct StreamSubscription
+    {
+        int cmd;
+        std::chrono::microseconds period;
+        Clock::time_point nextDue;
+    };
+
+    /// Reply waiting for its due time before being written on the pty.
+    struct PendingReply
+    {
+        Clock::time_point due;
+        std::string bytes;
+    };
+
+    volatile std::sig_atomic_t s_running = 1;
+
+    void stopSimulator(int)
+    {
+        s_running = 0;
+    }
+
+
+    /**
+    * Simulated device: decodes the requests received on the master side of the pty and answers them with
+    * values computed from the command tables and a time-based trajectory.
+    */
+    class SimDevice
+    {
+    public:
+        SimDevice(const SimSettings& settings)
+            : m_settings(settings)
+            , m_protocol(WireProtocol::Ascii)
+            , m_start(Clock::now())
+            , m_random(std::random_device{}())
+        {
+            switch (settings.deviceType)
+            {
+            case 2: m_commands = iboxCommands; m_numCommands = int(sizeof(iboxCommands) / sizeof(SimCommand)); break;
+            case 3: m_commands = scopeCommands; m_numCommands = int(sizeof(scopeCommands) / sizeof(SimCommand)); break;
+            default: m_commands = portCommands; m_numCommands = int(sizeof(portCommands) / sizeof(SimCommand)); break;
+            }
+            m_lastArgs.resize(m_numCommands);
+        }
+
+        /// Consume the bytes received from the driver, queue the replies in @param replies.
+        void receive(const char* data, int size, std::deque<PendingReply>& replies)
+        {
+            m_input.append(data, size);
+            if (m_protocol == WireProtocol::Binary)
+                processBinary(replies);
+            else
+                processAscii(replies);
+        }
+
+        /// Back to the power-on state, as the real devices do when the port is reopened.
+        void reset()
+        {
+            m_protocol = WireProtocol::Ascii;
+            m_streams.clear();
+            m_input.clear();
+            for (auto& args : m_lastArgs)
+                args.clear();
+        }
+
+        /// Time of the next stream frame, or max() if nothing is streamed.
+        Clock::time_point getNextStreamDue() const
+        {
+            Clock::time_point next = Clock::time_point::max();
+            for (const auto& stream : m_streams)
+                if (stream.nextDue < next)
+                    next = stream.nextDue;
+            return next;
+        }
+
+        /// Build the stream frame of the subscriptions due at @param now. Returns an empty string if none is due.
+        std::string pushStream(Clock::time_point now)
+        {
+            std::string payload;
+            int count = 0;
+            char entry[wire::ENTRY_HEADER_SIZE + RESULT_MAX * wire::VALUE_SIZE];
+            for (auto& stream : m_streams)
+            {
+                if (stream.nextDue > now)
+                    continue;
+
+                int values[RESULT_MAX];
+                const int n = getValues(stream.cmd, nullptr, 0, values);
+                payload.append(entry, wire::writeEntry(entry, stream.cmd, values, n));
+                count++;
+
+                // keep the period without drift, skip the periods missed
+                stream.nextDue += stream.period;
+                if (stream.nextDue < now)
+                    stream.nextDue = now + stream.period;
+            }
+            if (count == 0)
+                return std::string();
+
+            wire::FrameHeader header;
+            header.type = wire::FRAME_STREAM;
+            header.count = uint8_t(count);
+            header.payloadLength = uint16_t(payload.size());
+            header.seq = ++m_streamSeq;
+            char headerBytes[wire::HEADER_SIZE];
+            wire::writeHeader(headerBytes, header);
+            m_numStreamFrames++;
+            return std::string(headerBytes, wire::HEADER_SIZE) + payload;
+        }
+
+        uint64_t getNumStreamFrames() const { return m_numStreamFrames; }
+        uint64_t getNumRequests() const { return m_numRequests; }
+        uint64_t getNumDropped() const { return m_numDropped; }
+
+    protected:
+        void processAscii(std::deque<PendingReply>& replies)
+        {
+            size_t eol;
+            while (m_protocol == WireProtocol::Ascii && (eol = m_input.find('\n')) != std::string::npos)
+            {
+                std::string line = m_input.substr(0, eol);
+                m_input.erase(0, eol + 1);
+
+                std::vector<int> tokens;
+                const char* p = line.c_str();
+                char* end = nullptr;
+                while (true)
+                {
+                    long v = std::strtol(p, &end, 10);
+                    if (end == p)
+                        break;
+                    tokens.push_back(int(v));
+                    p = end;
+                }
+
+                std::string reply;
+                bool switchToBinary = false;
+                size_t k = 0;
+                while (k < tokens.size())
+                {
+                    const int cmd = tokens[k++];
+                    if (cmd == wire::PROTOCOL_SELECT_CMD)
+                    {
+                        const int version = (k < tokens.size()) ? tokens[k++] : 0;
+                        if (m_settings.asciiOnly)
+                            break; // unknown command for an older firmware
+                        reply += std::to_string(version == wire::BINARY_PROTOCOL_VERSION ? version : 0) + " ";
+                        switchToBinary = (version == wire::BINARY_PROTOCOL_VERSION);
+                        continue;
+                    }
+                    if (cmd < 0 || cmd >= m_numCommands)
+                    {
+                        std::cerr << "Unknown command " << cmd << " in line '" << line << "'" << std::endl;
+                        break;
+                    }
+
+                    const int numArgs = std::min(m_commands[cmd].numArgs, int(tokens.size() - k));
+                    execute(cmd, tokens.data() + k, numArgs);
+                    k += numArgs;
+
+                    int values[RESULT_MAX];
+                    const int n = getValues(cmd, tokens.empty() ? nullptr : tokens.data() + k - numArgs, numArgs, values);
+                    for (int i = 0; i < n; i++)
+                        reply += std::to_string(values[i]) + " ";
+                }
+
+                m_numRequests++;
+                if (!reply.empty())
+                    queueReply(reply + "\n", replies);
+
+                if (switchToBinary)
+                {
+                    m_protocol = WireProtocol::Binary;
+                    if (m_settings.verbose)
+                        std::cout << "Switched to binary protocol" << std::endl;
+                    processBinary(replies);
+                }
+            }
+        }
+
+        void processBinary(std::deque<PendingReply>& replies)
+        {
+            while (m_protocol == WireProtocol::Binary)
+            {
+                // resynchronize on the sync bytes
+                size_t start = 0;
+                while (start + 1 < m_input.size() && !(uint8_t(m_input[start]) == wire::SYNC0 && uint8_t(m_input[start + 1]) == wire::SYNC1))
+                    start++;
+                m_input.erase(0, start);
+
+                wire::FrameHeader header;
+                if (m_input.size() < size_t(wire::HEADER_SIZE) || !wire::readHeader(m_input.data(), header))
+                    return;
+                if (m_input.size() < size_t(wire::HEADER_SIZE + header.payloadLength))
+                    return;
+
+                const char* entry = m_input.data() + wire::HEADER_SIZE;
+                const char* payloadEnd = entry + header.payloadLength;
+                std::string payload;
+                bool switchToAscii = false;
+                char value[wire::VALUE_SIZE];
+                for (int e = 0; e < header.count && entry + wire::ENTRY_HEADER_SIZE <= payloadEnd; e++)
+                {
+                    const int cmd = uint8_t(entry[0]);
+                    const int numArgs = uint8_t(entry[1]);
+                    int args[32] = { 0 };
+                    for (int i = 0; i < numArgs && i < 32; i++)
+                        args[i] = wire::readInt32(entry + wire::ENTRY_HEADER_SIZE + i * wire::VALUE_SIZE);
+                    entry += wire::entrySize(numArgs);
+
+                    if (cmd == wire::PROTOCOL_SELECT_CMD)
+                    {
+                        wire::writeInt32(value, args[0]);
+                        payload.append(value, wire::VALUE_SIZE);
+                        switchToAscii = (args[0] == 0);
+                        continue;
+                    }
+                    if (cmd == wire::STREAM_SUBSCRIBE_CMD)
+                    {
+                        wire::writeInt32(value, subscribe(args[0], args[1]) ? 1 : 0);
+                        payload.append(value, wire::VALUE_SIZE);
+                        continue;
+                    }
+                    if (cmd >= m_numCommands)
+                    {
+                        std::cerr << "Unknown command " << cmd << " in frame " << header.seq << std::endl;
+                        continue;
+                    }
+
+                    execute(cmd, args, std::min(numArgs, 32));
+                    int values[RESULT_MAX];
+                    const int n = getValues(cmd, args, numArgs, values);
+                    for (int i = 0; i < n; i++)
+                    {
+                        wire::writeInt32(value, values[i]);
+                        payload.append(value, wire::VALUE_SIZE);
+                    }
+                }
+                m_input.erase(0, wire::HEADER_SIZE + header.payloadLength);
+                m_numRequests++;
+
+                if (header.type != wire::FRAME_REQUEST)
+                    continue;
+
+                // the device answers every request frame, even without value
+                wire::FrameHeader replyHeader;
+                replyHeader.type = wire::FRAME_REPLY;
+                replyHeader.payloadLength = uint16_t(payload.size());
+                replyHeader.seq = header.seq;
+                char headerBytes[wire::HEADER_SIZE];
+                wire::writeHeader(headerBytes, replyHeader);
+                queueReply(std::string(headerBytes, wire::HEADER_SIZE) + payload, replies, switchToAscii);
+
+                if (switchToAscii)
+                {
+                    m_protocol = WireProtocol::Ascii;
+                    m_streams.clear();
+                    if (m_settings.verbose)
+                        std::cout << "Switched to Ascii protocol" << std::endl;
+                    processAscii(replies);
+                }
+            }
+        }
+
+        void queueReply(const std::string& bytes, std::deque<PendingReply>& replies, bool neverDrop = false)
+        {
+            if (!neverDrop && m_settings.dropRate > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < m_settings.dropRate)
+            {
+                m_numDropped++;
+                return;
+            }
+
+            int delayUs = m_settings.delayUs;
+            if (m_settings.jitterUs > 0)
+                delayUs += std::uniform_int_distribution<int>(0, m_settings.jitterUs)(m_random);
+
+            // replies keep their order on the wire, even with jitter
+            Clock::time_point due = Clock::now() + std::chrono::microseconds(delayUs);
+            if (!replies.empty() && replies.back().due > due)
+                due = replies.back().due;
+            replies.push_back({ due, bytes });
+        }
+
+        /// Add, change or remove (@param periodUs = 0) the stream subscription of @param cmd. Only commands with return values can be streamed.
+        bool subscribe(int cmd, int periodUs)
+        {
+            for (size_t i = 0; i < m_streams.size(); i++)
+            {
+                if (m_streams[i].cmd == cmd)
+                {
+                    m_streams.erase(m_streams.begin() + i);
+                    break;
+                }
+            }
+
+            if (periodUs <= 0)
+                return true;
+            if (cmd < 0 || cmd >= m_numCommands || m_commands[cmd].numReturnVals == 0)
+                return false;
+
+            const std::chrono::microseconds period(periodUs);
+            m_streams.push_back({ cmd, period, Clock::now() + period });
+            if (m_settings.verbose)
+                std::cout << "Streaming " << m_commands[cmd].name << " every " << periodUs << " us" << std::endl;
+            return true;
+        }
+
+        /// Keep the arguments of the setter commands, some getters answer with them.
+        void execute(int cmd, const int* args, int numArgs)
+        {
+            m_lastArgs[cmd].assign(args, args + numArgs);
+        }
+
+        int lastArg(int cmd, int i) const
+        {
+            return (i < int(m_lastArgs[cmd].size())) ? m_lastArgs[cmd][i] : 0;
+        }
+
+        static constexpr int RESULT_MAX = 16;
+
+        /// Compute the scaled integer values returned by @param cmd. Returns the number of values.
+        int getValues(int cmd, const int* args, int numArgs, int* values)
+        {
+            const SimCommand& desc = m_commands[cmd];
+            const int n = desc.numReturnVals;
+            const double t = std::chrono::duration<double>(Clock::now() - m_start).count();
+            const double w = 2.0 * M_PI * m_settings.frequency;
+            const double a = m_settings.amplitude;
+            auto scaled = [&desc](double v) { return int(std::lround(v * desc.scale)); };
+
+            for (int i = 0; i < n; i++)
+                values[i] = 0;
+
+            const std::string name = desc.name;
+            if (name == "RESET")
+                values[0] = (numArgs > 0 && args) ? args[0] : 0;
+            else if (name == "GET_DEVICE_TYPE")
+                values[0] = m_settings.deviceType;
+            else if (name == "GET_SERIAL_NUM")
+                values[0] = m_settings.serialNumber;
+            else if (name == "GET_BUILD_DATE")
+                values[0] = 20210101;
+            else if (name == "GET_CURRENT_DELTA_T")
+                values[0] = scaled(0.05);
+            else if (name == "GET_BOARD_TEMP")
+                values[0] = scaled(35.0 + 0.5 * std::sin(0.01 * t));
+            else if (name == "GET_BATTERY_VOLTAGE")
+                values[0] = scaled(16.2);
+            else if (name == "GET_USB_CHARGING_CURRENT")
+                values[0] = scaled(0.5);
+            else if (name == "GET_PART_TEMPERATURES")
+            {
+                for (int i = 0; i < n; i++)
+                    values[i] = scaled(30.0 + i);
+            }
+            else if (name == "GET_CALIBRATION_STATUS")
+            {
+                for (int i = 0; i < n; i++)
+                    values[i] = 1;
+            }
+            // Port
+            else if (name == "GET_ANGLES_AND_LENGTH")
+            {
+                values[0] = scaled(a * 1.0 * std::sin(w * t));                  // rot
+                values[1] = scaled(a * 0.3 * std::sin(0.7 * w * t));            // pitch
+                values[2] = scaled(60.0 + a * 40.0 * std::sin(0.5 * w * t));    // z
+                values[3] = scaled(a * 0.3 * std::cos(0.9 * w * t));            // yaw
+            }
+            else if (name == "GET_RAW_ENCODER_VALUES")
+            {
+                values[0] = int(1000.0 * a * std::sin(w * t));
+                values[1] = int(300.0 * a * std::sin(0.7 * w * t));
+                values[2] = int(600.0 + 400.0 * a * std::sin(0.5 * w * t));
+                values[3] = int(300.0 * a * std::cos(0.9 * w * t));
+            }
+            else if (name == "GET_ENCODER_SCALING_VALUES" || name == "GET_MOTOR_SCALING_VALUES")
+            {
+                for (int i = 0; i < n; i++)
+                    values[i] = scaled(1000.0);
+            }
+            else if (name == "GET_TOOL_ID" || name == "GET_TOOL_INSERTED")
+                values[0] = 1;
+            else if (name == "GET_TIP_LENGTH")
+                values[0] = scaled(300.0);
+            else if (name == "GET_LAST_PWM" && m_settings.deviceType == 1)
+            {
+                // forces are sent in N and Nm, answer in pwm counts
+                const int forceCmd = findCommand("SET_MOTOR_FORCE_AND_TORQUES");
+                for (int i = 0; i < n; i++)
+                    values[i] = lastArg(forceCmd, i) / 100;
+            }
+            // IBox
+            else if (name == "GET_OPENING_VALUES")
+            {
+                for (int i = 0; i < n; i++)
+                    values[i] = scaled(0.5 + 0.5 * a * std::sin(w * t + i));
+            }
+            else if (name == "GET_HANDLE_IDS" || name == "GET_HANDLE_IDS_REAL")
+            {
+                for (int i = 0; i < n; i++)
+                    values[i] = scaled(i + 1);
+            }
+            else if (name == "GET_CONNECTION_STATES")
+                values[0] = 0x3F;
+            // Scope
+            else if (name == "GET_CAMERA_ANGLE")
+                values[0] = scaled(a * 0.5 * std::sin(w * t));
+            else if (name == "GET_ZOOM_LEVEL")
+                values[0] = int(std::lround(10.0 * std::sin(0.1 * w * t)));
+
+            return n;
+        }
+
+        int findCommand(const char* name) const
+        {
+            for (int i = 0; i < m_numCommands; i++)
+                if (std::strcmp(m_commands[i].name, name) == 0)
+                    return i;
+            return 0;
+        }
+
+        const SimSettings& m_settings;
+        const SimCommand* m_commands = nullptr;
+        int m_numCommands = 0;
+        WireProtocol m_protocol;
+        Clock::time_point m_start;
+        std::mt19937 m_random;
+        std::string m_input;
+        std::vector< std::vector<int> > m_lastArgs;
+        std::vector<StreamSubscription> m_streams;
+        uint16_t m_streamSeq = 0;
+        uint64_t m_numStreamFrames = 0;
+        uint64_t m_numRequests = 0;
+        uint64_t m_numDropped = 0;
+    };
+
+
+    void printUsage(const char* program)
+    {
+        std::cout << "Usage: " << program << " [options]\n"
+            << "  --device port|ibox|scope  simulated device (default port)\n"
+            << "  --link PATH               create a symlink PATH to the slave side of the pty\n"
+            << "  --delay-us N              reply delay in microseconds (default 200)\n"
+            << "  --jitter-us N             random jitter added to the delay (default 0)\n"
+            << "  --drop P                  probability to not answer a request (default 0)\n"
+            << "  --frequency F             frequency of the encoder trajectories in Hz (default 0.5)\n"
+            << "  --amplitude A             scale of the encoder trajectories (default 1)\n"
+            << "  --serial N                serial number (default 1234567)\n"
+            << "  --ascii-only              behave as an older firmware without binary protocol\n"
+            << "  --verbose                 print protocol changes and request rates\n";
+    }
+
+    bool parseArguments(int argc, char** argv, SimSettings& settings)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = (i + 1 < argc);
+            if (arg == "--device" && hasValue)
+            {
+                const std::string device = argv[++i];
+                if (device == "port") settings.deviceType = 1;
+                else if (device == "ibox") settings.deviceType = 2;
+                else if (device == "scope") settings.deviceType = 3;
+                else return false;
+            }
+            else if (arg == "--link" && hasValue) settings.link = argv[++i];
+            else if (arg == "--delay-us" && hasValue) settings.delayUs = std::atoi(argv[++i]);
+            else if (arg == "--jitter-us" && hasValue) settings.jitterUs = std::atoi(argv[++i]);
+            else if (arg == "--drop" && hasValue) settings.dropRate = std::atof(argv[++i]);
+            else if (arg == "--frequency" && hasValue) settings.frequency = std::atof(argv[++i]);
+            else if (arg == "--amplitude" && hasValue) settings.amplitude = std::atof(argv[++i]);
+            else if (arg == "--serial" && hasValue) settings.serialNumber = std::atoi(argv[++i]);
+            else if (arg == "--ascii-only") settings.asciiOnly = true;
+            else if (arg == "--verbose") settings.verbose = true;
+            else return false;
+        }
+        return true;
+    }
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+    SimSettings settings;
+    if (!parseArguments(argc, argv, settings))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        std::cerr << "Failed to open a pseudo-terminal: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    // raw line: no echo nor line editing of the requests
+    struct termios tio;
+    if (tcgetattr(master, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(master, TCSANOW, &tio);
+    }
+
+    const std::string slaveName = ptsname(master);
+    if (!settings.link.empty())
+    {
+        unlink(settings.link.c_str());
+        if (symlink(slaveName.c_str(), settings.link.c_str()) != 0)
+            std::cerr << "Failed to create link " << settings.link << ": " << std::strerror(errno) << std::endl;
+    }
+
+    std::signal(SIGINT, stopSimulator);
+    std::signal(SIGTERM, stopSimulator);
+
+    std::cout << "HapticAvatarSimulator device " << settings.deviceType << " on " << slaveName << std::endl;
+
+    SimDevice device(settings);
+    std::deque<PendingReply> replies;
+    char buffer[4096];
+    Clock::time_point nextReport = Clock::now() + std::chrono::seconds(1);
+    uint64_t lastRequests = 0;
+    bool connected = false;
+
+    while (s_running)
+    {
+        Clock::time_point next = device.getNextStreamDue();
+        if (!replies.empty() && replies.front().due < next)
+            next = replies.front().due;
+
+        int timeoutMs = 100;
+        if (next != Clock::time_point::max())
+        {
+            const auto wait = std::chrono::duration_cast<std::chrono::microseconds>(next - Clock::now()).count();
+            timeoutMs = (wait > 0) ? int(std::min<long long>((wait + 999) / 1000, 100)) : 0;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = master;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int res = poll(&pfd, 1, timeoutMs);
+        if (res < 0 && errno != EINTR)
+        {
+            std::cerr << "poll failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        if (res > 0 && (pfd.revents & POLLIN))
+        {
+            ssize_t n = read(master, buffer, sizeof(buffer));
+            if (n > 0)
+            {
+                connected = true;
+                device.receive(buffer, int(n), replies);
+            }
+        }
+        else if (res > 0 && (pfd.revents & POLLHUP))
+        {
+            // no driver has the slave side open: wait for the next one, which finds a freshly reset device
+            if (connected)
+            {
+                device.reset();
+                replies.clear();
+                connected = false;
+                if (settings.verbose)
+                    std::cout << "Driver disconnected, device reset" << std::endl;
+            }
+            usleep(10000);
+            continue;
+        }
+
+        // sub-millisecond delays: spin the remaining time of the next reply
+        while (!replies.empty() && replies.front().due <= Clock::now() + std::chrono::milliseconds(1))
+        {
+            while (Clock::now() < replies.front().due) {}
+            const std::string& bytes = replies.front().bytes;
+            if (write(master, bytes.data(), bytes.size()) < 0)
+                std::cerr << "write failed: " << std::strerror(errno) << std::endl;
+            replies.pop_front();
+        }
+
+        // samples pushed by the device, spinning the last millisecond as the replies
+        const Clock::time_point streamDue = device.getNextStreamDue();
+        if (streamDue <= Clock::now() + std::chrono::milliseconds(1))
+        {
+            while (Clock::now() < streamDue) {}
+            const std::string frame = device.pushStream(Clock::now());
+            if (!frame.empty() && write(master, frame.data(), frame.size()) < 0)
+                std::cerr << "write failed: " << std::strerror(errno) << std::endl;
+        }
+
+        if (settings.verbose && Clock::now() >= nextReport)
+        {
+            std::cout << "requests/s: " << device.getNumRequests() - lastRequests << " dropped: " << device.getNumDropped() << " stream frames: " << device.getNumStreamFrames() << std::endl;
+            lastRequests = device.getNumRequests();
+            nextReport += std::chrono::seconds(1);
+        }
+    }
+
+    close(master);
+    if (!settings.link.empty())
+        unlink(settings.link.c_str());
+
+    return 0;
+}